@@ -0,0 +1,216 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Drives emulated lidars through one RPlidarReactor and reports the system calls of its
+// I/O thread, the wakeups and reads of the drivers and how long their decoding took.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "rplidar.h"
+
+using namespace rp::standalone::rplidar;
+
+namespace {
+
+struct BenchConfig {
+    size_t  lidars;
+    int     seconds;
+    size_t  workers;
+    _u32    transport;
+    _u32    framesPerPacket;
+    _u32    reactorFlags;
+};
+
+void printUsage(const char * name)
+{
+    printf("usage: %s [-n lidars] [-s seconds] [-w workers] [-f frames per packet] [-u] [-e]\n"
+           "  -u  emulate UDP lidars instead of TCP\n"
+           "  -e  wait with epoll even when the build supports io_uring\n", name);
+}
+
+bool parseArgs(int argc, char ** argv, BenchConfig & config)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char * arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (!strcmp(arg, "-u")) {
+            config.transport = DRIVER_TYPE_UDP;
+        } else if (!strcmp(arg, "-e")) {
+            config.reactorFlags |= RPlidarReactor::REACTOR_FLAG_NO_IO_URING;
+        } else if (!strcmp(arg, "-n") && hasValue) {
+            config.lidars = (size_t)atoi(argv[++i]);
+        } else if (!strcmp(arg, "-s") && hasValue) {
+            config.seconds = atoi(argv[++i]);
+        } else if (!strcmp(arg, "-w") && hasValue) {
+            config.workers = (size_t)atoi(argv[++i]);
+        } else if (!strcmp(arg, "-f") && hasValue) {
+            config.framesPerPacket = (_u32)atoi(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return config.lidars > 0 && config.seconds > 0 && config.workers > 0 && config.framesPerPacket > 0;
+}
+
+double perSecond(_u64 count, double seconds)
+{
+    return (double)count / seconds;
+}
+
+double ratio(_u64 count, _u64 total)
+{
+    return total ? (double)count / (double)total : 0.0;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    BenchConfig config = { 8, 10, 2, DRIVER_TYPE_TCP, 1, 0 };
+    if (!parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    RplidarEmulatorConfig emulatorConfig = {};
+    emulatorConfig.transport = config.transport;
+    emulatorConfig.device_count = config.lidars;
+    emulatorConfig.ans_type = RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED;
+    emulatorConfig.scan_frequency = 10;
+    emulatorConfig.sample_rate = 32000;
+    emulatorConfig.frames_per_packet = config.framesPerPacket;
+
+    RPlidarEmulator * emulator = RPlidarEmulator::CreateEmulator(emulatorConfig);
+    if (!emulator) {
+        fprintf(stderr, "cannot start the emulator\n");
+        return 1;
+    }
+
+    RPlidarReactor * reactor = RPlidarReactor::CreateReactor(config.workers, NULL, config.reactorFlags);
+    if (!reactor) {
+        fprintf(stderr, "the reactor is not supported on this platform\n");
+        RPlidarEmulator::DisposeEmulator(emulator);
+        return 1;
+    }
+
+    std::vector<RPlidarDriver *> drivers;
+    bool started = true;
+    for (size_t i = 0; i < config.lidars && started; ++i) {
+        RPlidarDriver * driver = RPlidarDriver::CreateDriver(config.transport);
+        drivers.push_back(driver);
+        driver->setReactor(reactor);
+
+        u_result ans = driver->connect(L"127.0.0.1", emulator->getPort(i));
+        if (IS_OK(ans)) ans = driver->startMotorAsync();
+        if (IS_OK(ans)) ans = driver->startScan(false, true);
+        if (IS_OK(ans)) ans = driver->waitMotorReady();
+        if (IS_FAIL(ans)) {
+            fprintf(stderr, "lidar %d failed to start: %x\n", (int)i, ans);
+            started = false;
+        }
+    }
+
+    if (started) {
+        // measure the steady state only, the connection and scan start go through the channels
+        RplidarReactorStats before;
+        reactor->getStats(before);
+        for (size_t i = 0; i < drivers.size(); ++i) drivers[i]->resetStats();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::seconds(config.seconds));
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        RplidarReactorStats after;
+        reactor->getStats(after);
+        _u64 waitCalls = after.wait_calls - before.wait_calls;
+        _u64 readCalls = after.read_calls - before.read_calls;
+        _u64 completions = after.completions - before.completions;
+        _u64 bytes = after.bytes_received - before.bytes_received;
+
+        RplidarDriverStats total = {};
+        float rateSum = 0;
+        for (size_t i = 0; i < drivers.size(); ++i) {
+            RplidarDriverStats stats;
+            drivers[i]->getStats(stats);
+            total.wakeups += stats.wakeups;
+            total.recv_calls += stats.recv_calls;
+            total.bytes_received += stats.bytes_received;
+            total.scans_published += stats.scans_published;
+            total.ring_overruns += stats.ring_overruns;
+            for (int bin = 0; bin < RplidarDriverStats::DECODE_TIME_BINS; ++bin) {
+                total.decode_time[bin] += stats.decode_time[bin];
+            }
+            rateSum += stats.revolution_rate;
+        }
+
+        printf("backend      %s\n", reactor->getBackend() == RPlidarReactor::REACTOR_BACKEND_IO_URING ? "io_uring" : "epoll");
+        printf("lidars       %d %s, %d frames per packet, %d workers, %.1f s\n", (int)config.lidars,
+               config.transport == DRIVER_TYPE_UDP ? "udp" : "tcp", (int)config.framesPerPacket, (int)config.workers, elapsed);
+        printf("reactor      wait_calls %llu (%.0f/s)  read_calls %llu (%.0f/s)  completions %llu  bytes %llu\n",
+               (unsigned long long)waitCalls, perSecond(waitCalls, elapsed), (unsigned long long)readCalls, perSecond(readCalls, elapsed),
+               (unsigned long long)completions, (unsigned long long)bytes);
+        printf("             system calls per KB %.3f, per revolution %.2f\n",
+               ratio(waitCalls + readCalls, bytes / 1024), ratio(waitCalls + readCalls, total.scans_published));
+        printf("drivers      wakeups %llu (%.0f/s)  recv_calls %llu (%.0f/s)  revolutions %llu (%.1f Hz per lidar)  ring overruns %llu\n",
+               (unsigned long long)total.wakeups, perSecond(total.wakeups, elapsed),
+               (unsigned long long)total.recv_calls, perSecond(total.recv_calls, elapsed),
+               (unsigned long long)total.scans_published, rateSum / drivers.size(), (unsigned long long)total.ring_overruns);
+
+        _u64 decodes = 0;
+        for (int bin = 0; bin < RplidarDriverStats::DECODE_TIME_BINS; ++bin) decodes += total.decode_time[bin];
+        printf("decode time  %llu passes\n", (unsigned long long)decodes);
+        for (int bin = 0; bin < RplidarDriverStats::DECODE_TIME_BINS; ++bin) {
+            if (!total.decode_time[bin]) continue;
+            // the last bin also takes everything longer
+            char upper[16] = "";
+            if (bin + 1 < RplidarDriverStats::DECODE_TIME_BINS) sprintf(upper, "%d", (1 << (bin + 1)) - 1);
+            printf("  %6d - %6s us  %10llu  %5.1f%%\n", bin ? (1 << bin) : 0, upper,
+                   (unsigned long long)total.decode_time[bin], 100.0 * ratio(total.decode_time[bin], decodes));
+        }
+    }
+
+    for (size_t i = 0; i < drivers.size(); ++i) {
+        drivers[i]->stop();
+        drivers[i]->disconnect();
+        RPlidarDriver::DisposeDriver(drivers[i]);
+    }
+    RPlidarReactor::DisposeReactor(reactor);
+    RPlidarEmulator::DisposeEmulator(emulator);
+    return started ? 0 : 1;
+}
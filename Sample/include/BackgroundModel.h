@@ -0,0 +1,63 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include <vector>
+#include <string>
+
+// Per-angle model of the static scene (walls, pillars, furniture, floor reflections).
+// It learns a robust range for every bin over a number of revolutions, then marks
+// points at or behind that range as background and slowly follows drift.
+class BackgroundModel {
+private:
+	int								mBinsPerDegree, mBinCount;
+	int								mRevolutions, mLearned;
+	float							mTolerance, mSpreadScale, mAdaptRate;
+	bool							mLearning;
+	// learned range and spread per bin, kept as plain arrays for the hot path
+	std::vector<float>				mRange, mSpread, mThreshold;
+	std::vector<std::vector<float>>	mSamples;
+	// revolutions that hit each bin while learning, and the last one that counted
+	std::vector<int>				mHitRevolutions, mLastHit;
+	std::vector<int>				mBins;
+	// bins that had a foreground point in the last classify()
+	std::vector<uint8_t>			mOccupied;
+
+	void updateThreshold(int bin);
+
+public:
+	BackgroundModel(int binsPerDegree = 2);
+
+	// tolerance in world units, spreadScale multiplies the learned deviation,
+	// adaptRate is the per-point weight used to follow slow changes
+	void setup		   (int revolutions, float tolerance, float spreadScale, float adaptRate);
+	void startLearning ();
+	// feed one revolution while learning, returns true once the model is complete
+	bool learn		   (const float *angles, const float *distances, size_t count);
+	// writes 1 to background for every point belonging to the learned scene
+	void classify	   (const float *angles, const float *distances, uint8_t *background, size_t count);
+
+	bool isLearning	   () const { return mLearning; }
+	bool isReady	   () const { return !mLearning && mLearned > 0; }
+
+	bool save		   (const ci::fs::path &path) const;
+	bool load		   (const ci::fs::path &path);
+};
@@ -0,0 +1,166 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Xml.h"
+#include "RangeMap.h"
+#include "BackgroundModel.h"
+#include "rplidar.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one fused point, in world coordinates
+struct WorldPoint {
+	ci::vec2	position;
+	double		time;
+	int			device;
+};
+
+// One lidar with its mount pose and everything that is compiled relative to it
+// (exclusion circles, area, learned background). The driver decodes on its own thread and hands
+// every revolution over through a waitScanAsync() request, the app thread never waits for it.
+class LidarDevice {
+private:
+	int								mIndex;
+	std::string						mPort;
+	_u32							mBaudrate;
+	float							mTargetFrequency;
+	ci::vec2						mPosition;
+	float							mRotation, mDirection;
+	ci::vec4						mBoundary;
+	float							mSlope;
+
+	std::shared_ptr<rp::standalone::rplidar::RPlidarDriver>	mDriver;
+	rp::standalone::rplidar::RplidarScanFilter	mScanFilter;
+	std::vector<rplidar_response_measurement_node_hq_t>	mNodes;
+	size_t							mNodeCount;
+	// the pending waitScanAsync() request, SCAN_READY once the driver has completed it
+	enum { SCAN_IDLE, SCAN_WAITING, SCAN_READY };
+	rp::standalone::rplidar::RplidarAsyncRequest	mRequest;
+	std::atomic<int>				mScanState;
+	u_result						mScanResult;
+	std::chrono::steady_clock::time_point	mScanTime;
+	std::vector<float>				mAngles, mDistances;
+	std::vector<uint8_t>			mIsBackground;
+
+	RangeMap						mFilterMap, mAreaMap;
+	bool							mUseArea;
+	float							mAreaExtent;
+	BackgroundModel					mBackground;
+	bool							mUseBackground;
+	ci::fs::path					mBackgroundPath;
+	ci::fs::path					mProfileCachePath;
+
+	// health
+	bool							mHealthy;
+	// mLastScanTime is when the driver published the last revolution, on the app clock
+	double							mLastScanTime, mLastOpenTime, mPeriod;
+	// connects, probes and starts the lidar off the app thread, null when that failed
+	std::future<std::shared_ptr<rp::standalone::rplidar::RPlidarDriver>>	mOpening;
+
+	// run by the open task, they only read the settings loaded at setup
+	std::shared_ptr<rp::standalone::rplidar::RPlidarDriver> openDriver(
+		std::shared_ptr<rp::standalone::rplidar::RPlidarDriver> previous, rp::standalone::rplidar::RplidarScanFilter filter) const;
+	bool checkHealth	(rp::standalone::rplidar::RPlidarDriver &driver) const;
+	void startScan		(rp::standalone::rplidar::RPlidarDriver &driver, const rp::standalone::rplidar::RplidarScanFilter &filter) const;
+	void updateScanFilter();
+	void requestScan	();
+	static void onScan	(rp::standalone::rplidar::RplidarAsyncRequest *request, u_result result);
+
+public:
+	LidarDevice(int index);
+	~LidarDevice();
+
+	// reads the pose, port and roi from a <lidar> block
+	void load			(const ci::XmlTree &lidar, const ci::vec4 &boundary, float slope);
+	void loadFilters	(const ci::XmlTree &params);
+	void loadArea		(const ci::XmlTree &params);
+	void loadBackground	(const ci::XmlTree &params, const ci::fs::path &directory);
+	// lets the driver skip the capability queries on the next open
+	void setProfileCache(const ci::fs::path &path) { mProfileCachePath = path; }
+
+	// starts opening the lidar in the background, closing the current driver first
+	void open			(double now);
+	void close			(bool stopMotor = true);
+	bool isOpen			() const { return (bool)mDriver; }
+	bool isOpening		() const { return mOpening.valid(); }
+	bool isHealthy		() const { return mHealthy; }
+	double getLastOpenTime() const { return mLastOpenTime; }
+	// takes over the lidar once open() has finished, waits for that when wait is set
+	void poll			(double now, bool wait = false);
+	// marks the device unhealthy when no scan arrived for a while, returns true when that changed
+	bool updateHealth	(double now);
+
+	// replaces points with the accepted points of the revolution published since the last call,
+	// ordered by time. Returns false right away when there is none
+	bool grab			(std::vector<WorldPoint> &points, double now);
+	size_t getNodeCount	() const { return mNodeCount; }
+
+	void relearnBackground();
+	void saveBackground	 ();
+
+	int						getIndex	() const { return mIndex; }
+	const std::string&		getPort		() const { return mPort; }
+	const ci::vec2&			getPosition	() const { return mPosition; }
+	float					getRotation	() const { return mRotation; }
+	float					getDirection() const { return mDirection; }
+	std::shared_ptr<rp::standalone::rplidar::RPlidarDriver>	getDriver() const { return mDriver; }
+};
+
+// All lidars of the installation, fused into one time ordered world point stream.
+class LidarGroup {
+private:
+	std::vector<std::unique_ptr<LidarDevice>>	mDevices;
+	std::vector<std::vector<WorldPoint>>		mDevicePoints;
+	std::unordered_map<int64_t, int>			mCells;
+	float										mCellSize;
+	double										mReopenInterval;
+
+public:
+	LidarGroup();
+
+	// creates one device for every <lidar> block
+	void load			(const ci::XmlTree &params, const ci::vec4 &boundary, float slope);
+	void loadFilters	(const ci::XmlTree &params);
+	void loadArea		(const ci::XmlTree &params);
+	void loadBackground	(const ci::XmlTree &params, const ci::fs::path &directory);
+	void setProfileCache(const ci::fs::path &path);
+
+	// opens all devices at once and waits for them, returns the number that could be opened
+	int  open			(double now);
+	void close			();
+
+	// merges the latest revolution of every device by time once any of them has a new one,
+	// returns false and leaves points alone otherwise. Points falling into a grid cell
+	// already covered by another device are dropped as duplicates.
+	bool update			(std::vector<WorldPoint> &points, double now);
+
+	void relearnBackground();
+	void saveBackground	 ();
+
+	size_t					size	 () const { return mDevices.size(); }
+	LidarDevice&			operator[](size_t i) { return *mDevices[i]; }
+};
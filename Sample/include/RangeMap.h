@@ -0,0 +1,57 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include <vector>
+
+// Distance intervals looked up by angle, in the lidar's own polar frame.
+// Shapes are given in world coordinates and compiled once, so testing a scan
+// point costs one bin lookup and a compare per interval stored in that bin.
+class RangeMap {
+private:
+	int								mBinsPerDegree, mBinCount;
+	ci::vec2						mPosition;
+	float							mRotation, mDirection;
+	// intervals added since the last compile, one list per bin
+	std::vector<std::vector<ci::vec2>>	mPending;
+	// compiled intervals of bin i are mIntervals[mOffsets[i]] .. mIntervals[mOffsets[i + 1] - 1]
+	std::vector<uint32_t>			mOffsets;
+	std::vector<ci::vec2>			mIntervals;
+
+	int		 binIndex	 (float angle) const;
+	ci::vec2 binDirection(int bin) const;
+
+public:
+	RangeMap(int binsPerDegree = 10);
+
+	// lidar pose in world coordinates, same convention as SampleApp::grabScanData
+	void setOrigin(const ci::vec2 &position, float rotation, float direction);
+
+	void clear	  ();
+	void addCircle(const ci::vec2 &center, float radius);
+	// polygon may be concave, the inside follows the even-odd rule
+	void addPolygon(const std::vector<ci::vec2> &points);
+	void compile  ();
+
+	// angle in degrees and distance in world units, both as reported by the lidar
+	bool contains (float angle, float distance) const;
+	bool empty	  () const { return mIntervals.empty(); }
+};
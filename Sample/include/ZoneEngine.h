@@ -0,0 +1,120 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "RangeMap.h"
+#include "rplidar.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Presence triggers on named zones, seen by every lidar. Each lidar's decoded sectors are
+// handed over through RPlidarDriver::waitSectorAsync() and measured on the zone thread, so an
+// enter event fires as soon as enough points of one lidar's current sweep land in a zone instead
+// of waiting for a full revolution. The drivers' interval buffers are left to other readers.
+class ZoneEngine {
+public:
+	// called from the zone thread with the zone name and whether it was entered or left
+	using EventFn = std::function<void(const std::string &name, bool entered)>;
+
+private:
+	// a zone as one lidar sees it, compiled in that lidar's polar frame
+	struct View {
+		RangeMap	map;
+		int			hits;
+		int			emptySweeps;
+		bool		occupied;
+	};
+
+	struct Zone {
+		std::string				name;
+		std::vector<ci::vec2>	points;
+		// one per lidar, the zone is occupied while any of them says so
+		std::vector<View>		views;
+		int						occupiedViews;
+	};
+
+	// One lidar's sector subscription. The completion copies the sector into pending and asks
+	// for the next one right away, the zone thread arms it again after the scan stopped.
+	struct Lidar {
+		ZoneEngine				*engine;
+		size_t					index;
+		ci::vec2				position;
+		float					rotation, direction;
+		float					lastAngle;
+
+		// set by setDriver(), taken over by the zone thread; both guarded by mMutex
+		std::shared_ptr<rp::standalone::rplidar::RPlidarDriver>	driver;
+		bool					changed;
+		std::vector<rplidar_response_measurement_node_hq_t>	pending;
+
+		// the driver the request is pending on, only touched while the request isn't
+		std::shared_ptr<rp::standalone::rplidar::RPlidarDriver>	armedDriver;
+		rp::standalone::rplidar::RplidarAsyncRequest			request;
+		std::vector<rplidar_response_measurement_node_hq_t>	buffer, work;
+		std::atomic<bool>		armed;
+	};
+
+	// hits needed within one sweep to enter, at most leaveHits per sweep for
+	// leaveSweeps sweeps in a row to leave
+	int							mEnterHits, mLeaveHits, mLeaveSweeps;
+	std::vector<std::unique_ptr<Zone>>	mZones;
+	std::vector<std::unique_ptr<Lidar>>	mLidars;
+
+	std::mutex					mMutex;
+	std::condition_variable		mSectorCond;
+	bool						mSectorsPending;
+	EventFn						mEventFn;
+	std::thread					mThread;
+	std::atomic<bool>			mRunning;
+
+	void arm		(Lidar &lidar);
+	void endSweep	(size_t lidar);
+	void resetLidar	(size_t lidar);
+	void setOccupied(Zone &zone, View &view, bool occupied);
+	void threadLoop	();
+	static void onSector(rp::standalone::rplidar::RplidarAsyncRequest *request, u_result result);
+
+public:
+	ZoneEngine();
+	~ZoneEngine();
+
+	// lidars are numbered in the order they are added, add them all before starting
+	size_t addLidar	(const ci::vec2 &position, float rotation, float direction);
+	void setup		(int enterHits, int leaveHits, int leaveSweeps);
+	void addZone	(const std::string &name, const std::vector<ci::vec2> &points);
+	bool empty		() const { return mZones.empty() || mLidars.empty(); }
+
+	// feeds one lidar's nodes in scan order, emitting events through fn
+	void process	(size_t lidar, const rplidar_response_measurement_node_hq_t *nodes, size_t count);
+
+	void start		(EventFn fn);
+	void stop		();
+	bool isRunning	() const { return mRunning; }
+	// the lidar's current driver, null while it is closed. Its zones are measured
+	// from scratch when a lidar gets a new driver, after a reopen for instance
+	void setDriver	(size_t lidar, std::shared_ptr<rp::standalone::rplidar::RPlidarDriver> driver);
+};
@@ -0,0 +1,181 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "BackgroundModel.h"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	const char		FILE_MAGIC[4]	= { 'R', 'P', 'B', 'G' };
+	const uint32_t	FILE_VERSION	= 1;
+	// scales a median absolute deviation to the standard deviation of normal noise
+	const float		MAD_TO_SIGMA	= 1.4826f;
+
+	float median(vector<float> &values) {
+		auto mid = values.begin() + values.size() / 2;
+		std::nth_element(values.begin(), mid, values.end());
+		return *mid;
+	}
+}
+
+BackgroundModel::BackgroundModel(int binsPerDegree) {
+	mBinsPerDegree	= binsPerDegree;
+	mBinCount		= 360 * binsPerDegree;
+	mRange			= vector<float>(mBinCount, 0.f);
+	mSpread			= vector<float>(mBinCount, 0.f);
+	mThreshold		= vector<float>(mBinCount, numeric_limits<float>::max());
+	mLearning		= false;
+	mLearned		= 0;
+	setup(50, 5.f, 3.f, .001f);
+}
+
+void BackgroundModel::setup(int revolutions, float tolerance, float spreadScale, float adaptRate) {
+	mRevolutions	= glm::max(1, revolutions);
+	mTolerance		= tolerance;
+	mSpreadScale	= spreadScale;
+	mAdaptRate		= adaptRate;
+	for (int bin = 0; bin < mBinCount; bin++)
+		updateThreshold(bin);
+}
+
+void BackgroundModel::updateThreshold(int bin) {
+	if (mRange[bin] <= 0.f)
+		mThreshold[bin] = numeric_limits<float>::max();
+	else
+		mThreshold[bin] = mRange[bin] - glm::max(mTolerance, mSpreadScale * mSpread[bin]);
+}
+
+void BackgroundModel::startLearning() {
+	mSamples = vector<vector<float>>(mBinCount);
+	mHitRevolutions = vector<int>(mBinCount, 0);
+	mLastHit		= vector<int>(mBinCount, -1);
+	mLearned = 0;
+	mLearning = true;
+}
+
+bool BackgroundModel::learn(const float *angles, const float *distances, size_t count) {
+	if (!mLearning) return false;
+
+	for (size_t i = 0; i < count; i++) {
+		int bin = int(angles[i] * mBinsPerDegree) % mBinCount;
+		mSamples[bin].push_back(distances[i]);
+		// a bin gets several points per revolution, count each revolution once
+		if (mLastHit[bin] != mLearned) {
+			mLastHit[bin] = mLearned;
+			mHitRevolutions[bin]++;
+		}
+	}
+	if (++mLearned < mRevolutions) return false;
+
+	for (int bin = 0; bin < mBinCount; bin++) {
+		auto &samples = mSamples[bin];
+		// bins that rarely return anything are open space, nothing there is background
+		if (mHitRevolutions[bin] * 2 < mRevolutions) {
+			mRange[bin]	 = 0.f;
+			mSpread[bin] = 0.f;
+		} else {
+			// median and median absolute deviation, so people walking by while learning don't count
+			float range = median(samples);
+			for (auto &sample : samples)
+				sample = glm::abs(sample - range);
+			mRange[bin]	 = range;
+			mSpread[bin] = MAD_TO_SIGMA * median(samples);
+		}
+		updateThreshold(bin);
+	}
+	mSamples.clear();
+	mHitRevolutions.clear();
+	mLastHit.clear();
+	mLearning = false;
+	return true;
+}
+
+void BackgroundModel::classify(const float *angles, const float *distances, uint8_t *background, size_t count) {
+	if (mBins.size() < count) mBins.resize(count);
+	int *bins = mBins.data();
+	const float *threshold = mThreshold.data();
+
+	// branch free so the compare loop vectorizes
+	for (size_t i = 0; i < count; i++)
+		bins[i] = int(angles[i] * mBinsPerDegree) % mBinCount;
+	for (size_t i = 0; i < count; i++)
+		background[i] = uint8_t(distances[i] >= threshold[bins[i]]);
+
+	if (mAdaptRate <= 0.f) return;
+
+	// a bin with anything in front of it this time is left alone, even its background points
+	if (mOccupied.size() != size_t(mBinCount)) mOccupied.resize(mBinCount);
+	std::fill(mOccupied.begin(), mOccupied.end(), uint8_t(0));
+	for (size_t i = 0; i < count; i++)
+		if (!background[i]) mOccupied[bins[i]] = 1;
+
+	// follow slow drift of the scene, keeping the spread on the learned sigma scale
+	for (size_t i = 0; i < count; i++) {
+		int bin = bins[i];
+		if (!background[i] || mOccupied[bin]) continue;
+		float delta = distances[i] - mRange[bin];
+		mRange[bin]	 += mAdaptRate * delta;
+		mSpread[bin] += mAdaptRate * (MAD_TO_SIGMA * glm::abs(delta) - mSpread[bin]);
+		updateThreshold(bin);
+	}
+}
+
+bool BackgroundModel::save(const fs::path &path) const {
+	ofstream file(path.string(), ios::binary);
+	if (!file) return false;
+
+	uint32_t bins = mBinCount;
+	file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+	file.write((const char*)&FILE_VERSION, sizeof(FILE_VERSION));
+	file.write((const char*)&bins, sizeof(bins));
+	file.write((const char*)mRange.data(), mBinCount * sizeof(float));
+	file.write((const char*)mSpread.data(), mBinCount * sizeof(float));
+	return file.good();
+}
+
+bool BackgroundModel::load(const fs::path &path) {
+	ifstream file(path.string(), ios::binary);
+	if (!file) return false;
+
+	char	 magic[4];
+	uint32_t version, bins;
+	file.read(magic, sizeof(magic));
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&bins, sizeof(bins));
+	if (!file || !std::equal(magic, magic + 4, FILE_MAGIC) ||
+		version != FILE_VERSION || bins != uint32_t(mBinCount))
+		return false;
+
+	vector<float> range(mBinCount), spread(mBinCount);
+	file.read((char*)range.data(), mBinCount * sizeof(float));
+	file.read((char*)spread.data(), mBinCount * sizeof(float));
+	if (!file) return false;
+
+	mRange.swap(range);
+	mSpread.swap(spread);
+	for (int bin = 0; bin < mBinCount; bin++)
+		updateThreshold(bin);
+	mLearned  = mRevolutions;
+	mLearning = false;
+	return true;
+}
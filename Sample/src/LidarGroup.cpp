@@ -0,0 +1,509 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "LidarGroup.h"
+#include "cinder/Log.h"
+#include <algorithm>
+#include <future>
+
+using namespace std;
+using namespace ci;
+using namespace rp::standalone::rplidar;
+
+static const int	MAX_NODES		= 8192;
+static const double	STALL_TIME		= 2.0;
+
+LidarDevice::LidarDevice(int index) {
+	mIndex			= index;
+	mBaudrate		= 115200;
+	mTargetFrequency = 0.f;
+	mPosition		= vec2(0.f);
+	mRotation		= 0.f;
+	mDirection		= 1.f;
+	mBoundary		= vec4(0.f);
+	mSlope			= 0.f;
+	mNodes.resize(MAX_NODES);
+	mNodeCount		= 0;
+	mRequest		= RplidarAsyncRequest();
+	mScanState		= SCAN_IDLE;
+	mScanResult		= RESULT_OK;
+	mAngles.resize(MAX_NODES);
+	mDistances.resize(MAX_NODES);
+	mIsBackground.resize(MAX_NODES);
+	mUseArea		= false;
+	mAreaExtent		= 0.f;
+	mUseBackground	= false;
+	mHealthy		= false;
+	mLastScanTime	= 0.0;
+	mLastOpenTime	= 0.0;
+	mPeriod			= .1;
+	memset(&mScanFilter, 0, sizeof(mScanFilter));
+}
+
+LidarDevice::~LidarDevice() {
+	close();
+}
+
+void LidarDevice::load(const XmlTree &lidar, const vec4 &boundary, float slope) {
+	mPort		= "\\\\.\\" + lidar.getChild("port").getValue<string>();
+	if (lidar.hasChild("baudrate"))
+		mBaudrate = lidar.getChild("baudrate").getValue<_u32>();
+	if (lidar.hasChild("frequency"))
+		mTargetFrequency = lidar.getChild("frequency").getValue<float>();
+	mRotation	= glm::radians(lidar.getChild("angle").getValue<float>());
+	mPosition.x = lidar.getChild("position").getChild("x").getValue<float>();
+	mPosition.y = lidar.getChild("position").getChild("y").getValue<float>();
+	mDirection	= (lidar.getChild("topdown").getValue<string>() == "true") ? -1.f : +1.f;
+	mBoundary	= boundary;
+	mSlope		= slope;
+
+	memset(&mScanFilter, 0, sizeof(mScanFilter));
+	if (lidar.hasChild("roi")) {
+		auto roi = lidar.getChild("roi");
+		for (auto range = roi.begin("range"); range != roi.end() &&
+			mScanFilter.angle_range_count < RplidarScanFilter::MAX_ANGLE_RANGES; ++range) {
+			auto &angleRange = mScanFilter.angle_ranges[mScanFilter.angle_range_count++];
+			angleRange.from	 = range->getChild("from").getValue<float>();
+			angleRange.to	 = range->getChild("to").getValue<float>();
+			CI_LOG_V("add roi range: " << angleRange.from << "-" << angleRange.to);
+		}
+		if (roi.hasChild("quality"))
+			mScanFilter.min_quality = roi.getChild("quality").getValue<int>();
+	}
+	updateScanFilter();
+}
+
+void LidarDevice::updateScanFilter() {
+	// let the driver drop everything beyond the farthest corner of the scan area (in mm)
+	float maxDistance = 10.f * mAreaExtent;
+	for (auto corner : { vec2(mBoundary.x, mBoundary.y), vec2(mBoundary.z, mBoundary.y),
+						 vec2(mBoundary.x, mBoundary.w), vec2(mBoundary.z, mBoundary.w) })
+		maxDistance = glm::max(maxDistance, 10.f * glm::distance(mPosition, corner));
+	mScanFilter.max_distance = maxDistance;
+
+	if (mDriver) mDriver->setScanFilter(&mScanFilter);
+}
+
+void LidarDevice::loadFilters(const XmlTree &params) {
+	// exclusion circles are fixed relative to the lidar, so turn them into
+	// per-angle distance intervals once instead of testing every point against every dot
+	mFilterMap.clear();
+	mFilterMap.setOrigin(mPosition, mRotation, mDirection);
+
+	auto filters = params.getChild("filter");
+	for (auto dot : filters) {
+		float xx = dot.getChild("x").getValue<float>();
+		float yy = dot.getChild("y").getValue<float>();
+		float rr = dot.getChild("r").getValue<float>();
+		CI_LOG_V("add filter: " << xx << "-" << yy << "-" << rr);
+		mFilterMap.addCircle(vec2(xx, yy), rr);
+	}
+	mFilterMap.compile();
+}
+
+void LidarDevice::loadArea(const XmlTree &params) {
+	// polygons replace the min/max box and slope, each angle gets the distance ranges inside them
+	mAreaMap.clear();
+	mAreaMap.setOrigin(mPosition, mRotation, mDirection);
+	mAreaExtent = 0.f;
+	mUseArea	= params.hasChild("area");
+
+	if (mUseArea) {
+		auto area = params.getChild("area");
+		for (auto polygon = area.begin("polygon"); polygon != area.end(); ++polygon) {
+			vector<vec2> points;
+			for (auto point = polygon->begin("point"); point != polygon->end(); ++point) {
+				vec2 p(point->getChild("x").getValue<float>(), point->getChild("y").getValue<float>());
+				mAreaExtent = glm::max(mAreaExtent, glm::distance(mPosition, p));
+				points.push_back(p);
+			}
+			CI_LOG_V("add area polygon: " << points.size() << " points");
+			mAreaMap.addPolygon(points);
+		}
+		mAreaMap.compile();
+	}
+
+	// the driver must not drop points of a larger area
+	updateScanFilter();
+}
+
+void LidarDevice::loadBackground(const XmlTree &params, const fs::path &directory) {
+	mUseBackground = params.hasChild("background");
+	if (!mUseBackground) return;
+
+	auto background = params.getChild("background");
+	mBackground.setup(
+		background.getChild("revolutions").getValue<int>(),
+		background.getChild("tolerance").getValue<float>(),
+		background.getChild("spread").getValue<float>(),
+		background.getChild("adapt").getValue<float>());
+
+	// every lidar sees its own background, the first one keeps the configured name
+	fs::path file = background.getChild("file").getValue<string>();
+	if (mIndex > 0)
+		file = file.stem().string() + "_" + to_string(mIndex) + file.extension().string();
+	mBackgroundPath = directory / file;
+
+	if (mBackground.load(mBackgroundPath)) {
+		CI_LOG_I("loaded background from " << mBackgroundPath);
+	} else {
+		CI_LOG_I("learning background for lidar " << mIndex);
+		mBackground.startLearning();
+	}
+}
+
+static void closeDriver(RPlidarDriver &driver, bool stopMotor) {
+	driver.stop();
+	if (stopMotor) driver.stopMotorAsync();
+	driver.disconnect();
+}
+
+bool LidarDevice::checkHealth(RPlidarDriver &driver) const {
+	u_result						 op_result;
+	rplidar_response_device_health_t healthinfo;
+	op_result = driver.getHealth(healthinfo);
+
+	if (IS_OK(op_result)) {
+		CI_LOG_I( "RPLidar " << mIndex << " health status: " << int(healthinfo.status) );
+		if (healthinfo.status == RPLIDAR_STATUS_ERROR) {
+			CI_LOG_I("Error, rplidar internal error detected. Please reboot the device to retry.");
+			// the lidar is opened again after the reopen interval
+			driver.reset();
+			return false;
+		}
+		else if (healthinfo.status == RPLIDAR_STATUS_OK) {
+			CI_LOG_I("OK");
+			return true;
+		}
+		else if (healthinfo.status == RPLIDAR_STATUS_WARNING) {
+			CI_LOG_I("WARNING");
+			return true;
+		}
+	} else {
+		CI_LOG_I("Error, cannot retrieve the lidar health code: " << op_result);
+	}
+	return false;
+}
+
+void LidarDevice::open(double now) {
+	if (mOpening.valid()) return;
+	mLastOpenTime = now;
+	mHealthy	  = false;
+
+	// connecting and probing take several round trips to the lidar, the app keeps rendering meanwhile
+	shared_ptr<RPlidarDriver> previous;
+	previous.swap(mDriver);
+	mOpening = async(launch::async, &LidarDevice::openDriver, this, previous, mScanFilter);
+}
+
+shared_ptr<RPlidarDriver> LidarDevice::openDriver(shared_ptr<RPlidarDriver> previous, RplidarScanFilter filter) const {
+	// a lidar reopened after a stall is most likely still spinning, don't cycle its motor
+	bool reopen = (bool)previous;
+	if (previous) closeDriver(*previous, false);
+
+	std::wstring wPort = std::wstring(mPort.begin(), mPort.end());
+	shared_ptr<RPlidarDriver> driver(RPlidarDriver::CreateDriver(DRIVER_TYPE_SERIALPORT));
+	if (!mProfileCachePath.empty())
+		driver->setProfileCache(mProfileCachePath.string().c_str());
+
+	rplidar_response_device_info_t devinfo;
+	if (!IS_OK(driver->connect(wPort.c_str(), mBaudrate, reopen ? RPlidarDriver::CONNECT_FLAG_KEEP_MOTOR : 0)) ||
+		!IS_OK(driver->getDeviceInfo(devinfo))) {
+		CI_LOG_E("cannot open lidar " << mIndex << " on " << mPort);
+		return nullptr;
+	}
+	if (!checkHealth(*driver)) return nullptr;
+
+	startScan(*driver, filter);
+	return driver;
+}
+
+void LidarDevice::startScan(RPlidarDriver &driver, const RplidarScanFilter &filter) const {
+	// the scan can start while the motor spins up, the first revolutions are just sparser
+	driver.startMotorAsync();
+
+	// lidars with a configurable speed hold it themselves, A2 boards are regulated by the driver
+	bool speedSet = mTargetFrequency <= 0.f ||
+		IS_OK(driver.setDesiredRotationFrequency(mTargetFrequency));
+	driver.startScan(false, true);
+	driver.setScanFilter(&filter);
+	if (!speedSet && !IS_OK(driver.setTargetFrequency(mTargetFrequency)))
+		CI_LOG_W("lidar " << mIndex << " can't change its speed, ignoring its frequency");
+}
+
+void LidarDevice::poll(double now, bool wait) {
+	if (!mOpening.valid()) return;
+	if (!wait && mOpening.wait_for(chrono::seconds(0)) != future_status::ready) return;
+
+	mDriver = mOpening.get();
+	if (!mDriver) return;
+	// the filters may have been reloaded while the lidar was opening
+	mDriver->setScanFilter(&mScanFilter);
+	mLastScanTime = now;
+	mHealthy	  = true;
+}
+
+void LidarDevice::close(bool stopMotor) {
+	// an open in progress can't be cancelled, wait for it and close what it opened
+	if (mOpening.valid()) mDriver = mOpening.get();
+	if (mDriver) {
+		closeDriver(*mDriver, stopMotor);
+		mDriver.reset();
+	}
+	// stopping the scan has completed the pending request
+	mScanState	= SCAN_IDLE;
+	mNodeCount	= 0;
+	mHealthy	= false;
+}
+
+bool LidarDevice::updateHealth(double now) {
+	bool healthy = mDriver && now - mLastScanTime < STALL_TIME;
+	if (healthy == mHealthy) return false;
+	mHealthy = healthy;
+	return true;
+}
+
+void LidarDevice::requestScan() {
+	if (!mDriver || mScanState != SCAN_IDLE) return;
+
+	mRequest			= RplidarAsyncRequest();
+	mRequest.complete	= &LidarDevice::onScan;
+	mRequest.context	= this;
+	mRequest.nodebuffer	= mNodes.data();
+	mRequest.count		= mNodes.size();
+	mScanState			= SCAN_WAITING;
+	// fails while the driver isn't scanning, the next frame asks again
+	if (!IS_OK(mDriver->waitScanAsync(&mRequest)))
+		mScanState = SCAN_IDLE;
+}
+
+void LidarDevice::onScan(RplidarAsyncRequest *request, u_result result) {
+	// runs on the thread that published the revolution, only note when that happened
+	LidarDevice *device = static_cast<LidarDevice*>(request->context);
+	device->mScanResult = result;
+	device->mScanTime	= chrono::steady_clock::now();
+	device->mScanState	= SCAN_READY;
+}
+
+bool LidarDevice::grab(vector<WorldPoint> &points, double now) {
+	if (mScanState != SCAN_READY) {
+		requestScan();
+		return false;
+	}
+	RPLIDAR_TRACE_SCOPE("LidarDevice::grab");
+	mScanState = SCAN_IDLE;
+
+	// a request cut short by a stop or a reopen carries no revolution
+	if (!IS_OK(mScanResult) || !mDriver) {
+		requestScan();
+		return false;
+	}
+	mNodeCount = mRequest.count;
+	mDriver->ascendScanData(mNodes.data(), mNodeCount);
+
+	// the revolution ended when the driver published it, however long ago this frame started.
+	// Spread its points over the period the lidar measured, not over the app's frame time
+	mLastScanTime = now - chrono::duration<double>(chrono::steady_clock::now() - mScanTime).count();
+	float frequency;
+	if (IS_OK(mDriver->getMeasuredFrequency(frequency)))
+		mPeriod = 1. / frequency;
+
+	size_t valid = 0;
+	for (size_t pos = 0; pos < mNodeCount; ++pos) {
+		float d = .1f * mNodes[pos].dist_mm_q2 / 4.f;
+		if (d > 0.f) {
+			mAngles[valid]	  = mNodes[pos].angle_z_q14 * 90.f / 16384.f;
+			mDistances[valid] = d;
+			valid++;
+		}
+	}
+
+	//background check
+	RPLIDAR_TRACE_BEGIN("LidarDevice::background");
+	std::fill(mIsBackground.begin(), mIsBackground.begin() + valid, 0);
+	if (mUseBackground) {
+		if (mBackground.isLearning()) {
+			if (mBackground.learn(mAngles.data(), mDistances.data(), valid)) {
+				CI_LOG_I("background learned for lidar " << mIndex);
+				saveBackground();
+			}
+		} else {
+			mBackground.classify(mAngles.data(), mDistances.data(), mIsBackground.data(), valid);
+		}
+	}
+	RPLIDAR_TRACE_END("LidarDevice::background");
+
+	RPLIDAR_TRACE_SCOPE("LidarDevice::project");
+	points.clear();
+	for (size_t i = 0; i < valid; ++i) {
+		if (mIsBackground[i]) continue;
+
+		float theta = mAngles[i];
+		float d = mDistances[i];
+		float a = mRotation + mDirection * glm::radians(theta);
+		vec2 p = mPosition + d * vec2(glm::cos(a), glm::sin(a));
+
+		bool inside;
+		if (mUseArea) {
+			//area check
+			inside = mAreaMap.contains(theta, d);
+		} else {
+			//slope check
+			float rt = glm::clamp((p.x - mSlope) / (mBoundary.z - mSlope), 0.f, 1.f);
+			float threshold = glm::lerp(mBoundary.y, mBoundary.w, rt);
+			inside = p.x >= mBoundary.x && p.x <= mBoundary.z &&
+				p.y >= threshold && p.y <= mBoundary.w;
+		}
+
+		//filter check
+		if (inside && !mFilterMap.contains(theta, d)) {
+			WorldPoint point;
+			point.position	= p;
+			point.time		= mLastScanTime - mPeriod * (1. - theta / 360.);
+			point.device	= mIndex;
+			points.push_back(point);
+		}
+	}
+	requestScan();
+	return true;
+}
+
+void LidarDevice::relearnBackground() {
+	if (mUseBackground) mBackground.startLearning();
+}
+
+void LidarDevice::saveBackground() {
+	if (!mUseBackground || !mBackground.isReady()) return;
+	if (!mBackground.save(mBackgroundPath))
+		CI_LOG_E("error saving background to " << mBackgroundPath);
+}
+
+LidarGroup::LidarGroup() {
+	mCellSize		= 10.f;
+	mReopenInterval = 5.0;
+}
+
+void LidarGroup::load(const XmlTree &params, const vec4 &boundary, float slope) {
+	mDevices.clear();
+	for (auto lidar = params.begin("lidar"); lidar != params.end(); ++lidar) {
+		unique_ptr<LidarDevice> device(new LidarDevice(mDevices.size()));
+		device->load(*lidar, boundary, slope);
+		mDevices.push_back(std::move(device));
+	}
+	mDevicePoints.resize(mDevices.size());
+
+	if (params.hasChild("fusion")) {
+		auto fusion = params.getChild("fusion");
+		mCellSize		= glm::max(1.f, fusion.getChild("cell").getValue<float>());
+		mReopenInterval = fusion.getChild("reopen").getValue<double>();
+	}
+}
+
+void LidarGroup::loadFilters(const XmlTree &params) {
+	for (auto &device : mDevices) device->loadFilters(params);
+}
+
+void LidarGroup::loadArea(const XmlTree &params) {
+	for (auto &device : mDevices) device->loadArea(params);
+}
+
+void LidarGroup::loadBackground(const XmlTree &params, const fs::path &directory) {
+	for (auto &device : mDevices) device->loadBackground(params, directory);
+}
+
+void LidarGroup::setProfileCache(const fs::path &path) {
+	for (auto &device : mDevices) device->setProfileCache(path);
+}
+
+int LidarGroup::open(double now) {
+	for (auto &device : mDevices) device->open(now);
+
+	int opened = 0;
+	for (auto &device : mDevices) {
+		device->poll(now, true);
+		opened += device->isOpen() ? 1 : 0;
+	}
+	return opened;
+}
+
+void LidarGroup::close() {
+	for (auto &device : mDevices) device->close();
+}
+
+bool LidarGroup::update(vector<WorldPoint> &points, double now) {
+	for (auto &device : mDevices) {
+		device->poll(now);
+		if (device->updateHealth(now)) {
+			if (device->isHealthy())
+				CI_LOG_I("lidar " << device->getIndex() << " on " << device->getPort() << " is back");
+			else
+				CI_LOG_E("lidar " << device->getIndex() << " on " << device->getPort() << " stopped sending scans");
+		}
+		// give a stalled or missing lidar another chance now and then
+		if (!device->isHealthy() && !device->isOpening() && now - device->getLastOpenTime() >= mReopenInterval)
+			device->open(now);
+	}
+
+	// the drivers hand their revolutions over as they publish them, nothing here waits.
+	// Each device keeps its latest revolution so the others still count in a frame it has none
+	bool fresh = false;
+	for (size_t i = 0; i < mDevices.size(); i++) {
+		if (mDevices[i]->grab(mDevicePoints[i], now)) {
+			fresh = true;
+		} else if (!mDevices[i]->isHealthy() && !mDevicePoints[i].empty()) {
+			// a stalled lidar's last revolution would linger
+			mDevicePoints[i].clear();
+			fresh = true;
+		}
+	}
+	if (!fresh) return false;
+
+	// every device's points are already in time order, merge them one run at a time
+	RPLIDAR_TRACE_SCOPE("LidarGroup::merge");
+	points.clear();
+	for (size_t i = 0; i < mDevices.size(); i++) {
+		size_t mid = points.size();
+		points.insert(points.end(), mDevicePoints[i].begin(), mDevicePoints[i].end());
+		std::inplace_merge(points.begin(), points.begin() + mid, points.end(),
+			[](const WorldPoint &a, const WorldPoint &b) { return a.time < b.time; });
+	}
+
+	// overlapping lidars see the same people, keep a grid cell for the first device reporting it
+	if (mDevices.size() > 1) {
+		mCells.clear();
+		size_t kept = 0;
+		for (size_t i = 0; i < points.size(); i++) {
+			int64_t cx = (int64_t)glm::floor(points[i].position.x / mCellSize);
+			int64_t cy = (int64_t)glm::floor(points[i].position.y / mCellSize);
+			auto cell = mCells.emplace((cx << 32) ^ (cy & 0xFFFFFFFF), points[i].device);
+			if (cell.second || cell.first->second == points[i].device)
+				points[kept++] = points[i];
+		}
+		points.resize(kept);
+	}
+	return true;
+}
+
+void LidarGroup::relearnBackground() {
+	for (auto &device : mDevices) device->relearnBackground();
+}
+
+void LidarGroup::saveBackground() {
+	for (auto &device : mDevices) device->saveBackground();
+}
@@ -0,0 +1,137 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RangeMap.h"
+#include <algorithm>
+
+using namespace std;
+using namespace ci;
+
+RangeMap::RangeMap(int binsPerDegree) {
+	mBinsPerDegree	= binsPerDegree;
+	mBinCount		= 360 * binsPerDegree;
+	mPosition		= vec2(0.f);
+	mRotation		= 0.f;
+	mDirection		= 1.f;
+	clear();
+}
+
+void RangeMap::setOrigin(const vec2 &position, float rotation, float direction) {
+	mPosition	= position;
+	mRotation	= rotation;
+	mDirection	= direction;
+}
+
+int RangeMap::binIndex(float angle) const {
+	int bin = int(angle * mBinsPerDegree) % mBinCount;
+	return (bin < 0) ? bin + mBinCount : bin;
+}
+
+vec2 RangeMap::binDirection(int bin) const {
+	float a = mRotation + mDirection * glm::radians((bin + .5f) / mBinsPerDegree);
+	return vec2(glm::cos(a), glm::sin(a));
+}
+
+void RangeMap::clear() {
+	mPending = vector<vector<vec2>>(mBinCount);
+	mOffsets = vector<uint32_t>(mBinCount + 1, 0);
+	mIntervals.clear();
+}
+
+void RangeMap::addCircle(const vec2 &center, float radius) {
+	vec2 q = center - mPosition;
+	float r2 = radius * radius;
+	for (int bin = 0; bin < mBinCount; bin++) {
+		// closest approach of the ray to the circle center
+		float t	 = glm::dot(binDirection(bin), q);
+		float h2 = glm::dot(q, q) - t * t;
+		if (h2 > r2) continue;
+
+		float dt = glm::sqrt(r2 - h2);
+		if (t + dt < 0.f) continue;
+		mPending[bin].push_back(vec2(glm::max(t - dt, 0.f), t + dt));
+	}
+}
+
+void RangeMap::addPolygon(const vector<vec2> &points) {
+	if (points.size() < 3) return;
+
+	vector<float> hits;
+	for (int bin = 0; bin < mBinCount; bin++) {
+		vec2 u = binDirection(bin);
+		hits.clear();
+
+		// distance along the ray line to every edge crossing it, behind the origin included
+		for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+			vec2 a = points[j] - mPosition;
+			vec2 b = points[i] - mPosition;
+			float sa = u.x * a.y - u.y * a.x;
+			float sb = u.x * b.y - u.y * b.x;
+			// half open test so a ray through a vertex counts it once
+			if ((sa > 0.f) == (sb > 0.f)) continue;
+
+			float s = sa / (sa - sb);
+			hits.push_back(glm::dot(u, a + s * (b - a)));
+		}
+		std::sort(hits.begin(), hits.end());
+
+		// crossings behind the origin tell whether it starts inside
+		size_t first = std::upper_bound(hits.begin(), hits.end(), 0.f) - hits.begin();
+		float start = 0.f;
+		bool inside = (first & 1) != 0;
+		for (size_t k = first; k < hits.size(); k++) {
+			if (inside) mPending[bin].push_back(vec2(start, hits[k]));
+			start = hits[k];
+			inside = !inside;
+		}
+	}
+}
+
+void RangeMap::compile() {
+	vector<vec2> intervals;
+	for (int bin = 0; bin < mBinCount; bin++) {
+		mOffsets[bin] = intervals.size();
+		auto &pending = mPending[bin];
+		if (pending.empty()) continue;
+
+		// merge overlapping intervals so each bin holds as few as possible
+		std::sort(pending.begin(), pending.end(), [](const vec2 &a, const vec2 &b) { return a.x < b.x; });
+		vec2 current = pending[0];
+		for (size_t i = 1; i < pending.size(); i++) {
+			if (pending[i].x <= current.y) {
+				current.y = glm::max(current.y, pending[i].y);
+			} else {
+				intervals.push_back(current);
+				current = pending[i];
+			}
+		}
+		intervals.push_back(current);
+	}
+	mOffsets[mBinCount] = intervals.size();
+	mIntervals.swap(intervals);
+}
+
+bool RangeMap::contains(float angle, float distance) const {
+	int bin = binIndex(angle);
+	for (uint32_t i = mOffsets[bin]; i < mOffsets[bin + 1]; i++) {
+		const vec2 &interval = mIntervals[i];
+		if (distance >= interval.x && distance <= interval.y) return true;
+	}
+	return false;
+}
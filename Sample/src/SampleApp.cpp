@@ -28,6 +28,8 @@
 
 #include "rplidar.h" 
 #include "KMeans.h"
+#include "LidarGroup.h"
+#include "ZoneEngine.h"
 
 #include <iostream>
 
@@ -56,26 +58,32 @@ protected:
 	bool								mDrawPoint, mDrawCluster, mUseRender, mActive;
 	// Rendering section
 	vector<vec2>						mPoints, mClusters;
-	vector<vec3>						mFilters;
 	int									mClusterCount, mHour, mMinute, NUM_THRESHOLD;
 	gl::BufferTextureRef				mPointBuffer, mClusterBuffer;
 	gl::VboRef							mInstanceDataVbo, mPointVbo, mClusterVbo;
 	gl::BatchRef						mPointBatch, mClusterBatch;
 	// OSC sender
-	SenderRef							mSender;
+	SenderRef							mSender, mZoneSender;
+	// zone triggers
+	ZoneEngine							mZones;
 	// lidar stuff
 	vector<PointRef>					mPointData;
-	shared_ptr<RPlidarDriver>			mDriver;
-	rplidar_response_measurement_node_t nodes[MAX_NODES];
+	LidarGroup							mLidars;
+	vector<WorldPoint>					mWorldPoints;
 	size_t								count;
-	float								mRotation, mSlope, mDirection;
-	vec2								mPosition;
+	float								mSlope;
 	vec4								mBoundary;
+	// settings hot reload
+	fs::path							mSettingsPath;
+	decltype(fs::last_write_time(fs::path()))	mSettingsTime;
+	double								mSettingsCheckTime;
 
 	bool isTimeup	 ();
 	void turnoff	 ();
 	bool grabScanData();
-	bool checkRPLIDARHealth(shared_ptr<RPlidarDriver> drv);
+	void loadZones	 (const XmlTree &params, const string &host, uint16_t port);
+	void updateZones ();
+	void reloadSettings();
 	void initBatch	 ();
 	void onSendError (asio::error_code error);
 
@@ -138,40 +146,22 @@ void SampleApp::initBatch() {
 }
 
 bool SampleApp::grabScanData() {
-	u_result op_result = mDriver->grabScanData(nodes, count);
+	// nothing to do until one of the lidars has finished a revolution
+	if (!mLidars.update(mWorldPoints, getElapsedSeconds())) return false;
 
-	if (IS_OK(op_result)) {
+	count = 0;
+	for (size_t i = 0; i < mLidars.size(); i++)
+		count += mLidars[i].getNodeCount();
+	count = ci::math<size_t>::min(count, MAX_NODES);
+
+	if (count > 0) {
 		std::fill(mPoints.begin(), mPoints.end(), vec2(655350.f));
-		mDriver->ascendScanData(nodes, count);
 
+		// fused points of all lidars, in time order
 		int idx = 0;
-		for (int pos = 0; pos < (int)count; ++pos) {
-			float a = mRotation + mDirection *
-				glm::radians((nodes[pos].angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) / 64.f);
-			float d = .1f * nodes[pos].distance_q2 / 4.f;
-
-			if (d > 0.f) {
-				vec2 p = mPosition + d * vec2(glm::cos(a), glm::sin(a));
-				float rt = glm::clamp((p.x - mSlope) / (mBoundary.z - mSlope), 0.f, 1.f);
-				float threshold = glm::lerp(mBoundary.y, mBoundary.w, rt);
-
-				//slope check
-				if (p.x >= mBoundary.x && p.x <= mBoundary.z &&
-					p.y >= threshold && p.y <= mBoundary.w) {
-
-					bool shouldAdd = true;
-					//filter check
-					for (auto filter : mFilters) {
-						if (glm::distance2(p, vec2(filter.x, filter.y)) <
-							filter.z * filter.z) {
-							shouldAdd = false;
-							break;
-						}
-					}
-
-					if (shouldAdd) mPointData[idx++]->setPosition(p);
-				}
-			}
+		for (const auto &point : mWorldPoints) {
+			if (idx >= MAX_NODES) break;
+			mPointData[idx++]->setPosition(point.position);
 		}
 
 		for (int pos = idx; pos < MAX_NODES; pos++) {
@@ -182,29 +172,67 @@ bool SampleApp::grabScanData() {
 	return false;
 }
 
-bool SampleApp::checkRPLIDARHealth(shared_ptr<RPlidarDriver> drv) {
-	u_result						 op_result;
-	rplidar_response_device_health_t healthinfo;
-	op_result = drv->getHealth(healthinfo);
-
-	if (IS_OK(op_result)) {
-		CI_LOG_I( "RPLidar health status: " << int(healthinfo.status) );
-		if (healthinfo.status == RPLIDAR_STATUS_ERROR) {
-			CI_LOG_I("Error, rplidar internal error detected. Please reboot the device to retry.");
-			drv->reset();
-			return false;
-		}
-		else if (healthinfo.status == RPLIDAR_STATUS_OK) {
-			CI_LOG_I("OK");
-			return true;
-		}
-		else if (healthinfo.status == RPLIDAR_STATUS_WARNING) {
-			CI_LOG_I("WARNING");
-			return true;
-		}
-	} else {
-		CI_LOG_I("Error, cannot retrieve the lidar health code: " << op_result);
-		return false;
+void SampleApp::loadZones(const XmlTree &params, const string &host, uint16_t port) {
+	if (!params.hasChild("zones") || mLidars.size() == 0) return;
+
+	// every lidar measures the zones, any of them seeing someone is enough
+	auto zones = params.getChild("zones");
+	for (size_t i = 0; i < mLidars.size(); i++)
+		mZones.addLidar(mLidars[i].getPosition(), mLidars[i].getRotation(), mLidars[i].getDirection());
+	mZones.setup(
+		zones.getChild("enter").getValue<int>(),
+		zones.getChild("leave").getValue<int>(),
+		zones.getChild("hold").getValue<int>());
+	for (auto zone = zones.begin("zone"); zone != zones.end(); ++zone) {
+		vector<vec2> points;
+		for (auto point = zone->begin("point"); point != zone->end(); ++point)
+			points.push_back(vec2(point->getChild("x").getValue<float>(), point->getChild("y").getValue<float>()));
+		auto name = zone->getChild("name").getValue<string>();
+		CI_LOG_V("add zone: " << name);
+		mZones.addZone(name, points);
+	}
+
+	// zone events are sent from the zone thread, give it its own socket
+	mZoneSender = SenderRef(new Sender(port + 1, host, destinationPort));
+	try { mZoneSender->bind(); }
+	catch (const osc::Exception &ex) {
+		CI_LOG_E("Error binding: " << ex.what() << " val: " << ex.value());
+		mZoneSender.reset();
+	}
+}
+
+void SampleApp::updateZones() {
+	if (!mZoneSender || mZones.empty()) return;
+
+	if (!mZones.isRunning()) {
+		mZones.start([this](const string &name, bool entered) {
+			osc::Message msg(entered ? "/zone/enter" : "/zone/leave");
+			msg.append(name);
+			mZoneSender->send(msg);
+		});
+	}
+	// a lidar gets a new driver every time it is reopened, the zones follow it
+	for (size_t i = 0; i < mLidars.size(); i++)
+		mZones.setDriver(i, mLidars[i].getDriver());
+}
+
+void SampleApp::reloadSettings() {
+	if (mSettingsPath.empty() || getElapsedSeconds() - mSettingsCheckTime < 1.0) return;
+	mSettingsCheckTime = getElapsedSeconds();
+
+	try {
+		auto time = fs::last_write_time(mSettingsPath);
+		if (time == mSettingsTime) return;
+		mSettingsTime = time;
+
+		XmlTree file(loadFile(mSettingsPath));
+		auto params = file.getChild("params");
+		mLidars.loadFilters(params);
+		mLidars.loadArea(params);
+		CI_LOG_I("reloaded filters from " << mSettingsPath);
+	} catch (const std::exception &ex) {
+		// keep the previous filters while the file is being edited
+		CI_LOG_E("error reloading settings: " << ex.what());
 	}
 }
 
@@ -218,13 +246,13 @@ bool SampleApp::isTimeup() {
 void SampleApp::turnoff() {
 	if (!mActive) return;
 	mActive = false;
-	mDriver->stop();
-	mDriver->stopMotor();
-	mDriver->disconnect();
-	mDriver.reset();
+	mZones.stop();
+	mLidars.close();
 }
 
 void SampleApp::cleanup() {
+	// keep what the background adapted to for the next run
+	mLidars.saveBackground();
 	turnoff();
 }
 
@@ -236,11 +264,13 @@ void SampleApp::setup() {
 	mActive = false;
 	mHour	= 20;
 	mMinute = 0;
-	string lidarPort = "\\\\.\\COM3";
 
 	try {
 		auto filepath = getAssetPath("") / "settings.xml";;
 		auto file = new XmlTree(loadFile(filepath));
+		mSettingsPath		= filepath;
+		mSettingsTime		= fs::last_write_time(filepath);
+		mSettingsCheckTime	= getElapsedSeconds();
 		auto params = file->getChild("params");
 
 		float frameRate = glm::max(1.f, params.getChild("frameRate").getValue<float>());
@@ -259,27 +289,21 @@ void SampleApp::setup() {
 			quit();
 		}
 
+		// scan area settings are shared by all lidars and read from the first one
 		auto lidar	= params.getChild("lidar");
-		lidarPort	= "\\\\.\\" + lidar.getChild("port").getValue<string>();
-		mRotation	= glm::radians(lidar.getChild("angle").getValue<float>());
-		mPosition.x = lidar.getChild("position").getChild("x").getValue<float>();
-		mPosition.y = lidar.getChild("position").getChild("y").getValue<float>();
 		mBoundary.x = lidar.getChild("min").getChild("x").getValue<float>();
 		mBoundary.y = lidar.getChild("min").getChild("y").getValue<float>();
 		mBoundary.z = lidar.getChild("max").getChild("x").getValue<float>();
 		mBoundary.w = lidar.getChild("max").getChild("y").getValue<float>();
 		mSlope			= lidar.getChild("slope").getValue<float>();
-		mDirection		= (lidar.getChild("topdown").getValue<string>() == "true") ? -1.f : +1.f;
 		NUM_THRESHOLD	= lidar.getChild("threshold").getValue<int>();
 
-		auto filters = params.getChild("filter");
-		for (auto dot : filters) {
-			float xx = dot.getChild("x").getValue<float>();
-			float yy = dot.getChild("y").getValue<float>();
-			float rr = dot.getChild("r").getValue<float>();
-			CI_LOG_V("add filter: " << xx << "-" << yy << "-" << rr);
-			mFilters.push_back(vec3(xx, yy, rr));
-		}
+		mLidars.load(params, mBoundary, mSlope);
+		mLidars.loadArea(params);
+		mLidars.loadFilters(params);
+		mLidars.loadBackground(params, getAssetPath(""));
+		mLidars.setProfileCache(getAssetPath("") / "lidar_profiles.bin");
+		loadZones(params, host, port);
 
 		if (showview) {
 			setWindowSize(mBoundary.z - mBoundary.x, mBoundary.w - mBoundary.y);
@@ -303,37 +327,14 @@ void SampleApp::setup() {
 
 	isTimeup();
 
-	const _u32 opt_com_baudrate		= 115200;
-	std::wstring wPort				= std::wstring(lidarPort.begin(), lidarPort.end());
-	const wchar_t * opt_com_path	= wPort.c_str();
-	count	= _countof(nodes);
-	mDriver = shared_ptr<RPlidarDriver>(RPlidarDriver::CreateDriver(DRIVER_TYPE_SERIALPORT));
-
+	count = MAX_NODES;
 	mPointData.resize(count);
 	for (int i = 0; i < count; i++)
 		mPointData[i] = Point::create(i, vec2(65535.f, 65535.f));
 
-	u_result op_result;
-	rplidar_response_device_info_t devinfo;
-
-	if (IS_OK(mDriver->connect(opt_com_path, opt_com_baudrate))) {
-		op_result = mDriver->getDeviceInfo(devinfo);
-		if (IS_OK(op_result)) {
-			/*
-			console() << "RPLIDAR S/N: ";
-			for (int pos = 0; pos < 16; ++pos)
-				console() << devinfo.serialnum[pos];
-			console() << endl << "Firmware Ver: "
-				<< (devinfo.firmware_version >> 8)
-				<< (devinfo.firmware_version & 0xFF)
-				<< endl << "Hardware Rev: "
-				<< (int)devinfo.hardware_version << endl;
-			*/
-			checkRPLIDARHealth(mDriver);
-			mDriver->startMotor();
-			mDriver->startScan(false, true);
-			mActive = true;
-		}
+	if (mLidars.open(getElapsedSeconds()) > 0) {
+		mActive = true;
+		updateZones();
 	} else {
 		mActive = false;
 		quit();
@@ -347,6 +348,13 @@ void SampleApp::keyDown(KeyEvent event) {
 		mDrawPoint = !mDrawPoint;
 	} else if (event.getCode() == KeyEvent::KEY_c) {
 		mDrawCluster = !mDrawCluster;
+	} else if (event.getCode() == KeyEvent::KEY_b) {
+		mLidars.relearnBackground();
+	} else if (event.getCode() == KeyEvent::KEY_t) {
+		// only writes anything when built with RPLIDAR_ENABLE_TRACE
+		auto path = (mSettingsPath.parent_path() / "trace.json").string();
+		if (RPlidarTrace::dump(path.c_str()))
+			CI_LOG_I("trace written to " << path);
 	}
 }
 
@@ -355,11 +363,18 @@ void SampleApp::update() {
 		turnoff();
 
 	if (!mActive) return;
+	RPLIDAR_TRACE_SCOPE("SampleApp::update");
+
+	reloadSettings();
 
 	int pointSize = 0;
 	vector<PointRef> copypoint;
 
-	if (grabScanData()) {
+	RPLIDAR_TRACE_BEGIN("SampleApp::grabScanData");
+	bool grabbed = grabScanData();
+	RPLIDAR_TRACE_END("SampleApp::grabScanData");
+	updateZones();
+	if (grabbed) {
 		pointSize = count;
 		for (size_t i = 0; i < count; i++) {
 			auto pp = mPointData[i];
@@ -380,7 +395,9 @@ void SampleApp::update() {
 
 	// kmeans pass
 	if (pointSize > 0) {
+		RPLIDAR_TRACE_BEGIN("KMeans::run");
 		auto clusters = mKmeans.run(copypoint, pointSize);
+		RPLIDAR_TRACE_END("KMeans::run");
 		mClusterCount = clusters.size();
 		if (mClusterCount > 0) {
 			vector<vec2> data;
@@ -411,7 +428,9 @@ void SampleApp::update() {
 			}
 			if (mUseRender)
 				mClusterVbo->bufferData(data.size() * sizeof(vec2), data.data(), GL_DYNAMIC_DRAW);
+			RPLIDAR_TRACE_BEGIN("osc send");
 			mSender->send(dataMsg, std::bind(&SampleApp::onSendError, this, std::placeholders::_1));
+			RPLIDAR_TRACE_END("osc send");
 #else
 			for (int i = 0; i < mClusterCount; i++) {
 				const auto clu = clusters[i];
@@ -422,6 +441,7 @@ void SampleApp::update() {
 					osc::Message msg("/data/0");
 					msg.append(target.x);
 					msg.append(target.y);
+					RPLIDAR_TRACE_SCOPE("osc send");
 					mSender->send(msg, std::bind(&RPLidarApp::onSendError, this, std::placeholders::_1));
 					if (mUseRender) data.push_back(pos);
 				}
@@ -442,7 +462,8 @@ void SampleApp::draw() {
 
 	{
 		gl::ScopedColor scpColor(Color(0, 0, 1));
-		gl::drawSolidCircle(mPosition, 16.f);
+		for (size_t i = 0; i < mLidars.size(); i++)
+			gl::drawSolidCircle(mLidars[i].getPosition(), 16.f);
 	}
 
 	if (mDrawPoint) {
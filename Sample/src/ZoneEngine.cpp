@@ -0,0 +1,255 @@
+/*
+ Copyright (c) 2018-2019, Seph Li - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ZoneEngine.h"
+#include <chrono>
+
+using namespace std;
+using namespace ci;
+using namespace rp::standalone::rplidar;
+
+// nodes of one sweep come in ascending order, up to a little jitter between capsules
+static const float	BACKWARD_TOLERANCE	= 5.f;
+// sectors arrive every few milliseconds, this only bounds how soon a stopped lidar is asked again
+static const _u64	WAIT_TIMEOUT_US		= 100000;
+// a sector holds a few dozen nodes, a full request buffer is plenty
+static const size_t	SECTOR_NODES		= 1024;
+// what a lidar may queue while the zone thread is busy, older sectors are dropped beyond that
+static const size_t	MAX_PENDING_NODES	= 8192;
+
+ZoneEngine::ZoneEngine() {
+	mSectorsPending = false;
+	mRunning		= false;
+	setup(3, 0, 2);
+}
+
+ZoneEngine::~ZoneEngine() {
+	stop();
+}
+
+size_t ZoneEngine::addLidar(const vec2 &position, float rotation, float direction) {
+	unique_ptr<Lidar> lidar(new Lidar());
+	lidar->engine		= this;
+	lidar->index		= mLidars.size();
+	lidar->position		= position;
+	lidar->rotation		= rotation;
+	lidar->direction	= direction;
+	lidar->lastAngle	= 0.f;
+	lidar->changed		= false;
+	lidar->request		= RplidarAsyncRequest();
+	lidar->buffer.resize(SECTOR_NODES);
+	lidar->armed		= false;
+	mLidars.push_back(std::move(lidar));
+	return mLidars.size() - 1;
+}
+
+void ZoneEngine::setup(int enterHits, int leaveHits, int leaveSweeps) {
+	mEnterHits	 = glm::max(1, enterHits);
+	mLeaveHits	 = glm::min(leaveHits, mEnterHits - 1);
+	mLeaveSweeps = glm::max(1, leaveSweeps);
+}
+
+void ZoneEngine::addZone(const string &name, const vector<vec2> &points) {
+	unique_ptr<Zone> zone(new Zone());
+	zone->name			= name;
+	zone->points		= points;
+	zone->occupiedViews = 0;
+	mZones.push_back(std::move(zone));
+}
+
+void ZoneEngine::setOccupied(Zone &zone, View &view, bool occupied) {
+	if (view.occupied == occupied) return;
+	view.occupied		= occupied;
+	view.emptySweeps	= 0;
+	zone.occupiedViews += occupied ? 1 : -1;
+
+	// the first lidar to see someone enters the zone, the last one to see nobody leaves it
+	if (occupied && zone.occupiedViews == 1 && mEventFn) mEventFn(zone.name, true);
+	if (!occupied && zone.occupiedViews == 0 && mEventFn) mEventFn(zone.name, false);
+}
+
+void ZoneEngine::endSweep(size_t lidar) {
+	for (auto &zone : mZones) {
+		View &view = zone->views[lidar];
+		if (view.occupied) {
+			view.emptySweeps = (view.hits <= mLeaveHits) ? view.emptySweeps + 1 : 0;
+			if (view.emptySweeps >= mLeaveSweeps) setOccupied(*zone, view, false);
+		}
+		view.hits = 0;
+	}
+}
+
+void ZoneEngine::resetLidar(size_t lidar) {
+	// a new driver starts a new sweep, what the old one saw doesn't hold anymore
+	for (auto &zone : mZones) {
+		View &view = zone->views[lidar];
+		setOccupied(*zone, view, false);
+		view.hits = 0;
+	}
+	mLidars[lidar]->lastAngle = 0.f;
+}
+
+void ZoneEngine::process(size_t lidar, const rplidar_response_measurement_node_hq_t *nodes, size_t count) {
+	RPLIDAR_TRACE_SCOPE("ZoneEngine::process");
+	float &lastAngle = mLidars[lidar]->lastAngle;
+	for (size_t pos = 0; pos < count; ++pos) {
+		float angle = nodes[pos].angle_z_q14 * 90.f / 16384.f;
+		// the roi or the distance filter may have dropped the sync node, and with a roi
+		// narrower than half a turn the angle never wraps by much, so any step back ends the sweep
+		if ((nodes[pos].flag & RPLIDAR_RESP_HQ_FLAG_SYNCBIT) || angle < lastAngle - BACKWARD_TOLERANCE)
+			endSweep(lidar);
+		lastAngle = angle;
+
+		if (!nodes[pos].dist_mm_q2) continue;
+		float d = .1f * nodes[pos].dist_mm_q2 / 4.f;
+
+		for (auto &zone : mZones) {
+			View &view = zone->views[lidar];
+			if (!view.map.contains(angle, d)) continue;
+			if (++view.hits == mEnterHits) setOccupied(*zone, view, true);
+		}
+	}
+}
+
+void ZoneEngine::arm(Lidar &lidar) {
+	shared_ptr<RPlidarDriver> driver;
+	{
+		lock_guard<mutex> lock(mMutex);
+		driver = lidar.driver;
+	}
+
+	// still waiting on a driver the lidar doesn't use anymore, take the request back
+	if (lidar.armed && lidar.armedDriver != driver && lidar.armedDriver->cancelAsync(&lidar.request))
+		lidar.armed = false;
+	if (lidar.armed || !driver) return;
+
+	lidar.armedDriver		 = driver;
+	lidar.request			 = RplidarAsyncRequest();
+	lidar.request.complete	 = &ZoneEngine::onSector;
+	lidar.request.context	 = &lidar;
+	lidar.request.nodebuffer = lidar.buffer.data();
+	lidar.request.count		 = lidar.buffer.size();
+	lidar.armed				 = true;
+	// fails while the lidar is not scanning yet, the next wakeup asks again
+	if (!IS_OK(driver->waitSectorAsync(&lidar.request)))
+		lidar.armed = false;
+}
+
+void ZoneEngine::onSector(RplidarAsyncRequest *request, u_result result) {
+	// runs on the driver's decode thread, copy the sector out and ask for the next one right away
+	Lidar *lidar = static_cast<Lidar*>(request->context);
+	ZoneEngine *engine = lidar->engine;
+
+	if (IS_OK(result) && request->count) {
+		{
+			lock_guard<mutex> lock(engine->mMutex);
+			if (lidar->pending.size() + request->count > MAX_PENDING_NODES) lidar->pending.clear();
+			lidar->pending.insert(lidar->pending.end(), request->nodebuffer, request->nodebuffer + request->count);
+			engine->mSectorsPending = true;
+		}
+		engine->mSectorCond.notify_one();
+	}
+
+	// once the scan stopped or the engine is stopping, the zone thread decides what comes next
+	if (IS_OK(result) && engine->mRunning) {
+		request->count = lidar->buffer.size();
+		if (IS_OK(lidar->armedDriver->waitSectorAsync(request))) return;
+	}
+	lidar->armed = false;
+}
+
+void ZoneEngine::threadLoop() {
+	RPLIDAR_TRACE_THREAD("zones");
+	vector<bool> changed(mLidars.size());
+	while (mRunning) {
+		for (auto &lidar : mLidars) arm(*lidar);
+
+		{
+			unique_lock<mutex> lock(mMutex);
+			mSectorCond.wait_for(lock, chrono::microseconds(WAIT_TIMEOUT_US),
+				[this]() { return mSectorsPending || !mRunning; });
+			mSectorsPending = false;
+			for (size_t i = 0; i < mLidars.size(); i++) {
+				changed[i] = mLidars[i]->changed;
+				mLidars[i]->changed = false;
+				mLidars[i]->work.swap(mLidars[i]->pending);
+			}
+		}
+
+		for (size_t i = 0; i < mLidars.size(); i++) {
+			if (changed[i]) resetLidar(i);
+			process(i, mLidars[i]->work.data(), mLidars[i]->work.size());
+			mLidars[i]->work.clear();
+		}
+	}
+}
+
+void ZoneEngine::start(EventFn fn) {
+	stop();
+	if (empty()) return;
+
+	// every zone is compiled once per lidar, in that lidar's frame
+	for (auto &zone : mZones) {
+		zone->views.clear();
+		zone->views.resize(mLidars.size());
+		for (size_t i = 0; i < mLidars.size(); i++) {
+			View &view = zone->views[i];
+			view.map.setOrigin(mLidars[i]->position, mLidars[i]->rotation, mLidars[i]->direction);
+			view.map.addPolygon(zone->points);
+			view.map.compile();
+			view.hits			= 0;
+			view.emptySweeps	= 0;
+			view.occupied		= false;
+		}
+		zone->occupiedViews = 0;
+	}
+
+	mEventFn = fn;
+	mRunning = true;
+	mThread	 = thread(&ZoneEngine::threadLoop, this);
+}
+
+void ZoneEngine::stop() {
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mSectorCond.notify_all();
+	if (mThread.joinable()) mThread.join();
+
+	// a completion running now sees mRunning and won't ask again, withdraw what is still pending
+	for (auto &lidar : mLidars) {
+		while (lidar->armed) {
+			if (lidar->armedDriver->cancelAsync(&lidar->request)) lidar->armed = false;
+			else this_thread::yield();
+		}
+		lidar->armedDriver.reset();
+		lock_guard<mutex> lock(mMutex);
+		lidar->driver.reset();
+		lidar->pending.clear();
+	}
+}
+
+void ZoneEngine::setDriver(size_t lidar, shared_ptr<RPlidarDriver> driver) {
+	if (lidar >= mLidars.size()) return;
+	lock_guard<mutex> lock(mMutex);
+	if (mLidars[lidar]->driver == driver) return;
+	mLidars[lidar]->driver	= driver;
+	mLidars[lidar]->changed = true;
+}
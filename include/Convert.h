@@ -20,7 +20,9 @@
 #pragma once
 
 #include <stdio.h>
-#include <tchar.h>
+#ifdef _WIN32
+#include <tchar.h>
+#endif
 #include <locale>
 #include <iostream>
 #include <string>
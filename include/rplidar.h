@@ -40,5 +40,7 @@
 #include "rplidar_cmd.h"
 
 #include "rplidar_driver.h"
+#include "rplidar_emulator.h"
+#include "rplidar_trace.h"
 
 #define RPLIDAR_SDK_VERSION  "1.10.0"
@@ -0,0 +1,90 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+// std::future front end of RPlidarDriver::submitCommandAsync(), for callers that would rather poll
+// or wait on a future than handle a callback. C++11.
+
+#include "rplidar.h"
+#include <future>
+#include <utility>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+struct RplidarCommandResult {
+    u_result                result;
+    RplidarCommandAnswer    answer;
+};
+
+/// Queue a command on the driver's command thread, see RPlidarDriver::submitCommandAsync()
+/// The future is ready once the command was answered, failed or ran out of time; it never blocks in
+/// its destructor, so a result nobody waits for can simply be dropped.
+///
+/// \param command        One of RplidarAsyncRequest::ASYNC_COMMAND_*
+/// \param timeout        In ms from now
+/// \param confType       The RPLIDAR_CONF_* to ask for with ASYNC_COMMAND_GET_LIDAR_CONF
+inline std::future<RplidarCommandResult> submitCommand(RPlidarDriver & driver, _u32 command, _u32 timeout = RPlidarDriver::DEFAULT_TIMEOUT, _u32 confType = 0)
+{
+    // owned by the driver until it completes
+    struct Pending {
+        RplidarAsyncRequest                 request;
+        std::promise<RplidarCommandResult>  promise;
+
+        static void complete(RplidarAsyncRequest * request, u_result result)
+        {
+            Pending * pending = static_cast<Pending *>(request->context);
+            RplidarCommandResult answer = { result, std::move(request->answer) };
+            pending->promise.set_value(std::move(answer));
+            delete pending;
+        }
+    };
+
+    Pending * pending = new Pending();
+    pending->request.complete = &Pending::complete;
+    pending->request.context = pending;
+    pending->request.command = command;
+    pending->request.conf_type = confType;
+    pending->request.timeout = timeout;
+
+    std::future<RplidarCommandResult> future = pending->promise.get_future();
+    u_result ans = driver.submitCommandAsync(&pending->request);
+    if (IS_FAIL(ans)) {
+        // not queued, the callback won't come
+        Pending::complete(&pending->request, ans);
+    }
+    return future;
+}
+
+}}}
@@ -99,6 +99,11 @@ typedef struct _rplidar_payload_get_scan_conf_t {
     _u32  type;
     _u8   reserved[32];
 } __attribute__((packed)) rplidar_payload_get_scan_conf_t;
+
+typedef struct _rplidar_payload_set_scan_conf_t {
+    _u32  type;
+    _u8   payload[0];
+} __attribute__((packed)) rplidar_payload_set_scan_conf_t;
 #define MAX_MOTOR_PWM               1023
 #define DEFAULT_MOTOR_PWM           660
 typedef struct _rplidar_payload_motor_pwm_t {
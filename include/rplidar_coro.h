@@ -0,0 +1,219 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+// C++20 coroutine wrappers over the asynchronous requests of RPlidarDriver.
+//
+//   RplidarScanResult scan = co_await nextScan(*driver);
+//   RplidarHealthResult status = co_await health(*driver);
+//   RplidarSectorStream sectors(*driver);
+//   while (RplidarScanResult sector = co_await sectors.next()) { ... }
+//
+// A suspended coroutine holds no thread. It is resumed on the driver thread (or reactor worker)
+// that completes its request, so keep the work short there or hand it over to a thread of your own.
+// Without coroutine support in the compiler this header declares nothing.
+
+#include "rplidar.h"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define RPLIDAR_HAS_COROUTINES 1
+#endif
+#endif
+
+#if defined(RPLIDAR_HAS_COROUTINES)
+
+#include <coroutine>
+#include <utility>
+#include <vector>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+struct RplidarScanResult {
+    u_result    result;
+    std::vector<rplidar_response_measurement_node_hq_t> nodes;
+
+    explicit operator bool() const { return IS_OK(result); }
+};
+
+struct RplidarHealthResult {
+    u_result    result;
+    rplidar_response_device_health_t health;
+
+    explicit operator bool() const { return IS_OK(result); }
+};
+
+namespace internal {
+
+// Issues one request when the coroutine suspends and resumes it from the request's callback.
+// Once the request is issued the callback may resume the coroutine, and destroy the awaiter,
+// before await_suspend() has returned, so nothing touches the awaiter after that.
+class RplidarAwaiterBase {
+public:
+    RplidarAwaiterBase(const RplidarAwaiterBase &) = delete;
+    RplidarAwaiterBase & operator=(const RplidarAwaiterBase &) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+protected:
+    explicit RplidarAwaiterBase(RPlidarDriver & driver)
+        : _driver(driver)
+        , _request()
+        , _result(RESULT_OK)
+    {
+    }
+
+    template <class Issue>
+    bool _suspend(std::coroutine_handle<> handle, Issue issue)
+    {
+        _handle = handle;
+        _request.complete = &RplidarAwaiterBase::_onComplete;
+        _request.context = this;
+
+        u_result ans = issue();
+        if (IS_OK(ans)) return true;
+
+        // the callback won't come, carry on right away
+        _result = ans;
+        return false;
+    }
+
+    static void _onComplete(RplidarAsyncRequest * request, u_result result)
+    {
+        RplidarAwaiterBase * awaiter = static_cast<RplidarAwaiterBase *>(request->context);
+        awaiter->_result = result;
+        awaiter->_handle.resume();
+    }
+
+    RPlidarDriver &         _driver;
+    RplidarAsyncRequest     _request;
+    u_result                _result;
+    std::coroutine_handle<> _handle;
+};
+
+// a full revolution or a sector
+class RplidarNodesAwaiter : public RplidarAwaiterBase {
+public:
+    typedef u_result (RPlidarDriver::*Issue)(RplidarAsyncRequest *);
+
+    RplidarNodesAwaiter(RPlidarDriver & driver, Issue issue, size_t capacity)
+        : RplidarAwaiterBase(driver)
+        , _issue(issue)
+        , _nodes(capacity)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        _request.nodebuffer = _nodes.data();
+        _request.count = _nodes.size();
+        return _suspend(handle, [this] { return (_driver.*_issue)(&_request); });
+    }
+
+    RplidarScanResult await_resume()
+    {
+        _nodes.resize(IS_OK(_result) ? _request.count : 0);
+        return RplidarScanResult{ _result, std::move(_nodes) };
+    }
+
+private:
+    Issue   _issue;
+    std::vector<rplidar_response_measurement_node_hq_t> _nodes;
+};
+
+class RplidarHealthAwaiter : public RplidarAwaiterBase {
+public:
+    RplidarHealthAwaiter(RPlidarDriver & driver, _u32 timeout)
+        : RplidarAwaiterBase(driver)
+    {
+        _request.timeout = timeout;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return _suspend(handle, [this] { return _driver.getHealthAsync(&_request); });
+    }
+
+    RplidarHealthResult await_resume()
+    {
+        return RplidarHealthResult{ _result, _request.answer.health };
+    }
+};
+
+}
+
+/// The next full revolution, see RPlidarDriver::waitScanAsync()
+/// The result fails with RESULT_OPERATION_STOP when the scan stops first.
+inline internal::RplidarNodesAwaiter nextScan(RPlidarDriver & driver, size_t capacity = 8192)
+{
+    return internal::RplidarNodesAwaiter(driver, &RPlidarDriver::waitScanAsync, capacity);
+}
+
+/// The next sector, see RPlidarDriver::waitSectorAsync()
+inline internal::RplidarNodesAwaiter nextSector(RPlidarDriver & driver, size_t capacity = 1024)
+{
+    return internal::RplidarNodesAwaiter(driver, &RPlidarDriver::waitSectorAsync, capacity);
+}
+
+/// The health status, queried by the driver's command thread, see RPlidarDriver::getHealthAsync()
+inline internal::RplidarHealthAwaiter health(RPlidarDriver & driver, _u32 timeout = RPlidarDriver::DEFAULT_TIMEOUT)
+{
+    return internal::RplidarHealthAwaiter(driver, timeout);
+}
+
+/// The sectors of a running scan, one per co_await next(), until the scan stops
+/// Sectors decoded while the consumer is busy between two next() calls are skipped, not queued.
+class RplidarSectorStream {
+public:
+    explicit RplidarSectorStream(RPlidarDriver & driver, size_t capacity = 1024)
+        : _driver(driver)
+        , _capacity(capacity)
+    {
+    }
+
+    /// Fails with RESULT_OPERATION_STOP once the scan has stopped, which ends the loop
+    internal::RplidarNodesAwaiter next()
+    {
+        return nextSector(_driver, _capacity);
+    }
+
+private:
+    RPlidarDriver & _driver;
+    size_t          _capacity;
+};
+
+}}}
+
+#endif
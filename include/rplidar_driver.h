@@ -60,9 +60,98 @@ struct RplidarScanMode {
     char    scan_mode[64];    // name of scan mode, max 63 characters
 };
 
+struct RplidarScanFilter {
+    enum {
+        MAX_ANGLE_RANGES = 8,
+    };
+
+    struct AngleRange {
+        float from;           // start angle in degrees, inclusive
+        float to;             // end angle in degrees, exclusive. A range with from > to wraps through 0
+    };
+
+    AngleRange  angle_ranges[MAX_ANGLE_RANGES];
+    size_t      angle_range_count;  // number of valid angle_ranges, 0 keeps every angle
+    float       min_distance;       // min distance in mm
+    float       max_distance;       // max distance in mm, 0 means no limit
+    _u8         min_quality;        // min quality, in the same unit as rplidar_response_measurement_node_hq_t::quality
+};
+
+struct RplidarDriverStats {
+    enum {
+        FRAME_TYPE_COUNT      = 5,  // RPLIDAR_ANS_TYPE_MEASUREMENT .. RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED
+        DECODE_TIME_BINS      = 16, // log2 buckets of microseconds
+    };
+
+    _u64    bytes_received;         // scan data bytes read from the channel
+    _u64    recv_calls;             // recvdata() calls made for the scan data
+    _u64    wakeups;                // times the receiving thread woke up with data available
+    _u64    frames_decoded[FRAME_TYPE_COUNT]; // valid frames, indexed by ans_type - RPLIDAR_ANS_TYPE_MEASUREMENT
+    _u64    checksum_failures;      // capsule frames dropped on a checksum mismatch
+    _u64    crc_failures;           // HQ frames dropped on a CRC mismatch
+    _u64    resync_bytes;           // bytes skipped while looking for the start of a frame
+    _u64    ring_overruns;          // bytes dropped because the reactor or pipeline ring was full
+    _u64    scans_published;        // full revolutions made available to grabScanData()
+    _u64    scans_dropped;          // published revolutions replaced before anybody grabbed them
+    _u64    interval_overflows;     // nodes lost because getScanDataWithInterval() was not called often enough
+    _u64    zero_distance_nodes;    // nodes without a valid measurement
+    _u64    capsule_gaps;           // jumps in the capsule start angles, capsules lost on the way (UDP)
+    _u64    capsules_reordered;     // capsules that arrived behind their predecessor and were dropped (UDP)
+    float   revolution_rate;        // the same as getMeasuredFrequency(), 0 before it is known
+    _u64    decode_time[DECODE_TIME_BINS]; // decode passes, bin i takes [2^i, 2^(i+1)) microseconds, bin 0 includes 0
+};
+
+struct RplidarReactorStats {
+    _u64    wait_calls;             // epoll_wait() or io_uring_enter() calls of the I/O thread
+    _u64    read_calls;             // read() calls, io_uring reads complete inside the kernel and are not counted
+    _u64    completions;            // reads that returned data
+    _u64    bytes_received;
+};
+
+struct RplidarRealtimeProfile {
+    int     priority;           // SCHED_FIFO priority of the scan threads, 0 keeps the default scheduling
+    _u64    io_cpu_mask;        // cpus the thread reading the port may run on, bit n is cpu n, 0 means any
+    _u64    decode_cpu_mask;    // cpus the decoding thread may run on (pipelined mode and reactor workers), 0 means any
+    bool    lock_memory;        // lock the process memory with mlockall() and pre-fault the scan buffers
+};
+
+/// The answer of a queued command, only the field of that command is set
+struct RplidarCommandAnswer {
+    rplidar_response_device_health_t health;    // ASYNC_COMMAND_GET_HEALTH
+    rplidar_response_device_info_t   devinfo;   // ASYNC_COMMAND_GET_DEVICE_INFO
+    std::vector<_u8>                 conf;      // ASYNC_COMMAND_GET_LIDAR_CONF, the payload after the type
+    bool                             motor_ctrl_support; // ASYNC_COMMAND_CHECK_MOTOR_CTRL
+};
+
+/// A request the driver completes later from one of its own threads, see RPlidarDriver::waitScanAsync()
+/// and RPlidarDriver::submitCommandAsync(). The caller owns the request and keeps it alive until
+/// complete has been called or cancelAsync() returned true. Value-initialize it, RplidarAsyncRequest request = {};
+struct RplidarAsyncRequest {
+    enum {
+        ASYNC_COMMAND_GET_HEALTH = 0,
+        ASYNC_COMMAND_GET_DEVICE_INFO,
+        ASYNC_COMMAND_GET_LIDAR_CONF,
+        ASYNC_COMMAND_RESET,
+        ASYNC_COMMAND_CHECK_MOTOR_CTRL,
+        ASYNC_COMMAND_COUNT,
+    };
+
+    void    (*complete)(RplidarAsyncRequest * request, u_result result); // called once, must return quickly and must not block on the driver
+    void *  context;            // left to the caller
+    rplidar_response_measurement_node_hq_t * nodebuffer; // where a scan or a sector is copied to
+    size_t  count;              // in: capacity of nodebuffer in nodes, out: nodes stored
+    _u32    command;            // ASYNC_COMMAND_*, commands only
+    _u32    conf_type;          // RPLIDAR_CONF_* asked for by ASYNC_COMMAND_GET_LIDAR_CONF
+    _u32    timeout;            // in ms from submission, commands only. A command still queued then is not sent anymore
+    RplidarCommandAnswer answer;
+    _u64    deadline_us;        // used by the driver
+    RplidarAsyncRequest * next; // used by the driver while the request is pending
+};
+
 enum {
     DRIVER_TYPE_SERIALPORT = 0x0,
     DRIVER_TYPE_TCP = 0x1,
+    DRIVER_TYPE_UDP = 0x2,
 };
 
 class ChannelDevice
@@ -78,6 +167,50 @@ public:
     virtual void setDTR() {return;}
     virtual void clearDTR() {return;}
     virtual void ReleaseRxTx() {return;}
+    virtual int getNativeHandle() {return -1;}
+    virtual void cancelOperation() {return;}
+    virtual void clearCancel() {return;}
+    virtual bool setBufferSize(size_t ) {return false;}
+};
+
+class RPlidarReactor {
+public:
+    enum {
+        REACTOR_BACKEND_EPOLL       = 0,
+        REACTOR_BACKEND_IO_URING    = 1,
+    };
+
+    enum {
+        REACTOR_FLAG_NO_IO_URING    = 0x1,  // wait with epoll even when io_uring is available
+    };
+
+    /// Create a reactor that services the scan data of many drivers with one I/O thread
+    /// The reactor waits on the ports of all attached drivers in a single epoll thread,
+    /// queues the received bytes per driver and decodes them on a small pool of worker threads,
+    /// so the number of threads stays the same no matter how many lidars are attached.
+    /// Returns NULL when the platform doesn't support it (only available on Linux)
+    ///
+    /// Built with RPLIDAR_USE_IO_URING, the I/O thread uses io_uring instead when the kernel supports it
+    /// (Linux 5.6 or later): the reads complete straight into the per-driver buffers and one
+    /// io_uring_enter() call submits and reaps a whole batch. Otherwise it falls back to epoll.
+    ///
+    /// \param workerCount    The number of decoding threads
+    /// \param profile        The real-time profile of the I/O and worker threads, NULL to keep the default scheduling
+    /// \param flags          REACTOR_FLAG_*
+    static RPlidarReactor * CreateReactor(size_t workerCount = 1, const RplidarRealtimeProfile * profile = NULL, _u32 flags = 0);
+
+    /// Dispose the reactor, every attached driver must have stopped scanning before
+    static void DisposeReactor(RPlidarReactor * reactor);
+
+    /// The kernel interface the I/O thread waits with, REACTOR_BACKEND_EPOLL or REACTOR_BACKEND_IO_URING
+    virtual _u32 getBackend() = 0;
+
+    /// The system call counters of the I/O thread since the reactor started
+    virtual void getStats(RplidarReactorStats & stats) = 0;
+
+    virtual ~RPlidarReactor() {}
+protected:
+    RPlidarReactor() {}
 };
 
 class RPlidarDriver {
@@ -94,6 +227,10 @@ public:
         LEGACY_SAMPLE_DURATION = 476,
     };
 
+    enum {
+        CONNECT_FLAG_KEEP_MOTOR = 0x1,  // don't stop the motor on connect, see connect()
+    };
+
 public:
     /// Create an RPLIDAR Driver Instance
     /// This interface should be invoked first before any other operations
@@ -116,7 +253,9 @@ public:
     ///        For most RPLIDAR models, the baudrate should be set to 115200
     ///
     /// \param flag          other flags
-    ///        Reserved for future use, always set to Zero
+    ///        CONNECT_FLAG_KEEP_MOTOR leaves the motor as it is instead of stopping it, and treats it as
+    ///        already spinning. Use it to reconnect to a lidar that kept running, so startMotorAsync()
+    ///        doesn't wait for a spin-up that isn't happening.
     virtual u_result connect(const wchar_t  *, _u32, _u32 flag = 0) = 0;
 
 
@@ -126,6 +265,25 @@ public:
     /// Returns TRUE when the connection has been established
     virtual bool isConnected() = 0;
 
+    /// Keep the capability profile of the lidar in a cache file
+    /// The scan modes with their answer types, sample durations and max distances, the typical scan mode
+    /// and the motor control support are probed once per lidar and firmware, then loaded from the file on
+    /// connect, so startScan*(), getTypicalScanMode() and getAllSupportedScanModes() don't query the lidar again.
+    /// A cached profile is verified by the first scan it starts: if the lidar answers with another type,
+    /// the profile is probed again. Without a cache file the profile is still probed only once per connection.
+    /// Call it before connect().
+    ///
+    /// \param path          The cache file, any number of lidars can share it. NULL to disable the file
+    virtual u_result setProfileCache(const char * path) = 0;
+
+    /// Set the kernel receive buffer (SO_RCVBUF) of a network lidar's socket
+    /// The driver moves the received bytes into its own ring buffer in bulk, the socket buffer only has to
+    /// hold what arrives while the scan thread is busy. The default is 256 KB. Call it before connect().
+    /// Returns RESULT_OPERATION_NOT_SUPPORT for serial port lidars.
+    ///
+    /// \param size          The buffer size in bytes, the OS may round or clamp it
+    virtual u_result setSocketBufferSize(size_t size) = 0;
+
     /// Ask the RPLIDAR core system to reset it self
     /// The host system can use the Reset operation to help RPLIDAR escape the self-protection mode.
     ///
@@ -188,6 +346,24 @@ public:
     /// Stop RPLIDAR's motor when using accessory board
     virtual u_result stopMotor() = 0;
 
+    /// Start RPLIDAR's motor and return right away
+    /// Use waitMotorReady() to find out when it has reached its speed. Calling it while the motor
+    /// is already spinning keeps its current speed and doesn't restart the spin-up.
+    virtual u_result startMotorAsync() = 0;
+
+    /// Stop RPLIDAR's motor and return right away
+    virtual u_result stopMotorAsync() = 0;
+
+    /// Wait until the motor started by startMotorAsync() runs at a stable speed
+    /// While scanning, the motor is ready once a few revolutions in a row agree with the measured
+    /// rate, and with the target of setTargetFrequency() if one is set. Without a scan there is nothing
+    /// to measure, the motor is assumed ready after a fixed spin-up time.
+    ///
+    /// \param timeout       The longest time to wait in milliseconds, 0 to only check
+    ///
+    /// \return RESULT_OPERATION_TIMEOUT if it is not ready yet, RESULT_OPERATION_FAIL if the motor is not started
+    virtual u_result waitMotorReady(_u32 timeout = DEFAULT_TIMEOUT) = 0;
+
     /// Check whether the device support motor control.
     /// Note: this API will disable grab.
     /// 
@@ -215,6 +391,37 @@ public:
     /// \param count         The number of sample nodes inside the given buffer
     virtual u_result getFrequency(const RplidarScanMode& scanMode, size_t count, float & frequency) = 0;
 
+    /// Get RPLIDAR's scanning frequency measured from the arrival times of the sync nodes while scanning
+    /// Unlike getFrequency(), it doesn't depend on the sample duration and follows the motor as it drifts.
+    /// Returns RESULT_OPERATION_TIMEOUT until two revolutions have been received.
+    ///
+    /// \param frequency     The smoothed scanning frequency (in HZ)
+    virtual u_result getMeasuredFrequency(float & frequency) = 0;
+
+    /// Hold the scanning frequency at a target by adjusting the motor pwm, accessory boards with motor control only
+    /// A PI controller runs on every revolution while scanning and sends setMotorPWM() when the pwm changes.
+    /// Lower frequencies give denser scans, higher ones lower latency.
+    ///
+    /// \param frequency     The target frequency (in HZ), 0 stops the regulation and keeps the current pwm
+    virtual u_result setTargetFrequency(float frequency) = 0;
+
+    /// Get the range of rotation frequencies the RPLIDAR accepts and the one it currently aims for
+    /// Only lidars with a configurable rotation speed support it (e.g. the S series, firmware 1.24 and up).
+    /// Call it while not scanning.
+    ///
+    /// \param minFrequency  The lowest rotation frequency (in HZ)
+    /// \param maxFrequency  The highest rotation frequency (in HZ)
+    /// \param desiredFrequency The rotation frequency (in HZ) the lidar currently holds
+    /// \param timeout       The operation timeout value (in millisecond) for the serial port communication
+    virtual u_result getRotationFrequencyRange(float & minFrequency, float & maxFrequency, float & desiredFrequency, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    /// Set the rotation frequency the RPLIDAR holds on its own, see getRotationFrequencyRange() for the supported range
+    /// Lower frequencies give denser scans, higher ones lower latency. Call it while not scanning.
+    ///
+    /// \param frequency     The desired rotation frequency (in HZ)
+    /// \param timeout       The operation timeout value (in millisecond) for the serial port communication
+    virtual u_result setDesiredRotationFrequency(float frequency, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
     /// Ask the RPLIDAR core system to enter the scan mode(Normal/Express, Express mode is 4k mode)
     /// A background thread will be created by the RPLIDAR driver to fetch the scan data continuously.
     /// User Application can use the grabScanData() interface to retrieved the scan data cached previous by this background thread.
@@ -231,6 +438,8 @@ public:
     DEPRECATED(virtual u_result checkExpressScanSupported(bool & support, _u32 timeout = DEFAULT_TIMEOUT)) = 0;
 
     /// Ask the RPLIDAR core system to stop the current scan operation and enter idle state. The background thread will be terminated
+    /// If the background thread does not end within twice DEFAULT_TIMEOUT, RESULT_OPERATION_TIMEOUT is returned and no new scan
+    /// can be started until it does. On macOS a thread can't be joined with a timeout, there the call waits for the thread.
     ///
     /// \param timeout       The operation timeout value (in millisecond) for the serial port communication 
     virtual u_result stop(_u32 timeout = DEFAULT_TIMEOUT) = 0;
@@ -275,6 +484,11 @@ public:
     /// \The caller application can set the timeout value to Zero(0) to make this interface always returns immediately to achieve non-block operation.
     virtual u_result grabScanDataHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u32 timeout = DEFAULT_TIMEOUT) = 0;
 
+    /// The same as grabScanDataHq() with the timeout in microseconds, for latency budgets below a millisecond
+    ///
+    /// \param timeout_us     Max duration allowed to wait for a complete scan data in microseconds, 0 returns immediately
+    virtual u_result grabScanDataHq_uS(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 timeout_us) = 0;
+
     /// Ascending the scan data according to the angle value in the scan.
     ///
     /// \param nodebuffer     Buffer provided by the caller application to do the reorder. Should be retrived from the grabScanData
@@ -311,6 +525,109 @@ public:
     /// The interface will return RESULT_OPERATION_TIMEOUT to indicate that not even a single node can be retrieved since last call. 
     virtual u_result getScanDataWithIntervalHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count) = 0;
 
+    /// The same as getScanDataWithIntervalHq(), but waits up to timeout_us microseconds for the first node
+    /// instead of returning RESULT_OPERATION_TIMEOUT right away when none has arrived since the last call
+    ///
+    /// \param timeout_us     Max duration allowed to wait in microseconds, 0 returns immediately
+    virtual u_result getScanDataWithIntervalHq_uS(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 timeout_us) = 0;
+
+    /// Set a region of interest that is applied by the background thread while decoding the scan data
+    /// Nodes outside the angle ranges, outside the distance limits, below the min quality or with zero distance
+    /// are dropped before they are published, so they never reach grabScanData*() and getScanDataWithInterval*().
+    /// Note, with a filter set the first node of a grabbed scan is not guaranteed to have the start_bit set.
+    ///
+    /// \param filter         The filter to apply, NULL to disable filtering
+    virtual u_result setScanFilter(const RplidarScanFilter * filter) = 0;
+
+    /// Let a shared reactor receive and decode the scan data instead of a dedicated thread of this driver
+    /// Takes effect on the next startScan*() call, the driver must not be scanning.
+    /// Scanning will fail with RESULT_OPERATION_NOT_SUPPORT if the channel has no native handle to wait on.
+    ///
+    /// \param reactor        The reactor to use, NULL to go back to a dedicated thread
+    virtual u_result setReactor(RPlidarReactor * reactor) = 0;
+
+    /// Split receiving and decoding of the scan data into two threads
+    /// A small high priority reader thread only moves the received bytes into a lock free ring buffer,
+    /// a second thread decodes and publishes them. A slow decode or a wait on the driver lock then
+    /// never delays reading the port, which avoids losing bytes at high baudrates.
+    /// Takes effect on the next startScan*() call, the driver must not be scanning.
+    ///
+    /// \param enable         true to use a reader and a decoder thread, false for a single thread
+    virtual u_result setPipelinedDecoding(bool enable) = 0;
+
+    /// Run the scan threads with a real-time acquisition profile
+    /// Each thread that reads or decodes the scan data switches itself to SCHED_FIFO with the given priority
+    /// and pins itself to its cpu mask when it starts, so a busy application can't starve it and the
+    /// serial port doesn't overflow. With lock_memory set the process memory is locked right away so
+    /// the scan path never takes a page fault. Takes effect on the next startScan*() call, the driver must not be scanning.
+    /// Real-time priorities need CAP_SYS_NICE (or an rtprio limit) and memory locking needs CAP_IPC_LOCK
+    /// (or a memlock limit); without them the threads keep the default scheduling.
+    /// On Windows the priority maps to THREAD_PRIORITY_TIME_CRITICAL and memory locking is not supported,
+    /// on macOS only the priority is applied.
+    ///
+    /// \param profile        The profile to apply, NULL to go back to the default scheduling
+    ///
+    /// \return RESULT_OPERATION_NOT_SUPPORT if the memory could not be locked, the rest of the profile is still applied
+    virtual u_result setRealtimeProfile(const RplidarRealtimeProfile * profile) = 0;
+
+    /// Ask for the next full revolution without blocking a thread on it
+    /// request->complete is called with RESULT_OK from the thread that publishes the scan, right after
+    /// the nodes (filtered like those of grabScanDataHq()) have been copied to request->nodebuffer.
+    /// Each request gets its own copy and doesn't consume the scan that grabScanDataHq() returns.
+    /// When the scan stops first, complete is called with RESULT_OPERATION_STOP, or RESULT_OPERATION_FAIL
+    /// if the scan thread gave up on the channel.
+    ///
+    /// \param request        The request, with complete, nodebuffer and count set
+    ///
+    /// \return RESULT_OPERATION_FAIL if the driver is not scanning, complete is not called then
+    virtual u_result waitScanAsync(RplidarAsyncRequest * request) = 0;
+
+    /// Ask for the next sector without blocking a thread on it
+    /// A sector is the part of a revolution decoded from one batch of received frames, usually a few
+    /// degrees. request->complete is called like for waitScanAsync() once the next sector is decoded;
+    /// sectors decoded while nobody is waiting are not kept.
+    ///
+    /// \param request        The request, with complete, nodebuffer and count set
+    ///
+    /// \return RESULT_OPERATION_FAIL if the driver is not scanning, complete is not called then
+    virtual u_result waitSectorAsync(RplidarAsyncRequest * request) = 0;
+
+    /// Queue a command without blocking the caller
+    /// The commands are sent one after the other, in the order they were submitted, by a thread the driver
+    /// starts on first use; disconnect() stops it. request->complete is called from that thread with the
+    /// result of the blocking call (getHealth(), getDeviceInfo(), getLidarConf(), reset() or
+    /// checkMotorCtrlSupport()) and request->answer filled in. Like those calls, the commands other than
+    /// ASYNC_COMMAND_GET_LIDAR_CONF and ASYNC_COMMAND_RESET stop a running scan.
+    /// The command must be answered within request->timeout of being submitted. One still queued by then
+    /// completes with RESULT_OPERATION_TIMEOUT without being sent, a running one waits only for the time left.
+    /// Commands still queued when the driver disconnects complete with RESULT_OPERATION_STOP.
+    ///
+    /// \param request        The request, with complete, command and timeout set (and conf_type for ASYNC_COMMAND_GET_LIDAR_CONF)
+    ///
+    /// \return RESULT_OPERATION_FAIL if the driver is not connected, complete is not called then
+    virtual u_result submitCommandAsync(RplidarAsyncRequest * request) = 0;
+
+    /// Ask for the health status without blocking the caller, the same as submitCommandAsync() with ASYNC_COMMAND_GET_HEALTH
+    ///
+    /// \param request        The request, with complete and timeout set
+    virtual u_result getHealthAsync(RplidarAsyncRequest * request) = 0;
+
+    /// Withdraw a pending asynchronous request
+    ///
+    /// \return true if the request was withdrawn and complete will not be called, false if it is not
+    ///         pending anymore; complete has been called or is about to be
+    virtual bool cancelAsync(RplidarAsyncRequest * request) = 0;
+
+    /// Take a snapshot of the driver's performance counters
+    /// The counters are always on and updated with relaxed atomics, so the snapshot is not
+    /// exactly consistent across fields while scanning, but every field is a valid count.
+    ///
+    /// \param stats          The snapshot
+    virtual u_result getStats(RplidarDriverStats & stats) = 0;
+
+    /// Reset all the performance counters to zero
+    virtual u_result resetStats() = 0;
+
     virtual ~RPlidarDriver() {}
 protected:
     RPlidarDriver(){}
@@ -0,0 +1,87 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+// A stand-in for network lidars, to test and load the TCP/UDP drivers without hardware.
+// Every emulated device listens on its own port, answers the command protocol like an S-series lidar
+// and streams synthetic or recorded scans in the requested format, with optional latency, jitter and loss.
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+struct RplidarEmulatorConfig {
+    _u32        transport;          // DRIVER_TYPE_TCP or DRIVER_TYPE_UDP
+    _u16        base_port;          // device n listens on base_port + n
+    size_t      device_count;
+    _u8         ans_type;           // format of the typical scan mode: RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED,
+                                    // _CAPSULED_ULTRA, _DENSE_CAPSULED, _HQ or RPLIDAR_ANS_TYPE_MEASUREMENT
+    float       scan_frequency;     // revolutions per second
+    _u32        sample_rate;        // samples per second
+    _u32        frames_per_packet;  // frames sent together in one write or datagram, at least 1
+    _u32        latency_us;         // delay added to every packet
+    _u32        jitter_us;          // random delay of up to this much on top, UDP packets may overtake each other
+    float       loss_rate;          // chance a packet is dropped, 0 to 1. TCP drops its bytes from the stream
+    const char * recording;         // rplidar_response_measurement_node_hq_t records as returned by grabScanDataHq(),
+                                    // revolutions start at a node with the sync flag. NULL for a synthetic room
+};
+
+struct RplidarEmulatorStats {
+    _u64    commands;               // commands answered or executed
+    _u64    packets_sent;
+    _u64    packets_dropped;        // packets dropped by loss_rate
+    _u64    bytes_sent;
+    _u64    connections;            // TCP connections accepted, UDP clients seen
+};
+
+class RPlidarEmulator {
+public:
+    /// Start the emulated devices, one thread each
+    /// Returns NULL if the config is invalid, the recording can't be read or a port can't be bound
+    static RPlidarEmulator * CreateEmulator(const RplidarEmulatorConfig & config);
+
+    /// Stop the devices and close their ports
+    static void DisposeEmulator(RPlidarEmulator * emulator);
+
+    /// The port of device n, connect a driver to it with connect(L"127.0.0.1", port)
+    virtual _u16 getPort(size_t device) = 0;
+
+    /// The counters of device n since it started
+    virtual u_result getStats(size_t device, RplidarEmulatorStats & stats) = 0;
+
+    virtual ~RPlidarEmulator() {}
+protected:
+    RPlidarEmulator() {}
+};
+
+}}}
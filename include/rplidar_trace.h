@@ -0,0 +1,92 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+// Begin/end trace events for finding where the time goes in the acquisition pipeline.
+// Build with RPLIDAR_ENABLE_TRACE defined to record them, otherwise the macros expand to nothing.
+// Every thread records into its own buffer without locks, the newest events overwrite the oldest.
+// Names must be string literals, only the pointer is stored.
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+class RPlidarTrace
+{
+public:
+    /// Record the start of a named section on the calling thread
+    static void begin(const char * name);
+
+    /// Record the end of the section started with the same name
+    static void end(const char * name);
+
+    /// Name the calling thread in the trace output
+    static void setThreadName(const char * name);
+
+    /// Write the recorded events of all threads as Chrome trace JSON, loadable in chrome://tracing or Perfetto
+    /// Events recorded while dumping may be missing or torn.
+    ///
+    /// \param path           The file to write
+    /// \return false if the file can't be written or tracing was not compiled in
+    static bool dump(const char * path);
+
+    /// Drop all recorded events
+    static void clear();
+};
+
+class RPlidarTraceScope
+{
+public:
+    explicit RPlidarTraceScope(const char * name) : _name(name) { RPlidarTrace::begin(name); }
+    ~RPlidarTraceScope() { RPlidarTrace::end(_name); }
+
+private:
+    const char * _name;
+};
+
+}}}
+
+#define RPLIDAR_TRACE_CONCAT_(a, b) a##b
+#define RPLIDAR_TRACE_CONCAT(a, b)  RPLIDAR_TRACE_CONCAT_(a, b)
+
+#ifdef RPLIDAR_ENABLE_TRACE
+#define RPLIDAR_TRACE_SCOPE(name)   rp::standalone::rplidar::RPlidarTraceScope RPLIDAR_TRACE_CONCAT(_trace_scope_, __LINE__)(name)
+#define RPLIDAR_TRACE_BEGIN(name)   rp::standalone::rplidar::RPlidarTrace::begin(name)
+#define RPLIDAR_TRACE_END(name)     rp::standalone::rplidar::RPlidarTrace::end(name)
+#define RPLIDAR_TRACE_THREAD(name)  rp::standalone::rplidar::RPlidarTrace::setThreadName(name)
+#else
+#define RPLIDAR_TRACE_SCOPE(name)   ((void)0)
+#define RPLIDAR_TRACE_BEGIN(name)   ((void)0)
+#define RPLIDAR_TRACE_END(name)     ((void)0)
+#define RPLIDAR_TRACE_THREAD(name)  ((void)0)
+#endif
@@ -0,0 +1,195 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2018 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+// The few io_uring calls the reactor needs, made with the raw system calls so liburing is not required.
+// Only built with RPLIDAR_USE_IO_URING, the kernel headers must be from Linux 5.6 or later.
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+namespace rp{ namespace arch{
+
+class io_uring_queue
+{
+public:
+    io_uring_queue()
+        : _fd(-1), _ring(NULL), _ringSize(0), _sqes(NULL), _sqesSize(0), _sqLocalTail(0), _sqSubmitted(0)
+    {
+    }
+
+    ~io_uring_queue()
+    {
+        close();
+    }
+
+    // false when the kernel has no io_uring (before 5.1, or blocked by seccomp) or lacks one of the ops
+    bool open(unsigned entries, const _u8 * requiredOps, size_t opCount)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        _fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (_fd < 0) return false;
+
+        // 5.4 maps both rings at once, 5.5 stops dropping completions when the queue overflows
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)
+            || !_probe(requiredOps, opCount)) {
+            close();
+            return false;
+        }
+
+        size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        _ringSize = sqSize > cqSize ? sqSize : cqSize;
+        _ring = (_u8 *)mmap(NULL, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+        _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        _sqes = (io_uring_sqe *)mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+        if (_ring == MAP_FAILED || _sqes == MAP_FAILED) {
+            if (_ring == MAP_FAILED) _ring = NULL;
+            if (_sqes == MAP_FAILED) _sqes = NULL;
+            close();
+            return false;
+        }
+
+        _sqHead = (unsigned *)(_ring + params.sq_off.head);
+        _sqTail = (unsigned *)(_ring + params.sq_off.tail);
+        _sqArray = (unsigned *)(_ring + params.sq_off.array);
+        _sqMask = *(unsigned *)(_ring + params.sq_off.ring_mask);
+        _sqEntries = params.sq_entries;
+        _cqHead = (unsigned *)(_ring + params.cq_off.head);
+        _cqTail = (unsigned *)(_ring + params.cq_off.tail);
+        _cqes = (io_uring_cqe *)(_ring + params.cq_off.cqes);
+        _cqMask = *(unsigned *)(_ring + params.cq_off.ring_mask);
+        _sqLocalTail = _sqSubmitted = *_sqTail;
+        return true;
+    }
+
+    void close()
+    {
+        if (_sqes) munmap(_sqes, _sqesSize);
+        if (_ring) munmap(_ring, _ringSize);
+        if (_fd >= 0) ::close(_fd);
+        _sqes = NULL;
+        _ring = NULL;
+        _fd = -1;
+    }
+
+    // submission entries that can still be taken before the next submit()
+    size_t freeSqes() const
+    {
+        return _sqEntries - (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE));
+    }
+
+    // the next submission entry, cleared, NULL when the queue is full
+    io_uring_sqe * getSqe()
+    {
+        if (!freeSqes()) return NULL;
+
+        unsigned index = _sqLocalTail & _sqMask;
+        _sqArray[index] = index;
+        ++_sqLocalTail;
+
+        io_uring_sqe * sqe = &_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // submits the new entries and waits for waitCount completions with a single io_uring_enter()
+    // returns the number of entries submitted or -errno, -EINTR when a signal cut the wait short
+    int submitAndWait(unsigned waitCount)
+    {
+        __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = _sqLocalTail - _sqSubmitted;
+
+        int ans = (int)syscall(__NR_io_uring_enter, _fd, toSubmit, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ans < 0) return -errno;
+        _sqSubmitted += ans;
+        return ans;
+    }
+
+    // takes the oldest completion
+    bool popCqe(io_uring_cqe & cqe)
+    {
+        unsigned head = *_cqHead;
+        if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) return false;
+
+        cqe = _cqes[head & _cqMask];
+        __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+protected:
+    // IORING_REGISTER_PROBE came with 5.6 together with IORING_OP_READ
+    bool _probe(const _u8 * requiredOps, size_t opCount)
+    {
+        size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        io_uring_probe * probe = (io_uring_probe *)calloc(1, size);
+        if (!probe) return false;
+
+        bool supported = syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+        for (size_t pos = 0; supported && pos < opCount; ++pos) {
+            _u8 op = requiredOps[pos];
+            supported = op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        }
+        free(probe);
+        return supported;
+    }
+
+    int             _fd;
+    _u8 *           _ring;
+    size_t          _ringSize;
+    io_uring_sqe *  _sqes;
+    size_t          _sqesSize;
+
+    unsigned *      _sqHead;
+    unsigned *      _sqTail;
+    unsigned *      _sqArray;
+    unsigned        _sqMask;
+    unsigned        _sqEntries;
+    unsigned        _sqLocalTail;
+    unsigned        _sqSubmitted;
+
+    unsigned *      _cqHead;
+    unsigned *      _cqTail;
+    io_uring_cqe *  _cqes;
+    unsigned        _cqMask;
+};
+
+}}
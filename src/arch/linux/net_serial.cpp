@@ -94,6 +94,15 @@ bool raw_serial::bind(const char * portname, uint32_t baudrate, uint32_t flags)
     return true;
 }
 
+bool raw_serial::bind(const wchar_t * portname, _u32 baudrate, _u32 flags)
+{
+    // the driver passes wide port names, device paths are plain ASCII
+    char name[sizeof(_portName)];
+    size_t len = wcstombs(name, portname, sizeof(name));
+    if (len == (size_t)-1 || len >= sizeof(name)) return false;
+    return bind((const char *)name, baudrate, flags);
+}
+
 bool raw_serial::open(const char * portname, uint32_t baudrate, uint32_t flags)
 {
     if (isOpened()) close();
@@ -428,6 +437,15 @@ void raw_serial::cancelOperation()
     ::write(_selfpipe[1], "x", 1);
 }
 
+void raw_serial::clearCancel()
+{
+    _operation_aborted = false;
+    if (_selfpipe[0] == -1) return;
+
+    int ch;
+    while (::read(_selfpipe[0], &ch, 1) > 0) {}
+}
+
 _u32 raw_serial::getTermBaudBitmap(_u32 baud)
 {
 #define BAUD_CONV( _baud_) case _baud_:  return B##_baud_ 
@@ -49,6 +49,7 @@ public:
     raw_serial();
     virtual ~raw_serial();
     virtual bool bind(const char * portname, uint32_t baudrate, uint32_t flags = 0);
+    virtual bool bind(const wchar_t * portname, _u32 baudrate, _u32 flags = 0);
     virtual bool open();
     virtual void close();
     virtual void flush( _u32 flags);
@@ -69,6 +70,8 @@ public:
     _u32 getTermBaudBitmap(_u32 baud);
 
     virtual void cancelOperation();
+    virtual void clearCancel();
+    virtual int getNativeHandle() { return serial_fd; }
 
 protected:
     bool open(const char * portname, uint32_t baudrate, uint32_t flags = 0);
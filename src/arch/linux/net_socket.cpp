@@ -15,6 +15,7 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <poll.h>
 
 namespace rp{ namespace net {
 
@@ -167,7 +168,7 @@ u_result SocketAddress::getAddressAsString(char * buffer, size_t buffersize) con
 
         break;
     }
-    return ans<=0?RESULT_OPERATION_FAIL:RESULT_OK;
+    return !ans?RESULT_OPERATION_FAIL:RESULT_OK;
 }
 
 
@@ -313,6 +314,29 @@ namespace rp { namespace arch { namespace net{
 
 using namespace rp::net;
 
+// poll() has no FD_SETSIZE limit on the descriptor value, unlike select()
+static u_result _pollSocket(int fd, short events, _u32 timeout)
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    int ans = ::poll(&pfd, 1, (int)timeout);
+
+    switch (ans) {
+        case 1:
+            // fired
+            return RESULT_OK;
+        case 0:
+            // timeout
+            return RESULT_OPERATION_TIMEOUT;
+        default:
+            delay(0); //relax cpu
+            return RESULT_OPERATION_FAIL;
+    }
+}
+
 class _single_thread StreamSocketImpl : public StreamSocket
 {
 public:
@@ -384,6 +408,29 @@ public:
 
         return RESULT_OK;
     }
+
+    virtual int getNativeHandle()
+    {
+        return _socket_fd;
+    }
+
+    virtual u_result setBufferSize(size_t size, socket_direction_mask msk)
+    {
+        int ans;
+        int bufsize = (int)size;
+
+        if (msk & SOCKET_DIR_RD) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        if (msk & SOCKET_DIR_WR) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        return RESULT_OK;
+    }
   
     virtual u_result connect(const SocketAddress & pairAddress)
     {
@@ -476,7 +523,6 @@ public:
         }
     }
 
-#if 0
     virtual u_result recvNoWait(void *buf, size_t len, size_t & recv_len)
     {
         size_t ans = ::recv( _socket_fd, buf, len, MSG_DONTWAIT);
@@ -489,13 +535,16 @@ public:
             }
 
 
+        } else if (ans == 0 && len) {
+            // the peer has closed the connection
+            recv_len = 0;
+            return RESULT_OPERATION_FAIL;
         } else {
             recv_len = ans;
             return RESULT_OK;
         }
 
     }
-#endif
 
     virtual u_result getPeerAddress(SocketAddress & peerAddr)
     {
@@ -545,50 +594,12 @@ public:
 
     virtual u_result waitforSent(_u32 timeout ) 
     {
-        fd_set wrset;
-        FD_ZERO(&wrset);
-        FD_SET(_socket_fd, &wrset);
-
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, NULL, &wrset, NULL, &tv);
-
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
-        }
+        return _pollSocket(_socket_fd, POLLOUT, timeout);
     }
 
     virtual u_result waitforData(_u32 timeout )
     {
-        fd_set rdset;
-        FD_ZERO(&rdset);
-        FD_SET(_socket_fd, &rdset);
-
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, &rdset, NULL, NULL, &tv);
-
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
-        }
+        return _pollSocket(_socket_fd, POLLIN, timeout);
     }
 
 protected:
@@ -667,54 +678,39 @@ public:
 
         return RESULT_OK;
     }
-  
 
-    virtual u_result waitforSent(_u32 timeout ) 
+    virtual int getNativeHandle()
     {
-        fd_set wrset;
-        FD_ZERO(&wrset);
-        FD_SET(_socket_fd, &wrset);
+        return _socket_fd;
+    }
 
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, NULL, &wrset, NULL, &tv);
+    virtual u_result setBufferSize(size_t size, socket_direction_mask msk)
+    {
+        int ans;
+        int bufsize = (int)size;
 
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
+        if (msk & SOCKET_DIR_RD) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
         }
+
+        if (msk & SOCKET_DIR_WR) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        return RESULT_OK;
     }
+  
 
-    virtual u_result waitforData(_u32 timeout )
+    virtual u_result waitforSent(_u32 timeout ) 
     {
-        fd_set rdset;
-        FD_ZERO(&rdset);
-        FD_SET(_socket_fd, &rdset);
-
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, &rdset, NULL, NULL, &tv);
+        return _pollSocket(_socket_fd, POLLOUT, timeout);
+    }
 
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
-        }
+    virtual u_result waitforData(_u32 timeout )
+    {
+        return _pollSocket(_socket_fd, POLLIN, timeout);
     }
 
     virtual u_result sendTo(const SocketAddress & target, const void * buffer, size_t len)
@@ -744,6 +740,56 @@ public:
     }
 
 
+    virtual u_result setPairAddress(const SocketAddress * pairAddress)
+    {
+        sockaddr_storage unspec;
+        const struct sockaddr * addr;
+        if (pairAddress) {
+            addr = reinterpret_cast<const struct sockaddr *>(pairAddress->getPlatformData());
+        } else {
+            // an AF_UNSPEC address dissolves the association
+            memset(&unspec, 0, sizeof(unspec));
+            unspec.ss_family = AF_UNSPEC;
+            addr = reinterpret_cast<const struct sockaddr *>(&unspec);
+        }
+
+        socklen_t addrLen = (addr->sa_family == AF_INET6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+        int ans = ::connect(_socket_fd, addr, addrLen);
+        if (!ans) return RESULT_OK;
+
+        switch (errno) {
+            case EAFNOSUPPORT:
+                return RESULT_OPERATION_NOT_SUPPORT;
+            default:
+                return RESULT_OPERATION_FAIL;
+        }
+    }
+
+    virtual u_result send(const void * buffer, size_t len)
+    {
+        size_t ans = ::send( _socket_fd, buffer, len, 0);
+        if (ans != (size_t)-1) {
+            assert(ans == len);
+            // a datagram goes out whole or not at all
+            if (ans != len) return RESULT_OPERATION_FAIL;
+            return RESULT_OK;
+        } else {
+            switch (errno) {
+                case EAGAIN:
+#if EWOULDBLOCK!=EAGAIN
+                case EWOULDBLOCK:
+#endif
+                    return RESULT_OPERATION_TIMEOUT;
+
+                case EMSGSIZE:
+                    return RESULT_INVALID_DATA;
+                default:
+                    return RESULT_OPERATION_FAIL;
+            }
+        }
+    }
+
+
     virtual u_result recvFrom(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr)
     {
         struct sockaddr * addr = (sourceAddr?reinterpret_cast<struct sockaddr *>(const_cast<void *>(sourceAddr->getPlatformData())):NULL);
@@ -769,6 +815,39 @@ public:
 
     }
 
+    virtual u_result recvBatchNoWait(_u8 * buffers, size_t bufferSize, size_t count, size_t * recv_lens, size_t & recv_count)
+    {
+        mmsghdr msgs[MAX_RECV_BATCH];
+        iovec   iovs[MAX_RECV_BATCH];
+
+        recv_count = 0;
+        if (count > MAX_RECV_BATCH) count = MAX_RECV_BATCH;
+
+        memset(msgs, 0, sizeof(mmsghdr) * count);
+        for (size_t pos = 0; pos < count; ++pos) {
+            iovs[pos].iov_base = buffers + pos * bufferSize;
+            iovs[pos].iov_len = bufferSize;
+            msgs[pos].msg_hdr.msg_iov = &iovs[pos];
+            msgs[pos].msg_hdr.msg_iovlen = 1;
+        }
+
+        // one syscall for the whole batch
+        int ans = ::recvmmsg(_socket_fd, msgs, (unsigned int)count, MSG_DONTWAIT, NULL);
+        if (ans < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return RESULT_OK;
+            } else {
+                return RESULT_OPERATION_FAIL;
+            }
+        }
+
+        for (int pos = 0; pos < ans; ++pos) {
+            recv_lens[pos] = (msgs[pos].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : msgs[pos].msg_len;
+        }
+        recv_count = ans;
+        return RESULT_OK;
+    }
+
 #if 0
     virtual u_result recvFromNoWait(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr)
     {
@@ -35,6 +35,7 @@
 #include "arch/linux/arch_linux.h"
 
 #include <sched.h>
+#include <sys/mman.h>
 
 namespace rp{ namespace hal{
 
@@ -72,27 +73,29 @@ u_result Thread::setPriority( priority_val_t p)
         return RESULT_OPERATION_FAIL;
     }   
 
-    //int pthread_priority = 0 ;
+    int pthread_priority_max = sched_get_priority_max(SCHED_RR);
+    int pthread_priority_min = sched_get_priority_min(SCHED_RR);
+    int pthread_priority = 0 ;
 
     switch(p)
     {
     case PRIORITY_REALTIME:
-        //pthread_priority = pthread_priority_max;
+        pthread_priority = pthread_priority_max;
         current_policy = SCHED_RR;
         break;
     case PRIORITY_HIGH:
-        //pthread_priority = (pthread_priority_max + pthread_priority_min)/2;
+        pthread_priority = (pthread_priority_max + pthread_priority_min)/2;
         current_policy = SCHED_RR;
         break;
     case PRIORITY_NORMAL:
     case PRIORITY_LOW:
     case PRIORITY_IDLE:
-        //pthread_priority = 0;
+        pthread_priority = 0;
         current_policy = SCHED_OTHER;
         break;
     }
 
-    current_param.__sched_priority = current_policy;
+    current_param.sched_priority = pthread_priority;
     if ( (ans = pthread_setschedparam( (pthread_t) this->_handle, current_policy, &current_param)) )
     {
         return RESULT_OPERATION_FAIL;
@@ -115,22 +118,99 @@ Thread::priority_val_t Thread::getPriority()
     int pthread_priority_max = sched_get_priority_max(SCHED_RR);
     int pthread_priority_min = sched_get_priority_min(SCHED_RR);
 
-    if (current_param.__sched_priority ==(pthread_priority_max ))
+    if (current_policy == SCHED_OTHER)
+    {
+        return PRIORITY_NORMAL;
+    }
+    if (current_param.sched_priority ==(pthread_priority_max ))
     {
         return PRIORITY_REALTIME;
     }
-    if (current_param.__sched_priority >=(pthread_priority_max + pthread_priority_min)/2)
+    if (current_param.sched_priority >=(pthread_priority_max + pthread_priority_min)/2)
     {
         return PRIORITY_HIGH;
     }
     return PRIORITY_NORMAL;
 }
 
+u_result Thread::setCurrentRealtime(int priority)
+{
+    struct sched_param param;
+    int policy = SCHED_OTHER;
+    param.sched_priority = 0;
+
+    if (priority > 0)
+    {
+        int priority_max = sched_get_priority_max(SCHED_FIFO);
+        int priority_min = sched_get_priority_min(SCHED_FIFO);
+        if (priority > priority_max) priority = priority_max;
+        if (priority < priority_min) priority = priority_min;
+        policy = SCHED_FIFO;
+        param.sched_priority = priority;
+    }
+
+    int ans = pthread_setschedparam(pthread_self(), policy, &param);
+    if (ans == EPERM) return RESULT_OPERATION_NOT_SUPPORT;
+    return ans ? RESULT_OPERATION_FAIL : RESULT_OK;
+}
+
+u_result Thread::setCurrentAffinity(_u64 cpuMask)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    int cpuCount = (int)sysconf(_SC_NPROCESSORS_CONF);
+    if (cpuCount > 64) cpuCount = 64;
+    for (int cpu = 0; cpu < cpuCount; ++cpu)
+    {
+        if (!cpuMask || (cpuMask & ((_u64)1 << cpu))) CPU_SET(cpu, &cpus);
+    }
+    if (!CPU_COUNT(&cpus)) return RESULT_INVALID_DATA;
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
+
+u_result Thread::lockMemory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    {
+        return (errno == EPERM || errno == ENOMEM) ? RESULT_OPERATION_NOT_SUPPORT : RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
+
 u_result Thread::join(unsigned long timeout)
 {
     if (!this->_handle) return RESULT_OK;
-    
+
+#if defined(__GLIBC__)
+    if (timeout != (unsigned long)-1)
+    {
+        // pthread_timedjoin_np takes an absolute CLOCK_REALTIME deadline
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        int ans = pthread_timedjoin_np((pthread_t)(this->_handle), NULL, &deadline);
+        if (ans == ETIMEDOUT) return RESULT_OPERATION_TIMEOUT;
+        this->_handle = 0;
+        return ans ? RESULT_OPERATION_FAIL : RESULT_OK;
+    }
+#endif
+
     pthread_join((pthread_t)(this->_handle), NULL);
+    // a joined pthread_t must not be joined again
+    this->_handle = 0;
     return RESULT_OK;
 }
 
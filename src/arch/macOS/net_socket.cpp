@@ -15,6 +15,7 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <poll.h>
 
 namespace rp{ namespace net {
 
@@ -313,6 +314,29 @@ namespace rp { namespace arch { namespace net{
 
 using namespace rp::net;
 
+// poll() has no FD_SETSIZE limit on the descriptor value, unlike select()
+static u_result _pollSocket(int fd, short events, _u32 timeout)
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    int ans = ::poll(&pfd, 1, (int)timeout);
+
+    switch (ans) {
+        case 1:
+            // fired
+            return RESULT_OK;
+        case 0:
+            // timeout
+            return RESULT_OPERATION_TIMEOUT;
+        default:
+            delay(0); //relax cpu
+            return RESULT_OPERATION_FAIL;
+    }
+}
+
 class _single_thread StreamSocketImpl : public StreamSocket
 {
 public:
@@ -385,6 +409,29 @@ public:
 
         return RESULT_OK;
     }
+
+    virtual int getNativeHandle()
+    {
+        return _socket_fd;
+    }
+
+    virtual u_result setBufferSize(size_t size, socket_direction_mask msk)
+    {
+        int ans;
+        int bufsize = (int)size;
+
+        if (msk & SOCKET_DIR_RD) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        if (msk & SOCKET_DIR_WR) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        return RESULT_OK;
+    }
   
     virtual u_result connect(const SocketAddress & pairAddress)
     {
@@ -477,7 +524,6 @@ public:
         }
     }
 
-#if 0
     virtual u_result recvNoWait(void *buf, size_t len, size_t & recv_len)
     {
         size_t ans = ::recv( _socket_fd, buf, len, MSG_DONTWAIT);
@@ -490,13 +536,16 @@ public:
             }
 
 
+        } else if (ans == 0 && len) {
+            // the peer has closed the connection
+            recv_len = 0;
+            return RESULT_OPERATION_FAIL;
         } else {
             recv_len = ans;
             return RESULT_OK;
         }
 
     }
-#endif
 
     virtual u_result getPeerAddress(SocketAddress & peerAddr)
     {
@@ -546,50 +595,12 @@ public:
 
     virtual u_result waitforSent(_u32 timeout ) 
     {
-        fd_set wrset;
-        FD_ZERO(&wrset);
-        FD_SET(_socket_fd, &wrset);
-
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, NULL, &wrset, NULL, &tv);
-
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
-        }
+        return _pollSocket(_socket_fd, POLLOUT, timeout);
     }
 
     virtual u_result waitforData(_u32 timeout )
     {
-        fd_set rdset;
-        FD_ZERO(&rdset);
-        FD_SET(_socket_fd, &rdset);
-
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, &rdset, NULL, NULL, &tv);
-
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
-        }
+        return _pollSocket(_socket_fd, POLLIN, timeout);
     }
 
 protected:
@@ -668,54 +679,39 @@ public:
 
         return RESULT_OK;
     }
-  
 
-    virtual u_result waitforSent(_u32 timeout ) 
+    virtual int getNativeHandle()
     {
-        fd_set wrset;
-        FD_ZERO(&wrset);
-        FD_SET(_socket_fd, &wrset);
+        return _socket_fd;
+    }
 
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, NULL, &wrset, NULL, &tv);
-
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
+    virtual u_result setBufferSize(size_t size, socket_direction_mask msk)
+    {
+        int ans;
+        int bufsize = (int)size;
+
+        if (msk & SOCKET_DIR_RD) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        if (msk & SOCKET_DIR_WR) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
         }
+
+        return RESULT_OK;
     }
+  
 
-    virtual u_result waitforData(_u32 timeout )
+    virtual u_result waitforSent(_u32 timeout ) 
     {
-        fd_set rdset;
-        FD_ZERO(&rdset);
-        FD_SET(_socket_fd, &rdset);
+        return _pollSocket(_socket_fd, POLLOUT, timeout);
+    }
 
-        timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        int ans = ::select(_socket_fd+1, &rdset, NULL, NULL, &tv);
-
-        switch (ans) {
-            case 1:
-                // fired
-                return RESULT_OK;
-            case 0:
-                // timeout
-                return RESULT_OPERATION_TIMEOUT;
-            default:
-                delay(0); //relax cpu
-                return RESULT_OPERATION_FAIL;
-        }
+    virtual u_result waitforData(_u32 timeout )
+    {
+        return _pollSocket(_socket_fd, POLLIN, timeout);
     }
 
     virtual u_result sendTo(const SocketAddress & target, const void * buffer, size_t len)
@@ -745,6 +741,56 @@ public:
     }
 
 
+    virtual u_result setPairAddress(const SocketAddress * pairAddress)
+    {
+        sockaddr_storage unspec;
+        const struct sockaddr * addr;
+        if (pairAddress) {
+            addr = reinterpret_cast<const struct sockaddr *>(pairAddress->getPlatformData());
+        } else {
+            // an AF_UNSPEC address dissolves the association
+            memset(&unspec, 0, sizeof(unspec));
+            unspec.ss_family = AF_UNSPEC;
+            addr = reinterpret_cast<const struct sockaddr *>(&unspec);
+        }
+
+        socklen_t addrLen = (addr->sa_family == AF_INET6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+        int ans = ::connect(_socket_fd, addr, addrLen);
+        if (!ans) return RESULT_OK;
+
+        switch (errno) {
+            case EAFNOSUPPORT:
+                return RESULT_OPERATION_NOT_SUPPORT;
+            default:
+                return RESULT_OPERATION_FAIL;
+        }
+    }
+
+    virtual u_result send(const void * buffer, size_t len)
+    {
+        size_t ans = ::send( _socket_fd, buffer, len, 0);
+        if (ans != (size_t)-1) {
+            assert(ans == len);
+            // a datagram goes out whole or not at all
+            if (ans != len) return RESULT_OPERATION_FAIL;
+            return RESULT_OK;
+        } else {
+            switch (errno) {
+                case EAGAIN:
+#if EWOULDBLOCK!=EAGAIN
+                case EWOULDBLOCK:
+#endif
+                    return RESULT_OPERATION_TIMEOUT;
+
+                case EMSGSIZE:
+                    return RESULT_INVALID_DATA;
+                default:
+                    return RESULT_OPERATION_FAIL;
+            }
+        }
+    }
+
+
     virtual u_result recvFrom(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr)
     {
         struct sockaddr * addr = (sourceAddr?reinterpret_cast<struct sockaddr *>(const_cast<void *>(sourceAddr->getPlatformData())):NULL);
@@ -770,6 +816,32 @@ public:
 
     }
 
+    virtual u_result recvBatchNoWait(_u8 * buffers, size_t bufferSize, size_t count, size_t * recv_lens, size_t & recv_count)
+    {
+        recv_count = 0;
+        if (count > MAX_RECV_BATCH) count = MAX_RECV_BATCH;
+
+        // no recvmmsg() here, one recvmsg() per datagram
+        while (recv_count < count) {
+            iovec iov;
+            iov.iov_base = buffers + recv_count * bufferSize;
+            iov.iov_len = bufferSize;
+
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+
+            ssize_t ans = ::recvmsg(_socket_fd, &msg, MSG_DONTWAIT);
+            if (ans < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || recv_count) break;
+                return RESULT_OPERATION_FAIL;
+            }
+            recv_lens[recv_count++] = (msg.msg_flags & MSG_TRUNC) ? 0 : (size_t)ans;
+        }
+        return RESULT_OK;
+    }
+
 #if 0
     virtual u_result recvFromNoWait(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr)
     {
@@ -68,11 +68,44 @@ Thread::priority_val_t Thread::getPriority()
 	return PRIORITY_NORMAL;
 }
 
+u_result Thread::setCurrentRealtime(int priority)
+{
+    struct sched_param param;
+    int policy = SCHED_OTHER;
+    param.sched_priority = 0;
+
+    if (priority > 0)
+    {
+        int priority_max = sched_get_priority_max(SCHED_FIFO);
+        int priority_min = sched_get_priority_min(SCHED_FIFO);
+        if (priority > priority_max) priority = priority_max;
+        if (priority < priority_min) priority = priority_min;
+        policy = SCHED_FIFO;
+        param.sched_priority = priority;
+    }
+
+    return pthread_setschedparam(pthread_self(), policy, &param) ? RESULT_OPERATION_FAIL : RESULT_OK;
+}
+
+u_result Thread::setCurrentAffinity(_u64 cpuMask)
+{
+    // the scheduler offers affinity tags only, not hard cpu binding
+    return cpuMask ? RESULT_OPERATION_NOT_SUPPORT : RESULT_OK;
+}
+
+u_result Thread::lockMemory()
+{
+    return RESULT_OPERATION_NOT_SUPPORT;
+}
+
 u_result Thread::join(unsigned long timeout)
 {
     if (!this->_handle) return RESULT_OK;
     
+    // there is no timed join on this platform, the timeout is ignored and the call never
+    // returns RESULT_OPERATION_TIMEOUT, so callers bounding a join by it wait for the thread
     pthread_join((pthread_t)(this->_handle), NULL);
+    this->_handle = 0;
     return RESULT_OK;
 }
 
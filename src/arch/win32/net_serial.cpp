@@ -53,6 +53,7 @@ raw_serial::~raw_serial()
     CloseHandle(_ro.hEvent);
     CloseHandle(_wo.hEvent);
     CloseHandle(_wait_o.hEvent);
+    CloseHandle(_cancel_evt);
 }
 
 bool raw_serial::open()
@@ -152,8 +153,11 @@ int raw_serial::senddata(const unsigned char * data, size_t size)
         PurgeComm(_serial_handle, PURGE_TXABORT | PURGE_TXCLEAR);
 
     if(!WriteFile(_serial_handle, data, size, &w_len, &_wo))
-        if(GetLastError() != ERROR_IO_PENDING)
+    {
+        // wait for the overlapped write, the caller's buffer and _wo must outlive it
+        if(GetLastError() != ERROR_IO_PENDING || !GetOverlappedResult(_serial_handle, &_wo, &w_len, TRUE))
             w_len = ANS_DEV_ERR;
+    }
 
     return w_len;
 }
@@ -250,7 +254,19 @@ int raw_serial::waitfordata(size_t data_count, _u32 timeout, size_t * returned_s
         {
             if(GetLastError() == ERROR_IO_PENDING)
             {
-                if (WaitForSingleObject(_wait_o.hEvent, timeout) == WAIT_TIMEOUT)
+                HANDLE waitEvts[2] = { _wait_o.hEvent, _cancel_evt };
+                DWORD waitAns = WaitForMultipleObjects(2, waitEvts, FALSE, timeout);
+                if (waitAns == WAIT_OBJECT_0 + 1)
+                {
+                    // cancelled, the pending WaitCommEvent must finish before _wait_o is reused
+                    ResetEvent(_cancel_evt);
+                    SetCommMask(_serial_handle, EV_RXCHAR | EV_ERR);
+                    GetOverlappedResult(_serial_handle, &_wait_o, &length, TRUE);
+                    ::ResetEvent(_wait_o.hEvent);
+                    *returned_size =0;
+                    return ANS_TIMEOUT;
+                }
+                if (waitAns == WAIT_TIMEOUT)
                 {
                     *returned_size =0;
                     return ANS_TIMEOUT;
@@ -300,6 +316,16 @@ size_t raw_serial::rxqueue_count()
     return com_stat.cbInQue;
 }
 
+void raw_serial::cancelOperation()
+{
+    SetEvent(_cancel_evt);
+}
+
+void raw_serial::clearCancel()
+{
+    ResetEvent(_cancel_evt);
+}
+
 void raw_serial::setDTR()
 {
     if ( !isOpened() ) return;
@@ -333,6 +359,7 @@ void raw_serial::_init()
     _ro.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     _wo.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     _wait_o.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    _cancel_evt = CreateEvent(NULL, TRUE, FALSE, NULL);
 
     _portName[0] = 0;
 }
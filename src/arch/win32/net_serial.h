@@ -67,6 +67,8 @@ public:
 
     virtual void setDTR();
     virtual void clearDTR();
+    virtual void cancelOperation();
+    virtual void clearCancel();
 
 protected:
     bool open(const wchar_t * portname, _u32 baudrate, _u32 flags);
@@ -78,6 +80,7 @@ protected:
 
     OVERLAPPED _ro, _wo;
     OVERLAPPED _wait_o;
+    HANDLE _cancel_evt;
     volatile HANDLE _serial_handle;
     DCB _dcb;
     COMMTIMEOUTS _co;
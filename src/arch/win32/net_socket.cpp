@@ -461,6 +461,24 @@ public:
 
         return RESULT_OK;
     }
+
+    virtual u_result setBufferSize(size_t size, socket_direction_mask msk)
+    {
+        int ans;
+        int bufsize = (int)size;
+
+        if (msk & SOCKET_DIR_RD) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_RCVBUF, (const char *)&bufsize, (int)sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        if (msk & SOCKET_DIR_WR) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_SNDBUF, (const char *)&bufsize, (int)sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        return RESULT_OK;
+    }
   
     virtual u_result connect(const SocketAddress & pairAddress)
     {
@@ -547,6 +565,21 @@ public:
         }
     }
 
+    virtual u_result recvNoWait(void *buf, size_t len, size_t & recv_len)
+    {
+        // winsock has no MSG_DONTWAIT, only ask for what is already queued
+        u_long avail = 0;
+        recv_len = 0;
+        if (::ioctlsocket(_socket_fd, FIONREAD, &avail) == SOCKET_ERROR) {
+            return RESULT_OPERATION_FAIL;
+        }
+        if (!avail) {
+            return RESULT_OK;
+        }
+        if (len > avail) len = avail;
+        return recv(buf, len, recv_len);
+    }
+
     virtual u_result getPeerAddress(SocketAddress & peerAddr)
     {
         struct sockaddr * addr = reinterpret_cast<struct sockaddr *>(const_cast<void *>(peerAddr.getPlatformData())); //donnot do this at home...
@@ -718,6 +751,24 @@ public:
 
         return RESULT_OK;
     }
+
+    virtual u_result setBufferSize(size_t size, socket_direction_mask msk)
+    {
+        int ans;
+        int bufsize = (int)size;
+
+        if (msk & SOCKET_DIR_RD) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_RCVBUF, (const char *)&bufsize, (int)sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        if (msk & SOCKET_DIR_WR) {
+             ans = ::setsockopt( _socket_fd, SOL_SOCKET, SO_SNDBUF, (const char *)&bufsize, (int)sizeof(bufsize) );
+             if (ans) return RESULT_OPERATION_FAIL;
+        }
+
+        return RESULT_OK;
+    }
   
 
     virtual u_result waitforSent(_u32 timeout ) 
@@ -790,6 +841,52 @@ public:
     }
 
 
+    virtual u_result setPairAddress(const SocketAddress * pairAddress)
+    {
+        sockaddr_storage unspec;
+        const struct sockaddr * addr;
+        if (pairAddress) {
+            addr = reinterpret_cast<const struct sockaddr *>(pairAddress->getPlatformData());
+        } else {
+            // an AF_UNSPEC address dissolves the association
+            memset(&unspec, 0, sizeof(unspec));
+            unspec.ss_family = AF_UNSPEC;
+            addr = reinterpret_cast<const struct sockaddr *>(&unspec);
+        }
+
+        int addrLen = (addr->sa_family == AF_INET6) ? (int)sizeof(sockaddr_in6) : (int)sizeof(sockaddr_in);
+        int ans = ::connect(_socket_fd, addr, addrLen);
+        if (!ans) return RESULT_OK;
+
+        switch (WSAGetLastError()) {
+            case WSAEAFNOSUPPORT:
+                return RESULT_OPERATION_NOT_SUPPORT;
+            default:
+                return RESULT_OPERATION_FAIL;
+        }
+    }
+
+    virtual u_result send(const void * buffer, size_t len)
+    {
+        int ans = ::send( _socket_fd, (const char *)buffer, (int)len, 0);
+        if (ans != SOCKET_ERROR) {
+            assert(ans == (int)len);
+            // a datagram goes out whole or not at all
+            if (ans != (int)len) return RESULT_OPERATION_FAIL;
+            return RESULT_OK;
+        } else {
+           switch(WSAGetLastError()) {
+            case WSAETIMEDOUT:
+                return RESULT_OPERATION_TIMEOUT;
+            case WSAEMSGSIZE:
+                return RESULT_INVALID_DATA;
+            default:
+                return RESULT_OPERATION_FAIL;
+            }
+        }
+    }
+
+
     virtual u_result recvFrom(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr)
     {
         struct sockaddr * addr = (sourceAddr?reinterpret_cast<struct sockaddr *>(const_cast<void *>(sourceAddr->getPlatformData())):NULL);
@@ -812,6 +909,31 @@ public:
 
     }
 
+    virtual u_result recvBatchNoWait(_u8 * buffers, size_t bufferSize, size_t count, size_t * recv_lens, size_t & recv_count)
+    {
+        recv_count = 0;
+        if (count > MAX_RECV_BATCH) count = MAX_RECV_BATCH;
+
+        // winsock has neither recvmmsg() nor MSG_DONTWAIT, read while datagrams are queued
+        while (recv_count < count) {
+            u_long avail = 0;
+            if (::ioctlsocket(_socket_fd, FIONREAD, &avail) == SOCKET_ERROR) {
+                return RESULT_OPERATION_FAIL;
+            }
+            if (!avail) break;
+
+            int ans = ::recv(_socket_fd, (char *)(buffers + recv_count * bufferSize), (int)bufferSize, 0);
+            if (ans == SOCKET_ERROR) {
+                if (WSAGetLastError() != WSAEMSGSIZE) {
+                    if (recv_count) break;
+                    return RESULT_OPERATION_FAIL;
+                }
+                ans = 0;
+            }
+            recv_lens[recv_count++] = ans;
+        }
+        return RESULT_OK;
+    }
 
     
 protected:
@@ -41,7 +41,9 @@
 namespace rp{ namespace arch{
     void HPtimer_reset();
     _u32 getHDTimer();
+    _u64 rp_getus();
 }}
 
 #define getms()   rp::arch::getHDTimer()
+#define getus()   rp::arch::rp_getus()
 
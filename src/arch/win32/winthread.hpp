@@ -123,6 +123,33 @@ Thread::priority_val_t Thread::getPriority()
 	return PRIORITY_NORMAL;
 }
 
+u_result Thread::setCurrentRealtime(int priority)
+{
+	// windows has no fifo class for a single thread, map onto the thread priority
+	int win_priority = (priority > 0) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_NORMAL;
+	return SetThreadPriority(GetCurrentThread(), win_priority) ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
+u_result Thread::setCurrentAffinity(_u64 cpuMask)
+{
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+	{
+		return RESULT_OPERATION_FAIL;
+	}
+
+	DWORD_PTR threadMask = cpuMask ? (processMask & (DWORD_PTR)cpuMask) : processMask;
+	if (!threadMask) return RESULT_INVALID_DATA;
+
+	return SetThreadAffinityMask(GetCurrentThread(), threadMask) ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
+u_result Thread::lockMemory()
+{
+	// VirtualLock is bounded by the working set quota, not worth it here
+	return RESULT_OPERATION_NOT_SUPPORT;
+}
+
 u_result Thread::join(unsigned long timeout)
 {
     if (!this->_handle) return RESULT_OK;
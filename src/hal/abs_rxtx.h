@@ -71,7 +71,11 @@ public:
 
     virtual void setDTR() = 0;
     virtual void clearDTR() = 0;
+    // wakes up a waitfordata() in progress, or the next one if none is waiting
     virtual void cancelOperation() {}
+    // discards a cancellation nobody consumed
+    virtual void clearCancel() {}
+    virtual int getNativeHandle() { return -1; }
 
     virtual bool isOpened()
     {
@@ -33,8 +33,17 @@
  */
 
 #pragma once
+
+#ifndef _WIN32
+#include <atomic>
+#include <limits.h>
+#endif
+
 namespace rp{ namespace hal{
 
+// Timed waits run against the monotonic clock of getus(), so wall clock steps (NTP) don't
+// stretch or cut them short. On Linux the event is a futex: set() and a wait() that finds
+// the event already signalled don't enter the kernel.
 class Event
 {
 public:
@@ -49,14 +58,18 @@ public:
     Event(bool isAutoReset = true, bool isSignal = false)
 #ifdef _WIN32
         : _event(NULL)
-#else
+#elif defined(_MACOS)
         : _is_signalled(isSignal)
         , _isAutoReset(isAutoReset)
+#else
+        : _state(isSignal?1:0)
+        , _waiters(0)
+        , _isAutoReset(isAutoReset)
 #endif
     {
 #ifdef _WIN32
         _event = CreateEvent(NULL, isAutoReset?FALSE:TRUE, isSignal?TRUE:FALSE, NULL); 
-#else
+#elif defined(_MACOS)
         pthread_mutex_init(&_cond_locker, NULL);
         pthread_cond_init(&_cond_var, NULL);
 #endif
@@ -72,7 +85,7 @@ public:
         if (isSignal){
 #ifdef _WIN32
             SetEvent(_event);
-#else
+#elif defined(_MACOS)
             pthread_mutex_lock(&_cond_locker);
                
             if ( _is_signalled == false )
@@ -81,24 +94,50 @@ public:
                 pthread_cond_signal(&_cond_var);
             }
             pthread_mutex_unlock(&_cond_locker);
+#else
+            // only a transition with somebody asleep needs the kernel
+            if (_state.exchange(1) == 0 && _waiters.load() > 0) {
+                syscall(SYS_futex, &_state, FUTEX_WAKE_PRIVATE, _isAutoReset ? 1 : INT_MAX, NULL, NULL, 0);
+            }
 #endif
         }
         else
         {
 #ifdef _WIN32
             ResetEvent(_event);
-#else
+#elif defined(_MACOS)
             pthread_mutex_lock(&_cond_locker);
             _is_signalled = false;
             pthread_mutex_unlock(&_cond_locker);
+#else
+            _state.store(0);
 #endif
         }
     }
     
     unsigned long wait( unsigned long timeout = 0xFFFFFFFF )
+    {
+        if (timeout == 0xFFFFFFFF) return waitUntil(0);
+        return waitUntil(getus() + (_u64)timeout * 1000);
+    }
+
+    // wait with a relative timeout in microseconds
+    unsigned long waitUs( _u64 timeoutUs )
+    {
+        return waitUntil(getus() + timeoutUs);
+    }
+
+    // wait until the absolute getus() deadline, 0 waits forever
+    unsigned long waitUntil( _u64 deadlineUs )
     {
 #ifdef _WIN32
-        switch (WaitForSingleObject(_event, timeout==0xFFFFFFF?INFINITE:(DWORD)timeout))
+        DWORD timeout = INFINITE;
+        if (deadlineUs) {
+            _u64 now = getus();
+            // round up, waking early would just make the caller wait again
+            timeout = (deadlineUs > now) ? (DWORD)((deadlineUs - now + 999) / 1000) : 0;
+        }
+        switch (WaitForSingleObject(_event, timeout))
         {
         case WAIT_FAILED:
             return EVENT_FAILED;
@@ -108,48 +147,33 @@ public:
             return EVENT_TIMEOUT;
         }
         return EVENT_OK;
-#else
+#elif defined(_MACOS)
         unsigned long ans = EVENT_OK;
         pthread_mutex_lock( &_cond_locker );
 
-        if ( !_is_signalled )
+        while ( !_is_signalled )
         {
-            
-                if (timeout == 0xFFFFFFFF){
-                    pthread_cond_wait(&_cond_var,&_cond_locker);
-                }else
-                {
-                    timespec wait_time;
-                    timeval now;
-                    gettimeofday(&now,NULL);
-
-                    wait_time.tv_sec = timeout/1000 + now.tv_sec;
-                    wait_time.tv_nsec = (timeout%1000)*1000000ULL + now.tv_usec*1000;
-                
-                    if (wait_time.tv_nsec >= 1000000000)
-                    {
-                       ++wait_time.tv_sec;
-                       wait_time.tv_nsec -= 1000000000;
-                    }
-                    switch (pthread_cond_timedwait(&_cond_var,&_cond_locker,&wait_time))
-                    {
-                    case 0:
-                        // signalled
-                        break;
-                    case ETIMEDOUT:
-                        // time up
-                        ans = EVENT_TIMEOUT;
-                        goto _final;
-                        break;
-                    default:
-                        ans = EVENT_FAILED;
-                        goto _final;
-                    }
-       
+            if (!deadlineUs) {
+                pthread_cond_wait(&_cond_var,&_cond_locker);
+                continue;
+            }
+
+            // the relative wait is immune to clock steps
+            _u64 now = getus();
+            if (now >= deadlineUs) {
+                ans = EVENT_TIMEOUT;
+                goto _final;
+            }
+            timespec wait_time;
+            wait_time.tv_sec = (deadlineUs - now) / 1000000;
+            wait_time.tv_nsec = ((deadlineUs - now) % 1000000) * 1000;
+
+            int ret = pthread_cond_timedwait_relative_np(&_cond_var, &_cond_locker, &wait_time);
+            if (ret != 0 && ret != ETIMEDOUT) {
+                ans = EVENT_FAILED;
+                goto _final;
             }
         }
-          
-        assert(_is_signalled);
 
         if ( _isAutoReset )
         {
@@ -159,6 +183,33 @@ _final:
         pthread_mutex_unlock( &_cond_locker );
 
         return ans;
+#else
+        timespec wait_time;
+        if (deadlineUs) {
+            // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC time, the clock of getus()
+            wait_time.tv_sec = deadlineUs / 1000000;
+            wait_time.tv_nsec = (deadlineUs % 1000000) * 1000;
+        }
+
+        for (;;) {
+            if (_isAutoReset) {
+                int expected = 1;
+                if (_state.compare_exchange_strong(expected, 0)) return EVENT_OK;
+            } else if (_state.load() == 1) {
+                return EVENT_OK;
+            }
+
+            if (deadlineUs && getus() >= deadlineUs) return EVENT_TIMEOUT;
+
+            _waiters.fetch_add(1);
+            long ret = syscall(SYS_futex, &_state, FUTEX_WAIT_BITSET_PRIVATE, 0,
+                deadlineUs ? &wait_time : NULL, NULL, FUTEX_BITSET_MATCH_ANY);
+            int err = errno;
+            _waiters.fetch_sub(1);
+
+            // EAGAIN: set() came first, EINTR: a signal; both just look again
+            if (ret != 0 && err != ETIMEDOUT && err != EAGAIN && err != EINTR) return EVENT_FAILED;
+        }
 #endif
         
     }
@@ -168,7 +219,7 @@ protected:
     {
 #ifdef _WIN32
         CloseHandle(_event);
-#else
+#elif defined(_MACOS)
         pthread_mutex_destroy(&_cond_locker);
         pthread_cond_destroy(&_cond_var);
 #endif
@@ -176,11 +227,15 @@ protected:
 
 #ifdef _WIN32
         HANDLE _event;
-#else
+#elif defined(_MACOS)
         pthread_cond_t         _cond_var;
         pthread_mutex_t        _cond_locker;
         bool                   _is_signalled;
         bool                   _isAutoReset;
+#else
+        std::atomic<int>       _state;      // 1 when signalled, the futex word
+        std::atomic<int>       _waiters;
+        bool                   _isAutoReset;
 #endif
 };
 }}
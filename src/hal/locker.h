@@ -60,7 +60,7 @@ public:
     Locker::LOCK_STATUS lock(unsigned long timeout = 0xFFFFFFFF)
     {
 #ifdef _WIN32
-        switch (WaitForSingleObject(_lock, timeout==0xFFFFFFF?INFINITE:(DWORD)timeout))
+        switch (WaitForSingleObject(_lock, timeout==0xFFFFFFFF?INFINITE:(DWORD)timeout))
         {
         case WAIT_ABANDONED:
             return LOCK_FAILED;
@@ -87,25 +87,7 @@ public:
 #ifndef _MACOS
         else
         {
-            timespec wait_time;
-            timeval now;
-            gettimeofday(&now,NULL);
-
-            wait_time.tv_sec = timeout/1000 + now.tv_sec;
-            wait_time.tv_nsec = (timeout%1000)*1000000 + now.tv_usec*1000;
-        
-            if (wait_time.tv_nsec >= 1000000000)
-            {
-               ++wait_time.tv_sec;
-               wait_time.tv_nsec -= 1000000000;
-            }
-            switch (pthread_mutex_timedlock(&_lock,&wait_time))
-            {
-            case 0:
-                return LOCK_OK;
-            case ETIMEDOUT:
-                return LOCK_TIMEOUT;
-            }
+            return lockUntil(getus() + (_u64)timeout * 1000);
         }
 #endif
 #endif
@@ -113,6 +95,45 @@ public:
         return LOCK_FAILED;
     }
 
+    // lock with an absolute getus() deadline, microsecond precision
+    Locker::LOCK_STATUS lockUntil(_u64 deadlineUs)
+    {
+#if defined(_WIN32) || defined(_MACOS)
+        _u64 now = getus();
+        return lock((deadlineUs > now) ? (unsigned long)((deadlineUs - now + 999) / 1000) : 0);
+#else
+        timespec wait_time;
+        int ret;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+        // getus() runs on CLOCK_MONOTONIC, wall clock steps don't move the deadline
+        wait_time.tv_sec = deadlineUs / 1000000;
+        wait_time.tv_nsec = (deadlineUs % 1000000) * 1000;
+        ret = pthread_mutex_clocklock(&_lock, CLOCK_MONOTONIC, &wait_time);
+#else
+        // older libcs only time out on the wall clock, translate the remaining time just before waiting
+        _u64 now = getus();
+        _u64 remain = (deadlineUs > now) ? (deadlineUs - now) : 0;
+        clock_gettime(CLOCK_REALTIME, &wait_time);
+        wait_time.tv_sec += remain / 1000000;
+        wait_time.tv_nsec += (remain % 1000000) * 1000;
+        if (wait_time.tv_nsec >= 1000000000)
+        {
+           ++wait_time.tv_sec;
+           wait_time.tv_nsec -= 1000000000;
+        }
+        ret = pthread_mutex_timedlock(&_lock,&wait_time);
+#endif
+        switch (ret)
+        {
+        case 0:
+            return LOCK_OK;
+        case ETIMEDOUT:
+            return LOCK_TIMEOUT;
+        }
+        return LOCK_FAILED;
+#endif
+    }
+
 
     void unlock()
     {
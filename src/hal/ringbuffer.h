@@ -0,0 +1,155 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include "hal/types.h"
+#include <atomic>
+
+namespace rp{ namespace hal{
+
+// Lock free byte ring for exactly one producer thread and one consumer thread.
+class RingBuffer
+{
+public:
+    RingBuffer(size_t capacity)
+        : _head(0)
+        , _tail(0)
+    {
+        // round up to a power of two so positions wrap with a mask
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        _buffer = new _u8[size];
+        _mask = size - 1;
+    }
+
+    ~RingBuffer()
+    {
+        delete [] _buffer;
+    }
+
+    size_t capacity() const
+    {
+        return _mask + 1;
+    }
+
+    // bytes ready to be read, only exact when called by the consumer
+    size_t size() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    }
+
+    // bytes that can be written, only exact when called by the producer
+    size_t space() const
+    {
+        return capacity() - (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire));
+    }
+
+    // producer side, returns the number of bytes actually stored
+    size_t write(const _u8 * data, size_t size)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t free = capacity() - (head - _tail.load(std::memory_order_acquire));
+        if (size > free) size = free;
+
+        size_t offset = head & _mask;
+        size_t first = capacity() - offset;
+        if (first > size) first = size;
+        memcpy(_buffer + offset, data, first);
+        memcpy(_buffer, data + first, size - first);
+
+        _head.store(head + size, std::memory_order_release);
+        return size;
+    }
+
+    // producer side, the contiguous free block at the head, so data can be received in place
+    size_t writeBlock(_u8 ** block)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t free = capacity() - (head - _tail.load(std::memory_order_acquire));
+        size_t offset = head & _mask;
+        size_t first = capacity() - offset;
+
+        *block = _buffer + offset;
+        return first < free ? first : free;
+    }
+
+    // producer side, publishes size bytes stored into the block returned by writeBlock()
+    void commitWrite(size_t size)
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    // consumer side, returns the number of bytes actually taken
+    size_t read(_u8 * data, size_t size)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t avail = _head.load(std::memory_order_acquire) - tail;
+        if (size > avail) size = avail;
+
+        size_t offset = tail & _mask;
+        size_t first = capacity() - offset;
+        if (first > size) first = size;
+        memcpy(data, _buffer + offset, first);
+        memcpy(data + first, _buffer, size - first);
+
+        _tail.store(tail + size, std::memory_order_release);
+        return size;
+    }
+
+    // only safe while neither side is running
+    void clear()
+    {
+        _head.store(0);
+        _tail.store(0);
+    }
+
+    // touch every page of the storage so neither side takes a page fault later
+    void prefault()
+    {
+        memset(_buffer, 0, capacity());
+    }
+
+protected:
+    _u8 *               _buffer;
+    size_t              _mask;
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+
+private:
+    RingBuffer(const RingBuffer &);
+    RingBuffer & operator=(const RingBuffer &);
+};
+
+}}
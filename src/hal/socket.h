@@ -87,9 +87,14 @@ public:
     
     virtual u_result getLocalAddress(SocketAddress & ) = 0;
     virtual u_result setTimeout(_u32 timeout, socket_direction_mask msk = SOCKET_DIR_BOTH) = 0;
+    // SO_RCVBUF / SO_SNDBUF, the OS may round or clamp the size
+    virtual u_result setBufferSize(size_t size, socket_direction_mask msk = SOCKET_DIR_BOTH) = 0;
 
     virtual u_result waitforSent(_u32 timeout  = DEFAULT_SOCKET_TIMEOUT) = 0;
     virtual u_result waitforData(_u32 timeout  = DEFAULT_SOCKET_TIMEOUT)  = 0;
+
+    // the fd to wait on with epoll or io_uring, -1 where sockets are no fds
+    virtual int getNativeHandle() { return -1; }
 protected:
     SocketBase() {} 
 };
@@ -114,6 +119,9 @@ public:
     virtual u_result send(const void * buffer, size_t len) = 0;
     
     virtual u_result recv(void *buf, size_t len, size_t & recv_len) = 0;
+
+    // returns immediately with whatever is queued (recv_len may be 0), fails once the peer has closed
+    virtual u_result recvNoWait(void *buf, size_t len, size_t & recv_len) = 0;
     
     virtual u_result getPeerAddress(SocketAddress & ) = 0;
 
@@ -132,6 +140,9 @@ class _single_thread DGramSocket: public SocketBase
 {
 
 public:
+    enum {
+        MAX_RECV_BATCH = 64,
+    };
 
     static DGramSocket * CreateSocket(socket_family_t family = SOCKET_FAMILY_INET);
         
@@ -141,6 +152,18 @@ public:
    
     virtual u_result recvFrom(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr = NULL) = 0;
 
+    // connects the socket to one peer: send() goes there and datagrams from any other sender are
+    // dropped by the OS. NULL dissolves the association
+    virtual u_result setPairAddress(const SocketAddress * pairAddress) = 0;
+
+    // sends to the address set by setPairAddress()
+    virtual u_result send(const void * buffer, size_t len) = 0;
+
+    // receives up to count (at most MAX_RECV_BATCH) queued datagrams without waiting, recvmmsg() on Linux.
+    // datagram i is stored at buffers + i * bufferSize and its size in recv_lens[i], a datagram longer
+    // than bufferSize is dropped and reported with size 0. recv_count is 0 when nothing is queued
+    virtual u_result recvBatchNoWait(_u8 * buffers, size_t bufferSize, size_t count, size_t * recv_lens, size_t & recv_count) = 0;
+
     
 protected:
     virtual ~DGramSocket() {} // use dispose();
@@ -75,6 +75,13 @@ public:
 	u_result setPriority( priority_val_t p);
 	priority_val_t getPriority();
 
+    // calling-thread controls used by the real-time acquisition profile
+    // priority 0 restores the default time-sharing policy
+    static u_result setCurrentRealtime(int priority);
+    // cpuMask 0 allows any cpu
+    static u_result setCurrentAffinity(_u64 cpuMask);
+    static u_result lockMemory();
+
     bool operator== ( const Thread & right) { return this->_handle == right._handle; }
 protected:
     Thread( thread_proc_t proc, void * data ): _data(data),_func(proc), _handle(0)  {}
@@ -41,11 +41,16 @@
 #include "hal/locker.h"
 #include "hal/socket.h"
 #include "hal/event.h"
+#include "hal/ringbuffer.h"
+#include "rplidar_profile.h"
 #include "rplidar_driver_impl.h"
 #include "rplidar_driver_serial.h"
 #include "rplidar_driver_TCP.h"
+#include "rplidar_driver_UDP.h"
+#include "rplidar_reactor.h"
 
 #include <algorithm>
+#include <math.h>
 
 #ifndef min
 #define min(a,b)            (((a) < (b)) ? (a) : (b))
@@ -66,6 +71,12 @@ namespace rp { namespace standalone{ namespace rplidar {
         fprintf(stderr, "*WARN* YOU ARE USING DEPRECATED API: %s, PLEASE MOVE TO %s\n", fn, replacement);
     }
 
+// motor speed regulation gains, pwm per Hz of error and pwm per Hz of error per second
+static const float MOTOR_CTRL_KP = 15.0f;
+static const float MOTOR_CTRL_KI = 30.0f;
+// relative deviation of a revolution from the average, and of the average from the target, for a ready motor
+static const float MOTOR_READY_TOLERANCE = 0.03f;
+
 static void convert(const rplidar_response_measurement_node_t& from, rplidar_response_measurement_node_hq_t& to)
 {
     to.angle_z_q14 = (((from.angle_q6_checkbit) >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) << 8) / 90;  //transfer to q14 Z-angle
@@ -81,6 +92,12 @@ static void convert(const rplidar_response_measurement_node_hq_t& from, rplidar_
     to.distance_q2 = from.dist_mm_q2 > _u16(-1) ? _u16(0) : _u16(from.dist_mm_q2);
 }
 
+// the channels wait in ms, round up so they don't return before the deadline
+static _u32 _msUntil(_u64 deadline, _u64 now)
+{
+    return now >= deadline ? 0 : (_u32)((deadline - now + 999) / 1000);
+}
+
 // Factory Impl
 RPlidarDriver * RPlidarDriver::CreateDriver(_u32 drivertype)
 {
@@ -89,6 +106,8 @@ RPlidarDriver * RPlidarDriver::CreateDriver(_u32 drivertype)
         return new RPlidarDriverSerial();
     case DRIVER_TYPE_TCP:
          return new RPlidarDriverTCP();
+    case DRIVER_TYPE_UDP:
+         return new RPlidarDriverUDP();
     default:
         return NULL;
     }
@@ -105,9 +124,43 @@ RPlidarDriverImplCommon::RPlidarDriverImplCommon()
     : _isConnected(false)
     , _isScanning(false)
     , _isSupportingMotorCtrl(false)
+    , _isPipelined(false)
+    , _scan_ring(SCAN_RING_BUFFER_SIZE)
+    , _motor_ready_evt(false)
 {
     _cached_scan_node_hq_count = 0;
     _cached_scan_node_hq_count_for_interval_retrieve = 0;
+    _local_scan_count = 0;
+    _local_scan_synced = false;
+    _scan_filter_enabled = false;
+    _reactor = NULL;
+    _scan_requests = NULL;
+    _sector_requests = NULL;
+    _command_requests = NULL;
+    _async_running = false;
+    _scan_ans_type = 0;
+    _scan_frame_pos = 0;
+    _capsule_step_q8 = 0;
+    _capsule_late_count = 0;
+    _last_sync_us = 0;
+    _sync_outliers = 0;
+    _measured_frequency.store(0);
+    _target_frequency = 0;
+    _motor_ctrl_running = false;
+    _motor_ctrl_output = 0;
+    _motor_ctrl_error = 0;
+    _motor_pwm = 0;
+    _motor_on = false;
+    _motor_spinup_us = 0;
+    _stable_revolutions = 0;
+    _motor_ready.store(false);
+    _rt_enabled = false;
+    memset(&_rt_profile, 0, sizeof(_rt_profile));
+    _devinfo_valid = false;
+    memset(&_devinfo, 0, sizeof(_devinfo));
+    _profile_valid = false;
+    _profile_from_cache = false;
+    resetStats();
     _cached_sampleduration_std = LEGACY_SAMPLE_DURATION;
     _cached_sampleduration_express = LEGACY_SAMPLE_DURATION;
 }
@@ -145,16 +198,16 @@ u_result RPlidarDriverImplCommon::clearNetSerialRxCache()
 u_result RPlidarDriverImplCommon::_waitResponseHeader(rplidar_ans_header_t * header, _u32 timeout)
 {
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 deadline = getus() + (_u64)timeout * 1000;
     _u8  recvBuffer[sizeof(rplidar_ans_header_t)];
     _u8  *headerBuffer = reinterpret_cast<_u8 *>(header);
-    _u32 waitTime;
+    _u64 now;
 
-    while ((waitTime=getms() - startTs) <= timeout) {
+    while ((now = getus()) <= deadline) {
         size_t remainSize = sizeof(rplidar_ans_header_t) - recvPos;
         size_t recvSize;
         
-        bool ans = _chanDev->waitfordata(remainSize, timeout - waitTime, &recvSize);
+        bool ans = _chanDev->waitfordata(remainSize, _msUntil(deadline, now), &recvSize);
         if(!ans) return RESULT_OPERATION_TIMEOUT;
         
         if(recvSize > remainSize) recvSize = remainSize;
@@ -196,7 +249,7 @@ u_result RPlidarDriverImplCommon::getHealth(rplidar_response_device_health_t & h
     
     if (!isConnected()) return RESULT_OPERATION_FAIL;
     
-    _disableDataGrabbing();
+    if (IS_FAIL(ans = _disableDataGrabbing())) return ans;
 
     {
         rp::hal::AutoLocker l(_lock);
@@ -236,7 +289,7 @@ u_result RPlidarDriverImplCommon::getDeviceInfo(rplidar_response_device_info_t &
     
     if (!isConnected()) return RESULT_OPERATION_FAIL;
 
-    _disableDataGrabbing();
+    if (IS_FAIL(ans = _disableDataGrabbing())) return ans;
 
     {
         rp::hal::AutoLocker l(_lock);
@@ -264,6 +317,8 @@ u_result RPlidarDriverImplCommon::getDeviceInfo(rplidar_response_device_info_t &
             return RESULT_OPERATION_TIMEOUT;
         }
         _chanDev->recvdata(reinterpret_cast<_u8 *>(&info), sizeof(info));
+        _devinfo = info;
+        _devinfo_valid = true;
     }
     return RESULT_OK;
 }
@@ -291,24 +346,43 @@ u_result RPlidarDriverImplCommon::getFrequency(const RplidarScanMode& scanMode,
     return RESULT_OK;
 }
 
+u_result RPlidarDriverImplCommon::getMeasuredFrequency(float & frequency)
+{
+    frequency = _measured_frequency.load(std::memory_order_relaxed);
+    return (frequency > 0) ? RESULT_OK : RESULT_OPERATION_TIMEOUT;
+}
+
+u_result RPlidarDriverImplCommon::setTargetFrequency(float frequency)
+{
+    if (frequency > 0 && !_isSupportingMotorCtrl) return RESULT_OPERATION_NOT_SUPPORT;
+
+    rp::hal::AutoLocker l(_lock);
+    _target_frequency = frequency;
+    _motor_ctrl_running = false;
+    return RESULT_OK;
+}
+
 u_result RPlidarDriverImplCommon::_waitNode(rplidar_response_measurement_node_t * node, _u32 timeout)
 {
+    RPLIDAR_TRACE_SCOPE("_waitNode");
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 deadline = getus() + (_u64)timeout * 1000;
     _u8  recvBuffer[sizeof(rplidar_response_measurement_node_t)];
     _u8 *nodeBuffer = (_u8*)node;
-    _u32 waitTime;
+    _u64 now;
 
-   while ((waitTime=getms() - startTs) <= timeout) {
+   while ((now = getus()) <= deadline) {
         size_t remainSize = sizeof(rplidar_response_measurement_node_t) - recvPos;
         size_t recvSize;
 
-        bool ans = _chanDev->waitfordata(remainSize, timeout-waitTime, &recvSize);
+        bool ans = _chanDev->waitfordata(remainSize, _msUntil(deadline, now), &recvSize);
         if(!ans) return RESULT_OPERATION_FAIL;
 
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        _stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+        _countRecv(recvSize, recvSize);
 
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -319,6 +393,7 @@ u_result RPlidarDriverImplCommon::_waitNode(rplidar_response_measurement_node_t
                     if ( (tmp ^ currentByte) & 0x1 ) {
                         // pass
                     } else {
+                        _stats.resync_bytes.fetch_add(1, std::memory_order_relaxed);
                         continue;
                     }
 
@@ -329,6 +404,8 @@ u_result RPlidarDriverImplCommon::_waitNode(rplidar_response_measurement_node_t
                     if (currentByte & RPLIDAR_RESP_MEASUREMENT_CHECKBIT) {
                         // pass
                     } else {
+                        // the first byte of the frame goes with it
+                        _stats.resync_bytes.fetch_add(2, std::memory_order_relaxed);
                         recvPos = 0;
                         continue;
                     }
@@ -354,13 +431,13 @@ u_result RPlidarDriverImplCommon::_waitScanData(rplidar_response_measurement_nod
     }
 
     size_t   recvNodeCount =  0;
-    _u32     startTs = getms();
-    _u32     waitTime;
+    _u64     deadline = getus() + (_u64)timeout * 1000;
+    _u64     now;
     u_result ans;
 
-    while ((waitTime = getms() - startTs) <= timeout && recvNodeCount < count) {
+    while ((now = getus()) <= deadline && recvNodeCount < count) {
         rplidar_response_measurement_node_t node;
-        if (IS_FAIL(ans = _waitNode(&node, timeout - waitTime))) {
+        if (IS_FAIL(ans = _waitNode(&node, _msUntil(deadline, now)))) {
             return ans;
         }
         
@@ -375,18 +452,19 @@ u_result RPlidarDriverImplCommon::_waitScanData(rplidar_response_measurement_nod
 
 u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_measurement_nodes_t & node, _u32 timeout)
 {
+    RPLIDAR_TRACE_SCOPE("_waitCapsuledNode");
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 deadline = getus() + (_u64)timeout * 1000;
     _u8  recvBuffer[sizeof(rplidar_response_capsule_measurement_nodes_t)];
     _u8 *nodeBuffer = (_u8*)&node;
-    _u32 waitTime;
+    _u64 now;
 
 
-   while ((waitTime=getms() - startTs) <= timeout) {
+   while ((now = getus()) <= deadline) {
         size_t remainSize = sizeof(rplidar_response_capsule_measurement_nodes_t) - recvPos;
         size_t recvSize;
 
-        bool ans = _chanDev->waitfordata(remainSize, timeout-waitTime, &recvSize);
+        bool ans = _chanDev->waitfordata(remainSize, _msUntil(deadline, now), &recvSize);
         if(!ans)
         {
             return RESULT_OPERATION_TIMEOUT;
@@ -394,6 +472,8 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        _stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+        _countRecv(recvSize, recvSize);
         
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -406,6 +486,7 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
                         // pass
                     } else {
                         _is_previous_capsuledataRdy = false;
+                        _stats.resync_bytes.fetch_add(1, std::memory_order_relaxed);
                         continue;
                     }
 
@@ -419,6 +500,7 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
                     } else {
                         recvPos = 0;
                         _is_previous_capsuledataRdy = false;
+                        _stats.resync_bytes.fetch_add(2, std::memory_order_relaxed);
                         continue;
                     }
                 }
@@ -446,6 +528,7 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
                     return RESULT_OK;
                 }
                 _is_previous_capsuledataRdy = false;
+                _stats.checksum_failures.fetch_add(1, std::memory_order_relaxed);
                 return RESULT_INVALID_DATA;
             }
         }
@@ -456,21 +539,22 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
 
 u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_capsule_measurement_nodes_t & node, _u32 timeout)
 {
+    RPLIDAR_TRACE_SCOPE("_waitUltraCapsuledNode");
     if (!_isConnected) {
         return RESULT_OPERATION_FAIL;
     }
     
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 deadline = getus() + (_u64)timeout * 1000;
     _u8  recvBuffer[sizeof(rplidar_response_ultra_capsule_measurement_nodes_t)];
     _u8 *nodeBuffer = (_u8*)&node;
-    _u32 waitTime;
+    _u64 now;
     
-    while ((waitTime=getms() - startTs) <= timeout) {
+    while ((now = getus()) <= deadline) {
         size_t remainSize = sizeof(rplidar_response_ultra_capsule_measurement_nodes_t) - recvPos;
         size_t recvSize;
 
-        bool ans = _chanDev->waitfordata(remainSize, timeout-waitTime, &recvSize);
+        bool ans = _chanDev->waitfordata(remainSize, _msUntil(deadline, now), &recvSize);
         if(!ans)
         {
             return RESULT_OPERATION_TIMEOUT;
@@ -478,6 +562,8 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        _stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+        _countRecv(recvSize, recvSize);
         
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -490,6 +576,7 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
                     }
                     else {
                         _is_previous_capsuledataRdy = false;
+                        _stats.resync_bytes.fetch_add(1, std::memory_order_relaxed);
                         continue;
                     }
                 }    
@@ -503,6 +590,7 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
                 else {
                     recvPos = 0;
                     _is_previous_capsuledataRdy = false;
+                    _stats.resync_bytes.fetch_add(2, std::memory_order_relaxed);
                     continue;
                 }
             }
@@ -532,6 +620,7 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
                     return RESULT_OK;
                 }
                 _is_previous_capsuledataRdy = false;
+                _stats.checksum_failures.fetch_add(1, std::memory_order_relaxed);
                 return RESULT_INVALID_DATA;
             }
         }
@@ -540,14 +629,153 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
     return RESULT_OPERATION_TIMEOUT;
 }
 
+bool RPlidarDriverImplCommon::_isNodeInScanFilter(const rplidar_response_measurement_node_hq_t & node) const
+{
+    if (!node.dist_mm_q2) return false;
+    if (node.quality < _scan_filter_min_quality) return false;
+    if (node.dist_mm_q2 < _scan_filter_min_dist_q2 || node.dist_mm_q2 > _scan_filter_max_dist_q2) return false;
+    return _scan_filter_angle_mask[node.angle_z_q14 >> SCAN_FILTER_ANGLE_SHIFT] != 0;
+}
+
+void RPlidarDriverImplCommon::_cacheScanNodes(const rplidar_response_measurement_node_hq_t * nodebuffer, size_t count)
+{
+    size_t zeroDistNodes = 0;
+    bool   pwmChanged = false;
+    _u16   pwm = 0;
+    RplidarAsyncRequest * done = NULL;
+
+    {
+        RPLIDAR_TRACE_BEGIN("_cacheScanNodes.lock");
+        rp::hal::AutoLocker l(_lock);
+        RPLIDAR_TRACE_END("_cacheScanNodes.lock");
+        RPLIDAR_TRACE_SCOPE("_cacheScanNodes");
+        size_t sectorStart = _local_scan_count;
+
+        for (size_t pos = 0; pos < count; ++pos)
+        {
+            const rplidar_response_measurement_node_hq_t & node = nodebuffer[pos];
+            zeroDistNodes += (node.dist_mm_q2 == 0);
+
+            if (node.flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
+            {
+                float period = _measureRevolution(getus());
+                if (period > 0 && _regulateMotorSpeed(period, pwm)) pwmChanged = true;
+
+                // only publish the data when it contains a full 360 degree scan 
+                if (_local_scan_synced) {
+                    RPLIDAR_TRACE_SCOPE("publishScan");
+                    // nobody grabbed the previous revolution
+                    if (_cached_scan_node_hq_count) _stats.scans_dropped.fetch_add(1, std::memory_order_relaxed);
+                    _stats.scans_published.fetch_add(1, std::memory_order_relaxed);
+
+                    memcpy(_cached_scan_node_hq_buf, _local_scan_buf, _local_scan_count*sizeof(rplidar_response_measurement_node_hq_t));
+                    _cached_scan_node_hq_count = _local_scan_count;
+                    _dataEvt.set();
+                    _fillAsyncRequests(_scan_requests, _local_scan_buf, _local_scan_count, done);
+                }
+                // the end of the revolution closes the sector
+                if (_local_scan_count > sectorStart) _fillAsyncRequests(_sector_requests, _local_scan_buf + sectorStart, _local_scan_count - sectorStart, done);
+                _local_scan_count = 0;
+                _local_scan_synced = true;
+                sectorStart = 0;
+            }
+
+            // drop the node before it is copied anywhere if it falls outside the region of interest
+            if (_scan_filter_enabled && !_isNodeInScanFilter(node)) continue;
+
+            _local_scan_buf[_local_scan_count++] = node;
+            if (_local_scan_count == _countof(_local_scan_buf)) _local_scan_count-=1; // prevent overflow
+
+            //for interval retrieve
+            _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = node;
+            if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) {
+                _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
+                _stats.interval_overflows.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (_cached_scan_node_hq_count_for_interval_retrieve) _interval_evt.set();
+        if (_local_scan_count > sectorStart) _fillAsyncRequests(_sector_requests, _local_scan_buf + sectorStart, _local_scan_count - sectorStart, done);
+    }
+
+    // the callbacks may well ask for the next scan or grab one
+    _completeAsyncRequests(done, RESULT_OK);
+
+    if (zeroDistNodes) _stats.zero_distance_nodes.fetch_add(zeroDistNodes, std::memory_order_relaxed);
+
+    // setMotorPWM() takes the lock itself, the scan data is not held up by the command
+    if (pwmChanged) setMotorPWM(pwm);
+}
+
+float RPlidarDriverImplCommon::_measureRevolution(_u64 now)
+{
+    _u64 last = _last_sync_us;
+    _last_sync_us = now;
+    if (!last || now <= last) return 0;
+
+    float period = (float)(now - last) / 1000000.0f;
+    float frequency = _measured_frequency.load(std::memory_order_relaxed);
+
+    // a sync node lost to a bad frame makes one period look twice as long,
+    // only believe it when it keeps happening
+    if (frequency > 0 && period * frequency > 1.8f && ++_sync_outliers < 3) {
+        _stable_revolutions = 0;
+        _setMotorReady(false);
+        return 0;
+    }
+    _sync_outliers = 0;
+
+    // the motor is ready when a few revolutions in a row agree with the average
+    bool stable = frequency > 0 && fabsf(1.0f / period - frequency) < frequency * MOTOR_READY_TOLERANCE;
+
+    frequency = (frequency > 0) ? frequency + (1.0f / period - frequency) * 0.2f : 1.0f / period;
+    _measured_frequency.store(frequency, std::memory_order_relaxed);
+
+    if (stable && _target_frequency > 0 && _isSupportingMotorCtrl) {
+        stable = fabsf(frequency - _target_frequency) < _target_frequency * MOTOR_READY_TOLERANCE;
+    }
+    _stable_revolutions = stable ? _stable_revolutions + 1 : 0;
+    _setMotorReady(_stable_revolutions >= MOTOR_STABLE_REVOLUTIONS);
+    return period;
+}
+
+void RPlidarDriverImplCommon::_setMotorReady(bool ready)
+{
+    if (_motor_ready.exchange(ready) != ready) _motor_ready_evt.set(ready);
+}
+
+bool RPlidarDriverImplCommon::_regulateMotorSpeed(float period, _u16 & pwm)
+{
+    if (_target_frequency <= 0 || !_isSupportingMotorCtrl) return false;
+
+    float error = _target_frequency - _measured_frequency.load(std::memory_order_relaxed);
+    if (!_motor_ctrl_running) {
+        // start from whatever pwm the motor runs at now
+        _motor_ctrl_output = _motor_pwm;
+        _motor_ctrl_error = error;
+        _motor_ctrl_running = true;
+    }
+
+    // incremental PI: the output keeps the integral, clamping it is the anti-windup
+    _motor_ctrl_output += MOTOR_CTRL_KP * (error - _motor_ctrl_error) + MOTOR_CTRL_KI * error * period;
+    _motor_ctrl_error = error;
+    if (_motor_ctrl_output < 0) _motor_ctrl_output = 0;
+    if (_motor_ctrl_output > MAX_MOTOR_PWM) _motor_ctrl_output = MAX_MOTOR_PWM;
+
+    pwm = (_u16)(_motor_ctrl_output + 0.5f);
+    return pwm != _motor_pwm;
+}
+
 u_result RPlidarDriverImplCommon::_cacheScanData()
 {
+    RPLIDAR_TRACE_THREAD("scan cache");
+    if (_rt_enabled) _applyRealtimeProfile(_rt_profile, _rt_profile.io_cpu_mask);
     rplidar_response_measurement_node_t      local_buf[128];
     size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
+    rplidar_response_measurement_node_hq_t   local_buf_hq[128];
     u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
+
+    _local_scan_count = 0;
+    _local_scan_synced = false;
 
     _waitScanData(local_buf, count); // // always discard the first data since it may be incomplete
 
@@ -556,38 +784,19 @@ u_result RPlidarDriverImplCommon::_cacheScanData()
         if (IS_FAIL(ans=_waitScanData(local_buf, count))) {
             if (ans != RESULT_OPERATION_TIMEOUT) {
                 _isScanning = false;
+                _abortScanRequests(RESULT_OPERATION_FAIL);
                 return RESULT_OPERATION_FAIL;
             }
         }
-        
+
+        _u64 decodeStart = getus();
+        _countFrames(count);
         for (size_t pos = 0; pos < count; ++pos)
         {
-            if (local_buf[pos].sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-                // only publish the data when it contains a full 360 degree scan 
-                
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
-                }
-                scan_count = 0;
-            }
-
-            rplidar_response_measurement_node_hq_t nodeHq;
-            convert(local_buf[pos], nodeHq);
-            local_scan[scan_count++] = nodeHq;
-            if (scan_count == _countof(local_scan)) scan_count-=1; // prevent overflow
-
-            //for interval retrieve
-            {
-                rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = nodeHq;
-                if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
-            }
+            convert(local_buf[pos], local_buf_hq[pos]);
         }
+        _cacheScanNodes(local_buf_hq, count);
+        _countDecodeTime(decodeStart);
     }
     _isScanning = false;
     return RESULT_OK;
@@ -624,10 +833,8 @@ u_result RPlidarDriverImplCommon::startScanNormal(bool force,  _u32 timeout)
             return RESULT_INVALID_DATA;
         }
 
-        _isScanning = true;
-        _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheScanData);
-        if (_cachethread.getHandle() == 0) {
-            return RESULT_OPERATION_FAIL;
+        if (IS_FAIL(ans = _startScanCaching(RPLIDAR_ANS_TYPE_MEASUREMENT))) {
+            return ans;
         }
     }
     return RESULT_OK;
@@ -657,13 +864,15 @@ u_result RPlidarDriverImplCommon::checkExpressScanSupported(bool & support, _u32
 
 u_result RPlidarDriverImplCommon::_cacheCapsuledScanData()
 {
+    RPLIDAR_TRACE_THREAD("scan cache");
+    if (_rt_enabled) _applyRealtimeProfile(_rt_profile, _rt_profile.io_cpu_mask);
     rplidar_response_capsule_measurement_nodes_t    capsule_node;
     rplidar_response_measurement_node_hq_t   local_buf[128];
     size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
     u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
+
+    _local_scan_count = 0;
+    _local_scan_synced = false;
 
     _waitCapsuledNode(capsule_node); // // always discard the first data since it may be incomplete
 
@@ -675,12 +884,15 @@ u_result RPlidarDriverImplCommon::_cacheCapsuledScanData()
         if (IS_FAIL(ans=_waitCapsuledNode(capsule_node))) {
             if (ans != RESULT_OPERATION_TIMEOUT && ans != RESULT_INVALID_DATA) {
                 _isScanning = false;
+                _abortScanRequests(RESULT_OPERATION_FAIL);
                 return RESULT_OPERATION_FAIL;
             } else {
                 // current data is invalid, do not use it.
                 continue;
             }
         }
+        _u64 decodeStart = getus();
+        _countFrames(1);
         switch (_cached_express_flag) 
         {
         case 0:
@@ -692,31 +904,8 @@ u_result RPlidarDriverImplCommon::_cacheCapsuledScanData()
         }
         //
         
-        for (size_t pos = 0; pos < count; ++pos)
-        {
-            if (local_buf[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-                // only publish the data when it contains a full 360 degree scan 
-                
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
-                }
-                scan_count = 0;
-            }
-            local_scan[scan_count++] = local_buf[pos];
-            if (scan_count == _countof(local_scan)) scan_count-=1; // prevent overflow
-
-            //for interval retrieve
-            {
-                rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
-            }
-        }
+        _cacheScanNodes(local_buf, count);
+        _countDecodeTime(decodeStart);
     }
     _isScanning = false;
 
@@ -725,13 +914,15 @@ u_result RPlidarDriverImplCommon::_cacheCapsuledScanData()
 
 u_result RPlidarDriverImplCommon::_cacheUltraCapsuledScanData()
 {
+    RPLIDAR_TRACE_THREAD("scan cache");
+    if (_rt_enabled) _applyRealtimeProfile(_rt_profile, _rt_profile.io_cpu_mask);
     rplidar_response_ultra_capsule_measurement_nodes_t    ultra_capsule_node;
     rplidar_response_measurement_node_hq_t   local_buf[128];
     size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
     u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
+
+    _local_scan_count = 0;
+    _local_scan_synced = false;
 
     _waitUltraCapsuledNode(ultra_capsule_node);
     
@@ -740,6 +931,7 @@ u_result RPlidarDriverImplCommon::_cacheUltraCapsuledScanData()
         if (IS_FAIL(ans=_waitUltraCapsuledNode(ultra_capsule_node))) {
             if (ans != RESULT_OPERATION_TIMEOUT && ans != RESULT_INVALID_DATA) {
                 _isScanning = false;
+                _abortScanRequests(RESULT_OPERATION_FAIL);
                 return RESULT_OPERATION_FAIL;
             } else {
                 // current data is invalid, do not use it.
@@ -747,33 +939,12 @@ u_result RPlidarDriverImplCommon::_cacheUltraCapsuledScanData()
             }
         }
         
+        _u64 decodeStart = getus();
+        _countFrames(1);
         _ultraCapsuleToNormal(ultra_capsule_node, local_buf, count);
         
-        for (size_t pos = 0; pos < count; ++pos)
-        {
-            if (local_buf[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-                // only publish the data when it contains a full 360 degree scan 
-                
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
-                }
-                scan_count = 0;
-            }
-            local_scan[scan_count++] = local_buf[pos];
-            if (scan_count == _countof(local_scan)) scan_count-=1; // prevent overflow
-
-            //for interval retrieve
-            {
-                rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
-            }
-        }
+        _cacheScanNodes(local_buf, count);
+        _countDecodeTime(decodeStart);
     }
     
     _isScanning = false;
@@ -781,9 +952,39 @@ u_result RPlidarDriverImplCommon::_cacheUltraCapsuledScanData()
     return RESULT_OK;
 }
 
+// A capsule's nodes are spread between its start angle and the next capsule's. Frames that got lost
+// or reordered on the way (datagram channels) would spread them over the wrong span, so a capsule
+// behind its predecessor is dropped (false), and a jump larger than the usual step restarts the
+// interpolation from the current capsule. A late capsule can't be told apart from a jump of more
+// than half a turn, so only a few are dropped in a row.
+bool RPlidarDriverImplCommon::_checkCapsuleContinuity(_u16 currentStartAngle_q6, _u16 prevStartAngle_q6)
+{
+    int diffAngle_q8 = ((currentStartAngle_q6 & 0x7FFF) << 2) - ((prevStartAngle_q6 & 0x7FFF) << 2);
+    if (diffAngle_q8 < 0) diffAngle_q8 += (360<<8);
+
+    if (diffAngle_q8 > (180<<8) && _capsule_late_count < MAX_LATE_CAPSULES) {
+        ++_capsule_late_count;
+        _stats.capsules_reordered.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _capsule_late_count = 0;
+
+    if (_capsule_step_q8 && diffAngle_q8 > _capsule_step_q8 + _capsule_step_q8 / 2) {
+        _is_previous_capsuledataRdy = false;
+        _stats.capsule_gaps.fetch_add(1, std::memory_order_relaxed);
+    }
+    // a real change of speed costs one capsule, the next step is measured from this one
+    _capsule_step_q8 = diffAngle_q8;
+    return true;
+}
+
 void     RPlidarDriverImplCommon::_capsuleToNormal(const rplidar_response_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
 {
+    RPLIDAR_TRACE_SCOPE("_capsuleToNormal");
     nodeCount = 0;
+    if (_is_previous_capsuledataRdy && !_checkCapsuleContinuity(capsule.start_angle_sync_q6, _cached_previous_capsuledata.start_angle_sync_q6)) {
+        return;
+    }
     if (_is_previous_capsuledataRdy) {
         int diffAngle_q8;
         int currentStartAngle_q8 = ((capsule.start_angle_sync_q6 & 0x7FFF)<< 2);
@@ -841,8 +1042,12 @@ void     RPlidarDriverImplCommon::_capsuleToNormal(const rplidar_response_capsul
 
 void     RPlidarDriverImplCommon::_dense_capsuleToNormal(const rplidar_response_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
 {
+    RPLIDAR_TRACE_SCOPE("_dense_capsuleToNormal");
     const rplidar_response_dense_capsule_measurement_nodes_t *dense_capsule = reinterpret_cast<const rplidar_response_dense_capsule_measurement_nodes_t*>(&capsule);
     nodeCount = 0;
+    if (_is_previous_capsuledataRdy && !_checkCapsuleContinuity(dense_capsule->start_angle_sync_q6, _cached_previous_dense_capsuledata.start_angle_sync_q6)) {
+        return;
+    }
     if (_is_previous_capsuledataRdy) {
         int diffAngle_q8;
         int currentStartAngle_q8 = ((dense_capsule->start_angle_sync_q6 & 0x7FFF) << 2);
@@ -890,18 +1095,22 @@ void     RPlidarDriverImplCommon::_dense_capsuleToNormal(const rplidar_response_
 
 u_result RPlidarDriverImplCommon::_cacheHqScanData()
 {
+    RPLIDAR_TRACE_THREAD("scan cache");
+    if (_rt_enabled) _applyRealtimeProfile(_rt_profile, _rt_profile.io_cpu_mask);
     rplidar_response_hq_capsule_measurement_nodes_t    hq_node;
     rplidar_response_measurement_node_hq_t   local_buf[128];
     size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
     u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
+
+    _local_scan_count = 0;
+    _local_scan_synced = false;
+
     _waitHqNode(hq_node);
     while (_isScanning) {
         if (IS_FAIL(ans = _waitHqNode(hq_node))) {
             if (ans != RESULT_OPERATION_TIMEOUT && ans != RESULT_INVALID_DATA) {
                 _isScanning = false;
+                _abortScanRequests(RESULT_OPERATION_FAIL);
                 return RESULT_OPERATION_FAIL;
             }
             else {
@@ -910,30 +1119,11 @@ u_result RPlidarDriverImplCommon::_cacheHqScanData()
             }
         }
 
+        _u64 decodeStart = getus();
+        _countFrames(1);
         _HqToNormal(hq_node, local_buf, count);
-        for (size_t pos = 0; pos < count; ++pos)
-        {
-            if (local_buf[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-				// only publish the data when it contains a full 360 degree scan 
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count * sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
-                }
-                scan_count = 0;
-            }
-            local_scan[scan_count++] = local_buf[pos];
-            if (scan_count == _countof(local_scan)) scan_count -= 1; // prevent overflow
-																	 //for interval retrieve
-            {
-                rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                if (_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve -= 1; // prevent overflow
-            }
-        }
+        _cacheScanNodes(local_buf, count);
+        _countDecodeTime(decodeStart);
 
     }
     return RESULT_OK;
@@ -1000,7 +1190,7 @@ static _u32 _crc32cal(_u32 crc, void* input, _u16 len)
 }
 
 //crc32cal
-static u_result _crc32(_u8 *ptr, _u32 len) {
+_u32 _crc32(_u8 *ptr, _u32 len) {
 	static _u8 tmp;
 	if (tmp != 1) {
 		_crc32_init(0x4C11DB7);
@@ -1012,21 +1202,22 @@ static u_result _crc32(_u8 *ptr, _u32 len) {
 
 u_result RPlidarDriverImplCommon::_waitHqNode(rplidar_response_hq_capsule_measurement_nodes_t & node, _u32 timeout)
 {
+    RPLIDAR_TRACE_SCOPE("_waitHqNode");
     if (!_isConnected) {
         return RESULT_OPERATION_FAIL;
     }
 
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 deadline = getus() + (_u64)timeout * 1000;
     _u8  recvBuffer[sizeof(rplidar_response_hq_capsule_measurement_nodes_t)];
     _u8 *nodeBuffer = (_u8*)&node;
-    _u32 waitTime;
+    _u64 now;
     
-    while ((waitTime=getms() - startTs) <= timeout) {
+    while ((now = getus()) <= deadline) {
         size_t remainSize = sizeof(rplidar_response_hq_capsule_measurement_nodes_t) - recvPos;
         size_t recvSize;
         
-        bool ans = _chanDev->waitfordata(remainSize, timeout-waitTime, &recvSize);
+        bool ans = _chanDev->waitfordata(remainSize, _msUntil(deadline, now), &recvSize);
         if(!ans)
         {
             return RESULT_OPERATION_TIMEOUT;
@@ -1034,6 +1225,8 @@ u_result RPlidarDriverImplCommon::_waitHqNode(rplidar_response_hq_capsule_measur
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        _stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+        _countRecv(recvSize, recvSize);
     
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -1047,6 +1240,7 @@ u_result RPlidarDriverImplCommon::_waitHqNode(rplidar_response_hq_capsule_measur
                     else {
                         recvPos = 0;
                         _is_previous_HqdataRdy = false;
+                        _stats.resync_bytes.fetch_add(1, std::memory_order_relaxed);
                         continue;
                     }
                 }
@@ -1072,6 +1266,7 @@ u_result RPlidarDriverImplCommon::_waitHqNode(rplidar_response_hq_capsule_measur
                 }
                 else {
                     _is_previous_HqdataRdy = false;
+                    _stats.crc_failures.fetch_add(1, std::memory_order_relaxed);
                     return RESULT_INVALID_DATA;
                 }
 
@@ -1084,6 +1279,7 @@ u_result RPlidarDriverImplCommon::_waitHqNode(rplidar_response_hq_capsule_measur
 
 void RPlidarDriverImplCommon::_HqToNormal(const rplidar_response_hq_capsule_measurement_nodes_t & node_hq, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount) 
 {
+    RPLIDAR_TRACE_SCOPE("_HqToNormal");
     nodeCount = 0;
     if (_is_previous_HqdataRdy) {
         for (size_t pos = 0; pos < _countof(_cached_previous_Hqdata.node_hq); ++pos)
@@ -1097,114 +1293,498 @@ void RPlidarDriverImplCommon::_HqToNormal(const rplidar_response_hq_capsule_meas
 }
 //*******************************************HQ support********************************//
 
-static _u32 _varbitscale_decode(_u32 scaled, _u32 & scaleLevel)
+u_result RPlidarDriverImplCommon::setReactor(RPlidarReactor * reactor)
 {
-    static const _u32 VBS_SCALED_BASE[] = {
-        RPLIDAR_VARBITSCALE_X16_DEST_VAL,
-        RPLIDAR_VARBITSCALE_X8_DEST_VAL,
-        RPLIDAR_VARBITSCALE_X4_DEST_VAL,
-        RPLIDAR_VARBITSCALE_X2_DEST_VAL,
-        0,
-    };
+    if (_isScanning) return RESULT_OPERATION_FAIL;
+    _reactor = static_cast<RPlidarReactorImpl *>(reactor);
+    return RESULT_OK;
+}
 
-    static const _u32 VBS_SCALED_LVL[] = {
-        4,
-        3,
-        2,
-        1,
-        0,
-    };
+u_result RPlidarDriverImplCommon::setPipelinedDecoding(bool enable)
+{
+    if (_isScanning) return RESULT_OPERATION_FAIL;
+    _isPipelined = enable;
+    return RESULT_OK;
+}
 
-    static const _u32 VBS_TARGET_BASE[] = {
-        (0x1 << RPLIDAR_VARBITSCALE_X16_SRC_BIT),
-        (0x1 << RPLIDAR_VARBITSCALE_X8_SRC_BIT),
-        (0x1 << RPLIDAR_VARBITSCALE_X4_SRC_BIT),
-        (0x1 << RPLIDAR_VARBITSCALE_X2_SRC_BIT),
-        0,
-    };
+u_result RPlidarDriverImplCommon::setRealtimeProfile(const RplidarRealtimeProfile * profile)
+{
+    if (_isScanning) return RESULT_OPERATION_FAIL;
 
-    for (size_t i = 0; i < _countof(VBS_SCALED_BASE); ++i)
-    {
-        int remain = ((int)scaled - (int)VBS_SCALED_BASE[i]);
-        if (remain >= 0) {
-            scaleLevel = VBS_SCALED_LVL[i];
-            return VBS_TARGET_BASE[i] + (remain << scaleLevel);
-        }
+    if (!profile) {
+        _rt_enabled = false;
+        return RESULT_OK;
     }
-    return 0;
+
+    _rt_profile = *profile;
+    _rt_enabled = true;
+    if (_rt_profile.lock_memory) {
+        return rp::hal::Thread::lockMemory();
+    }
+    return RESULT_OK;
 }
 
-void RPlidarDriverImplCommon::_ultraCapsuleToNormal(const rplidar_response_ultra_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
+void RPlidarDriverImplCommon::_applyRealtimeProfile(const RplidarRealtimeProfile & profile, _u64 cpuMask)
 {
-    nodeCount = 0;
-    if (_is_previous_capsuledataRdy) {
-        int diffAngle_q8;
-        int currentStartAngle_q8 = ((capsule.start_angle_sync_q6 & 0x7FFF) << 2);
-        int prevStartAngle_q8 = ((_cached_previous_ultracapsuledata.start_angle_sync_q6 & 0x7FFF) << 2);
+    // best effort, a thread that can't be promoted still scans with the default scheduling
+    rp::hal::Thread::setCurrentAffinity(cpuMask);
+    rp::hal::Thread::setCurrentRealtime(profile.priority);
 
-        diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
-        if (prevStartAngle_q8 >  currentStartAngle_q8) {
-            diffAngle_q8 += (360 << 8);
-        }
+    if (profile.lock_memory) {
+        // touch the stack this thread will run on so it is resident before the first byte arrives
+        volatile _u8 stack[32 * 1024];
+        for (size_t pos = 0; pos < sizeof(stack); pos += 1024) stack[pos] = 0;
+    }
+}
 
-        int angleInc_q16 = (diffAngle_q8 << 3) / 3;
-        int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
-        for (size_t pos = 0; pos < _countof(_cached_previous_ultracapsuledata.ultra_cabins); ++pos)
-        {
-            int dist_q2[3];
-            int angle_q6[3];
-            int syncBit[3];
+void RPlidarDriverImplCommon::_prefaultScanBuffers()
+{
+    // mlockall(MCL_FUTURE) only locks pages once they are touched, do it before scanning
+    memset(_cached_scan_node_hq_buf, 0, sizeof(_cached_scan_node_hq_buf));
+    memset(_cached_scan_node_hq_buf_for_interval_retrieve, 0, sizeof(_cached_scan_node_hq_buf_for_interval_retrieve));
+    memset(_local_scan_buf, 0, sizeof(_local_scan_buf));
+    _scan_ring.prefault();
+}
 
+u_result RPlidarDriverImplCommon::getStats(RplidarDriverStats & stats)
+{
+    stats.bytes_received = _stats.bytes_received.load(std::memory_order_relaxed);
+    stats.recv_calls = _stats.recv_calls.load(std::memory_order_relaxed);
+    stats.wakeups = _stats.wakeups.load(std::memory_order_relaxed);
+    for (size_t pos = 0; pos < _countof(stats.frames_decoded); ++pos) {
+        stats.frames_decoded[pos] = _stats.frames_decoded[pos].load(std::memory_order_relaxed);
+    }
+    stats.checksum_failures = _stats.checksum_failures.load(std::memory_order_relaxed);
+    stats.crc_failures = _stats.crc_failures.load(std::memory_order_relaxed);
+    stats.resync_bytes = _stats.resync_bytes.load(std::memory_order_relaxed);
+    stats.ring_overruns = _stats.ring_overruns.load(std::memory_order_relaxed);
+    stats.scans_published = _stats.scans_published.load(std::memory_order_relaxed);
+    stats.scans_dropped = _stats.scans_dropped.load(std::memory_order_relaxed);
+    stats.interval_overflows = _stats.interval_overflows.load(std::memory_order_relaxed);
+    stats.zero_distance_nodes = _stats.zero_distance_nodes.load(std::memory_order_relaxed);
+    stats.capsule_gaps = _stats.capsule_gaps.load(std::memory_order_relaxed);
+    stats.capsules_reordered = _stats.capsules_reordered.load(std::memory_order_relaxed);
+    stats.revolution_rate = _measured_frequency.load(std::memory_order_relaxed);
+    for (size_t pos = 0; pos < _countof(stats.decode_time); ++pos) {
+        stats.decode_time[pos] = _stats.decode_time[pos].load(std::memory_order_relaxed);
+    }
+    return RESULT_OK;
+}
 
-            _u32 combined_x3 = _cached_previous_ultracapsuledata.ultra_cabins[pos].combined_x3;
+u_result RPlidarDriverImplCommon::resetStats()
+{
+    _stats.bytes_received.store(0, std::memory_order_relaxed);
+    _stats.recv_calls.store(0, std::memory_order_relaxed);
+    _stats.wakeups.store(0, std::memory_order_relaxed);
+    for (size_t pos = 0; pos < _countof(_stats.frames_decoded); ++pos) {
+        _stats.frames_decoded[pos].store(0, std::memory_order_relaxed);
+    }
+    _stats.checksum_failures.store(0, std::memory_order_relaxed);
+    _stats.crc_failures.store(0, std::memory_order_relaxed);
+    _stats.resync_bytes.store(0, std::memory_order_relaxed);
+    _stats.ring_overruns.store(0, std::memory_order_relaxed);
+    _stats.scans_published.store(0, std::memory_order_relaxed);
+    _stats.scans_dropped.store(0, std::memory_order_relaxed);
+    _stats.interval_overflows.store(0, std::memory_order_relaxed);
+    _stats.zero_distance_nodes.store(0, std::memory_order_relaxed);
+    _stats.capsule_gaps.store(0, std::memory_order_relaxed);
+    _stats.capsules_reordered.store(0, std::memory_order_relaxed);
+    for (size_t pos = 0; pos < _countof(_stats.decode_time); ++pos) {
+        _stats.decode_time[pos].store(0, std::memory_order_relaxed);
+    }
+    return RESULT_OK;
+}
 
-            // unpack ...
-            int dist_major = (combined_x3 & 0xFFF);
+void RPlidarDriverImplCommon::_countRecv(size_t recvSize, size_t keptSize)
+{
+    _stats.recv_calls.fetch_add(1, std::memory_order_relaxed);
+    _stats.bytes_received.fetch_add(recvSize, std::memory_order_relaxed);
+    if (keptSize < recvSize) _stats.ring_overruns.fetch_add(recvSize - keptSize, std::memory_order_relaxed);
+}
 
-            // signed partical integer, using the magic shift here
-            // DO NOT TOUCH
+void RPlidarDriverImplCommon::_countFrames(size_t frames)
+{
+    size_t type = (size_t)(_scan_ans_type - RPLIDAR_ANS_TYPE_MEASUREMENT);
+    if (frames && type < RplidarDriverStats::FRAME_TYPE_COUNT) {
+        _stats.frames_decoded[type].fetch_add(frames, std::memory_order_relaxed);
+    }
+}
 
-            int dist_predict1 = (((int)(combined_x3 << 10)) >> 22);
-            int dist_predict2 = (((int)combined_x3) >> 22);
+void RPlidarDriverImplCommon::_countDecodeTime(_u64 startUs)
+{
+    _u64 elapsed = getus() - startUs;
+    size_t bin = 0;
+    while (bin + 1 < RplidarDriverStats::DECODE_TIME_BINS && (elapsed >> (bin + 1))) ++bin;
+    _stats.decode_time[bin].fetch_add(1, std::memory_order_relaxed);
+}
 
-            int dist_major2;
+u_result RPlidarDriverImplCommon::_startScanCaching(_u8 ansType)
+{
+    // a thread that outlived stop() still owns the channel
+    if (_cachethread.getHandle() || _decodethread.getHandle()) return RESULT_OPERATION_FAIL;
 
-            _u32 scalelvl1, scalelvl2;
+    _isScanning = true;
+    _scan_ans_type = ansType;
+    _last_sync_us = 0;
+    _sync_outliers = 0;
+    _measured_frequency.store(0, std::memory_order_relaxed);
+    _stable_revolutions = 0;
+    _capsule_step_q8 = 0;
+    _capsule_late_count = 0;
+    _setMotorReady(false);
 
-            // prefetch next ...
-            if (pos == _countof(_cached_previous_ultracapsuledata.ultra_cabins) - 1)
-            {
-                dist_major2 = (capsule.ultra_cabins[0].combined_x3 & 0xFFF);
-            }
-            else {
-                dist_major2 = (_cached_previous_ultracapsuledata.ultra_cabins[pos + 1].combined_x3 & 0xFFF);
-            }
+    if (_rt_enabled && _rt_profile.lock_memory) _prefaultScanBuffers();
 
-            // decode with the var bit scale ...
-            dist_major = _varbitscale_decode(dist_major, scalelvl1);
-            dist_major2 = _varbitscale_decode(dist_major2, scalelvl2);
+    if (_reactor || _isPipelined) {
+        // the bytes are pushed into _feedScanData(), start from a clean decoder
+        _scan_frame_pos = 0;
+        _local_scan_count = 0;
+        _local_scan_synced = false;
+        _is_previous_capsuledataRdy = false;
+        _is_previous_HqdataRdy = false;
+    }
 
+    if (_reactor) {
+        u_result ans = _reactor->addDriver(this);
+        if (IS_FAIL(ans)) _isScanning = false;
+        return ans;
+    }
 
-            int dist_base1 = dist_major;
-            int dist_base2 = dist_major2;
+    if (_isPipelined) {
+        _scan_ring.clear();
+        _decodethread = CLASS_THREAD(RPlidarDriverImplCommon, _decodeRawScanData);
+        _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheRawScanData);
+        if (_cachethread.getHandle() == 0 || _decodethread.getHandle() == 0) {
+            _isScanning = false;
+            _cachethread.join();
+            _decodethread.join();
+            return RESULT_OPERATION_FAIL;
+        }
+        // a real-time profile sets the policy from inside the threads instead
+        if (!_rt_enabled) _cachethread.setPriority(rp::hal::Thread::PRIORITY_HIGH);
+        return RESULT_OK;
+    }
 
-            if ((!dist_major) && dist_major2) {
-                dist_base1 = dist_major2;
-                scalelvl1 = scalelvl2;
-            }
+    switch (ansType) {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheScanData);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheCapsuledScanData);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheHqScanData);
+        break;
+    default:
+        _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheUltraCapsuledScanData);
+        break;
+    }
 
-           
-            dist_q2[0] = (dist_major << 2);
-            if ((dist_predict1 == 0xFFFFFE00) || (dist_predict1 == 0x1FF)) {
-                dist_q2[1] = 0;
-            } else {
-                dist_predict1 = (dist_predict1 << scalelvl1);
-                dist_q2[1] = (dist_predict1 + dist_base1) << 2;
+    if (_cachethread.getHandle() == 0) {
+        return RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
 
-            }
+u_result RPlidarDriverImplCommon::_cacheRawScanData()
+{
+    RPLIDAR_TRACE_THREAD("scan reader");
+    if (_rt_enabled) _applyRealtimeProfile(_rt_profile, _rt_profile.io_cpu_mask);
+    _u8 recvBuffer[1024];
 
-            if ((dist_predict2 == 0xFFFFFE00) || (dist_predict2 == 0x1FF)) {
-                dist_q2[2] = 0;
+    while (_isScanning) {
+        size_t recvSize;
+        if (!_chanDev->waitfordata(1, 100, &recvSize)) continue;
+        _stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+
+        if (recvSize > sizeof(recvBuffer)) recvSize = sizeof(recvBuffer);
+        recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+
+        // no locks and no decoding here, if the decoder falls behind the ring drops the overflow
+        _countRecv(recvSize, _scan_ring.write(recvBuffer, recvSize));
+        _scan_ring_evt.set();
+    }
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::_decodeRawScanData()
+{
+    RPLIDAR_TRACE_THREAD("scan decoder");
+    if (_rt_enabled) _applyRealtimeProfile(_rt_profile, _rt_profile.decode_cpu_mask);
+    _u8 buffer[1024];
+
+    while (_isScanning) {
+        _scan_ring_evt.wait(100);
+
+        size_t size;
+        while ((size = _scan_ring.read(buffer, sizeof(buffer))) != 0) {
+            _feedScanData(buffer, size);
+        }
+    }
+    return RESULT_OK;
+}
+
+void RPlidarDriverImplCommon::_feedScanData(const _u8 * data, size_t size)
+{
+    RPLIDAR_TRACE_SCOPE("_feedScanData");
+    rplidar_response_measurement_node_hq_t   local_buf[512];
+    size_t                                   count = 0;
+    _u8 *frameBuffer = (_u8 *)&_scan_frame;
+    size_t frameSize;
+    size_t frames = 0;
+    size_t resyncBytes = 0;
+    _u64   decodeStart = getus();
+
+    switch (_scan_ans_type) {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        frameSize = sizeof(rplidar_response_measurement_node_t);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        frameSize = sizeof(rplidar_response_capsule_measurement_nodes_t);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        frameSize = sizeof(rplidar_response_hq_capsule_measurement_nodes_t);
+        break;
+    default:
+        frameSize = sizeof(rplidar_response_ultra_capsule_measurement_nodes_t);
+        break;
+    }
+
+    for (size_t pos = 0; pos < size; ++pos) {
+        _u8 currentByte = data[pos];
+
+        // the same sync checks as the _wait*Node() functions, the position survives between calls
+        bool valid = true;
+        if (_scan_ans_type == RPLIDAR_ANS_TYPE_MEASUREMENT) {
+            if (_scan_frame_pos == 0) valid = (((currentByte >> 1) ^ currentByte) & 0x1) != 0;
+            else if (_scan_frame_pos == 1) valid = (currentByte & RPLIDAR_RESP_MEASUREMENT_CHECKBIT) != 0;
+        } else if (_scan_ans_type == RPLIDAR_ANS_TYPE_MEASUREMENT_HQ) {
+            if (_scan_frame_pos == 0) valid = (currentByte == RPLIDAR_RESP_MEASUREMENT_HQ_SYNC);
+            if (!valid) _is_previous_HqdataRdy = false;
+        } else {
+            if (_scan_frame_pos == 0) valid = ((currentByte >> 4) == RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1);
+            else if (_scan_frame_pos == 1) valid = ((currentByte >> 4) == RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2);
+            if (!valid) _is_previous_capsuledataRdy = false;
+        }
+        if (!valid) {
+            // the bytes already taken for this frame are skipped with it
+            resyncBytes += _scan_frame_pos + 1;
+            _scan_frame_pos = 0;
+            continue;
+        }
+
+        frameBuffer[_scan_frame_pos++] = currentByte;
+        if (_scan_frame_pos < frameSize) continue;
+        _scan_frame_pos = 0;
+
+        size_t nodeCount;
+        if (_decodeScanFrame(local_buf + count, nodeCount)) ++frames;
+        count += nodeCount;
+
+        // an ultra capsule is the largest frame with 96 nodes
+        if (count + 96 > _countof(local_buf)) {
+            _cacheScanNodes(local_buf, count);
+            count = 0;
+        }
+    }
+
+    if (count) _cacheScanNodes(local_buf, count);
+
+    if (resyncBytes) _stats.resync_bytes.fetch_add(resyncBytes, std::memory_order_relaxed);
+    _countFrames(frames);
+    _countDecodeTime(decodeStart);
+}
+
+bool RPlidarDriverImplCommon::_decodeScanFrame(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount)
+{
+    nodeCount = 0;
+
+    switch (_scan_ans_type) {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        convert(_scan_frame.node, nodebuffer[nodeCount++]);
+        break;
+
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        {
+            const _u8 * frameBuffer = (const _u8 *)&_scan_frame.capsule;
+            _u8 checksum = 0;
+            _u8 recvChecksum = ((_scan_frame.capsule.s_checksum_1 & 0xF) | (_scan_frame.capsule.s_checksum_2 << 4));
+            for (size_t cpos = offsetof(rplidar_response_capsule_measurement_nodes_t, start_angle_sync_q6);
+                cpos < sizeof(rplidar_response_capsule_measurement_nodes_t); ++cpos)
+            {
+                checksum ^= frameBuffer[cpos];
+            }
+            if (recvChecksum != checksum) {
+                _is_previous_capsuledataRdy = false;
+                _stats.checksum_failures.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (_scan_frame.capsule.start_angle_sync_q6 & RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) {
+                // this is the first capsule frame in logic, discard the previous cached data...
+                _is_previous_capsuledataRdy = false;
+            }
+
+            if (_cached_express_flag == 0)
+                _capsuleToNormal(_scan_frame.capsule, nodebuffer, nodeCount);
+            else
+                _dense_capsuleToNormal(_scan_frame.capsule, nodebuffer, nodeCount);
+        }
+        break;
+
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        {
+            _u32 crcCalc2 = _crc32((_u8 *)&_scan_frame.hq, sizeof(rplidar_response_hq_capsule_measurement_nodes_t) - 4);
+            if (crcCalc2 != _scan_frame.hq.crc32) {
+                _is_previous_HqdataRdy = false;
+                _stats.crc_failures.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            _is_previous_HqdataRdy = true;
+            _HqToNormal(_scan_frame.hq, nodebuffer, nodeCount);
+        }
+        break;
+
+    default:
+        {
+            const _u8 * frameBuffer = (const _u8 *)&_scan_frame.ultra_capsule;
+            _u8 checksum = 0;
+            _u8 recvChecksum = ((_scan_frame.ultra_capsule.s_checksum_1 & 0xF) | (_scan_frame.ultra_capsule.s_checksum_2 << 4));
+            for (size_t cpos = offsetof(rplidar_response_ultra_capsule_measurement_nodes_t, start_angle_sync_q6);
+                cpos < sizeof(rplidar_response_ultra_capsule_measurement_nodes_t); ++cpos)
+            {
+                checksum ^= frameBuffer[cpos];
+            }
+            if (recvChecksum != checksum) {
+                _is_previous_capsuledataRdy = false;
+                _stats.checksum_failures.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (_scan_frame.ultra_capsule.start_angle_sync_q6 & RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) {
+                _is_previous_capsuledataRdy = false;
+            }
+
+            _ultraCapsuleToNormal(_scan_frame.ultra_capsule, nodebuffer, nodeCount);
+        }
+        break;
+    }
+    return true;
+}
+
+static _u32 _varbitscale_decode(_u32 scaled, _u32 & scaleLevel)
+{
+    static const _u32 VBS_SCALED_BASE[] = {
+        RPLIDAR_VARBITSCALE_X16_DEST_VAL,
+        RPLIDAR_VARBITSCALE_X8_DEST_VAL,
+        RPLIDAR_VARBITSCALE_X4_DEST_VAL,
+        RPLIDAR_VARBITSCALE_X2_DEST_VAL,
+        0,
+    };
+
+    static const _u32 VBS_SCALED_LVL[] = {
+        4,
+        3,
+        2,
+        1,
+        0,
+    };
+
+    static const _u32 VBS_TARGET_BASE[] = {
+        (0x1 << RPLIDAR_VARBITSCALE_X16_SRC_BIT),
+        (0x1 << RPLIDAR_VARBITSCALE_X8_SRC_BIT),
+        (0x1 << RPLIDAR_VARBITSCALE_X4_SRC_BIT),
+        (0x1 << RPLIDAR_VARBITSCALE_X2_SRC_BIT),
+        0,
+    };
+
+    for (size_t i = 0; i < _countof(VBS_SCALED_BASE); ++i)
+    {
+        int remain = ((int)scaled - (int)VBS_SCALED_BASE[i]);
+        if (remain >= 0) {
+            scaleLevel = VBS_SCALED_LVL[i];
+            return VBS_TARGET_BASE[i] + (remain << scaleLevel);
+        }
+    }
+    return 0;
+}
+
+void RPlidarDriverImplCommon::_ultraCapsuleToNormal(const rplidar_response_ultra_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
+{
+    RPLIDAR_TRACE_SCOPE("_ultraCapsuleToNormal");
+    nodeCount = 0;
+    if (_is_previous_capsuledataRdy && !_checkCapsuleContinuity(capsule.start_angle_sync_q6, _cached_previous_ultracapsuledata.start_angle_sync_q6)) {
+        return;
+    }
+    if (_is_previous_capsuledataRdy) {
+        int diffAngle_q8;
+        int currentStartAngle_q8 = ((capsule.start_angle_sync_q6 & 0x7FFF) << 2);
+        int prevStartAngle_q8 = ((_cached_previous_ultracapsuledata.start_angle_sync_q6 & 0x7FFF) << 2);
+
+        diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
+        if (prevStartAngle_q8 >  currentStartAngle_q8) {
+            diffAngle_q8 += (360 << 8);
+        }
+
+        int angleInc_q16 = (diffAngle_q8 << 3) / 3;
+        int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
+        for (size_t pos = 0; pos < _countof(_cached_previous_ultracapsuledata.ultra_cabins); ++pos)
+        {
+            int dist_q2[3];
+            int angle_q6[3];
+            int syncBit[3];
+
+
+            _u32 combined_x3 = _cached_previous_ultracapsuledata.ultra_cabins[pos].combined_x3;
+
+            // unpack ...
+            int dist_major = (combined_x3 & 0xFFF);
+
+            // signed partical integer, using the magic shift here
+            // DO NOT TOUCH
+
+            int dist_predict1 = (((int)(combined_x3 << 10)) >> 22);
+            int dist_predict2 = (((int)combined_x3) >> 22);
+
+            int dist_major2;
+
+            _u32 scalelvl1, scalelvl2;
+
+            // prefetch next ...
+            if (pos == _countof(_cached_previous_ultracapsuledata.ultra_cabins) - 1)
+            {
+                dist_major2 = (capsule.ultra_cabins[0].combined_x3 & 0xFFF);
+            }
+            else {
+                dist_major2 = (_cached_previous_ultracapsuledata.ultra_cabins[pos + 1].combined_x3 & 0xFFF);
+            }
+
+            // decode with the var bit scale ...
+            dist_major = _varbitscale_decode(dist_major, scalelvl1);
+            dist_major2 = _varbitscale_decode(dist_major2, scalelvl2);
+
+
+            int dist_base1 = dist_major;
+            int dist_base2 = dist_major2;
+
+            if ((!dist_major) && dist_major2) {
+                dist_base1 = dist_major2;
+                scalelvl1 = scalelvl2;
+            }
+
+           
+            dist_q2[0] = (dist_major << 2);
+            if ((dist_predict1 == 0xFFFFFE00) || (dist_predict1 == 0x1FF)) {
+                dist_q2[1] = 0;
+            } else {
+                dist_predict1 = (dist_predict1 << scalelvl1);
+                dist_q2[1] = (dist_predict1 + dist_base1) << 2;
+
+            }
+
+            if ((dist_predict2 == 0xFFFFFE00) || (dist_predict2 == 0x1FF)) {
+                dist_q2[2] = 0;
             } else {
                 dist_predict2 = (dist_predict2 << scalelvl2);
                 dist_q2[2] = (dist_predict2 + dist_base2) << 2;
@@ -1251,11 +1831,14 @@ void RPlidarDriverImplCommon::_ultraCapsuleToNormal(const rplidar_response_ultra
 
 u_result RPlidarDriverImplCommon::checkSupportConfigCommands(bool& outSupport, _u32 timeoutInMs)
 {
-    u_result ans;
+    u_result ans = RESULT_OK;
 
-    rplidar_response_device_info_t devinfo;
-    ans = getDeviceInfo(devinfo, timeoutInMs);
-    if (IS_FAIL(ans)) return ans;
+    // the firmware doesn't change while connected
+    rplidar_response_device_info_t devinfo = _devinfo;
+    if (!_devinfo_valid) {
+        ans = getDeviceInfo(devinfo, timeoutInMs);
+        if (IS_FAIL(ans)) return ans;
+    }
 
     // if lidar firmware >= 1.24
     if (devinfo.firmware_version >= ((0x1 << 8) | 24)) {
@@ -1304,38 +1887,149 @@ u_result RPlidarDriverImplCommon::getLidarConf(_u32 type, std::vector<_u8> &outp
             return RESULT_OPERATION_TIMEOUT;
         }
 
+        //check if returned type is same as asked type
+        _u32 replyType = -1;
+        _chanDev->recvdata(reinterpret_cast<_u8 *>(&replyType), sizeof(type));
+
+        //read the payload straight into outputBuf, a mismatched answer is still drained
+        int payLoadLen = header_size - sizeof(type);
+        if (payLoadLen > 0) {
+            outputBuf.resize(payLoadLen);
+            _chanDev->recvdata(&outputBuf[0], payLoadLen);
+        }
+
+        if (replyType != type) {
+            return RESULT_INVALID_DATA;
+        }
+
+        //do consistency check
+        if (payLoadLen <= 0) {
+            return RESULT_INVALID_DATA;
+        }
+    }
+    return ans;
+}
+
+u_result RPlidarDriverImplCommon::setLidarConf(_u32 type, const void * payload, size_t payloadSize, _u32 timeout)
+{
+    std::vector<_u8> query(sizeof(rplidar_payload_set_scan_conf_t) + payloadSize);
+    reinterpret_cast<rplidar_payload_set_scan_conf_t *>(&query[0])->type = type;
+    if (payloadSize > 0)
+        memcpy(&query[sizeof(rplidar_payload_set_scan_conf_t)], payload, payloadSize);
+
+    u_result ans;
+    {
+        rp::hal::AutoLocker l(_lock);
+        if (IS_FAIL(ans = _sendCommand(RPLIDAR_CMD_SET_LIDAR_CONF, &query[0], query.size()))) {
+            return ans;
+        }
+
+        // waiting for confirmation
+        rplidar_ans_header_t response_header;
+        if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+            return ans;
+        }
+
+        // verify whether we got a correct header
+        if (response_header.type != RPLIDAR_ANS_TYPE_SET_LIDAR_CONF) {
+            return RESULT_INVALID_DATA;
+        }
+
+        _u32 header_size = (response_header.size_q30_subtype & RPLIDAR_ANS_HEADER_SIZE_MASK);
+        if (header_size < sizeof(type)) {
+            return RESULT_INVALID_DATA;
+        }
+
+        if (!_chanDev->waitfordata(header_size, timeout)) {
+            return RESULT_OPERATION_TIMEOUT;
+        }
+
         std::vector<_u8> dataBuf;
         dataBuf.resize(header_size);
         _chanDev->recvdata(reinterpret_cast<_u8 *>(&dataBuf[0]), header_size);
 
-        //check if returned type is same as asked type
+        //check if returned type is same as the type set
         _u32 replyType = -1;
         memcpy(&replyType, &dataBuf[0], sizeof(type));
         if (replyType != type) {
             return RESULT_INVALID_DATA;
         }
 
-        //copy all the payload into &outputBuf
-        int payLoadLen = header_size - sizeof(type);
+        // a non zero result code means the lidar refused the value
+        if (header_size >= sizeof(type) + sizeof(rplidar_response_set_lidar_conf_t)) {
+            rplidar_response_set_lidar_conf_t reply;
+            memcpy(&reply, &dataBuf[0] + sizeof(type), sizeof(reply));
+            if (reply.result != 0) {
+                return RESULT_OPERATION_FAIL;
+            }
+        }
+    }
+    return ans;
+}
 
-        //do consistency check
-        if (payLoadLen <= 0) {
+u_result RPlidarDriverImplCommon::getRotationFrequencyRange(float & minFrequency, float & maxFrequency, float & desiredFrequency, _u32 timeout)
+{
+    // the answers can't be told apart from the scan data
+    if (_isScanning) return RESULT_OPERATION_FAIL;
+
+    bool lidarSupportConfigCmds = false;
+    u_result ans = checkSupportConfigCommands(lidarSupportConfigCmds, timeout);
+    if (IS_FAIL(ans)) return ans;
+    if (!lidarSupportConfigCmds) return RESULT_OPERATION_NOT_SUPPORT;
+
+    const _u32 types[] = { RPLIDAR_CONF_MIN_ROT_FREQ, RPLIDAR_CONF_MAX_ROT_FREQ, RPLIDAR_CONF_DESIRED_ROT_FREQ };
+    float * frequencies[] = { &minFrequency, &maxFrequency, &desiredFrequency };
+
+    for (size_t pos = 0; pos < _countof(types); ++pos) {
+        std::vector<_u8> answer;
+        ans = getLidarConf(types[pos], answer, std::vector<_u8>(), timeout);
+        if (IS_FAIL(ans)) {
+            // older firmwares don't answer at all for a fixed speed
+            return (ans == RESULT_OPERATION_TIMEOUT) ? RESULT_OPERATION_NOT_SUPPORT : ans;
+        }
+        if (answer.size() < sizeof(_u16)) {
             return RESULT_INVALID_DATA;
         }
-        //copy all payLoadLen bytes to outputBuf
-        outputBuf.resize(payLoadLen);
-        memcpy(&outputBuf[0], &dataBuf[0] + sizeof(type), payLoadLen);
+
+        // the lidar works in rpm
+        _u16 rpm;
+        memcpy(&rpm, &answer[0], sizeof(rpm));
+        *frequencies[pos] = rpm / 60.0f;
     }
-    return ans;
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::setDesiredRotationFrequency(float frequency, _u32 timeout)
+{
+    float minFrequency, maxFrequency, desiredFrequency;
+    u_result ans = getRotationFrequencyRange(minFrequency, maxFrequency, desiredFrequency, timeout);
+    if (IS_FAIL(ans)) return ans;
+
+    if (frequency < minFrequency || frequency > maxFrequency) {
+        return RESULT_INVALID_DATA;
+    }
+
+    _u16 rpm = (_u16)(frequency * 60.0f + 0.5f);
+    return setLidarConf(RPLIDAR_CONF_DESIRED_ROT_FREQ, &rpm, sizeof(rpm), timeout);
 }
 
 u_result RPlidarDriverImplCommon::getTypicalScanMode(_u16& outMode, _u32 timeoutInMs)
+{
+    const RplidarCapabilityProfile * profile;
+    u_result ans = _getProfile(profile, timeoutInMs);
+    if (IS_FAIL(ans)) return ans;
+
+    outMode = profile->typical_mode;
+    return ans;
+}
+
+u_result RPlidarDriverImplCommon::_queryTypicalScanMode(_u16& outMode, _u32 timeoutInMs)
 {
     u_result ans;
     std::vector<_u8> answer;
     bool lidarSupportConfigCmds = false;
-    ans = checkSupportConfigCommands(lidarSupportConfigCmds);
-    if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
+    ans = checkSupportConfigCommands(lidarSupportConfigCmds, timeoutInMs);
+    if (IS_FAIL(ans)) return ans;
 
     if (lidarSupportConfigCmds)
     {
@@ -1442,20 +2136,95 @@ u_result RPlidarDriverImplCommon::getScanModeName(char* modeName, _u16 scanModeI
 }
 
 u_result RPlidarDriverImplCommon::getAllSupportedScanModes(std::vector<RplidarScanMode>& outModes, _u32 timeoutInMs)
+{
+    const RplidarCapabilityProfile * profile;
+    u_result ans = _getProfile(profile, timeoutInMs);
+    if (IS_FAIL(ans)) return ans;
+
+    outModes.insert(outModes.end(), profile->modes.begin(), profile->modes.end());
+    return ans;
+}
+
+u_result RPlidarDriverImplCommon::setProfileCache(const char * path)
+{
+    if (isConnected()) return RESULT_OPERATION_FAIL;
+    _profile_cache_path = path ? path : "";
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::setSocketBufferSize(size_t size)
+{
+    if (isConnected()) return RESULT_OPERATION_FAIL;
+    return _chanDev->setBufferSize(size) ? RESULT_OK : RESULT_OPERATION_NOT_SUPPORT;
+}
+
+void RPlidarDriverImplCommon::_loadProfile()
+{
+    _devinfo_valid = false;
+    _profile_valid = false;
+    _profile_from_cache = false;
+
+    rplidar_response_device_info_t devinfo;
+    if (!_profile_cache_path.empty() && IS_OK(getDeviceInfo(devinfo))
+        && RplidarCapabilityProfile::Load(_profile_cache_path.c_str(), devinfo, _profile)) {
+        // verified lazily: a scan answering with another type than cached drops the profile
+        _profile_valid = true;
+        _profile_from_cache = true;
+    }
+    // the accessory board may have been swapped under the lidar, ask on every connect
+    checkMotorCtrlSupport(_isSupportingMotorCtrl);
+}
+
+u_result RPlidarDriverImplCommon::_getProfile(const RplidarCapabilityProfile *& profile, _u32 timeout)
+{
+    if (!_profile_valid) {
+        u_result ans = _probeProfile(timeout);
+        if (IS_FAIL(ans)) return ans;
+    }
+    profile = &_profile;
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::_probeProfile(_u32 timeout)
+{
+    RplidarCapabilityProfile profile;
+    u_result ans = checkSupportConfigCommands(profile.conf_supported, timeout);
+    if (IS_FAIL(ans)) return ans;
+    profile.devinfo = _devinfo;
+
+    if (IS_FAIL(ans = _queryScanModes(profile.modes, timeout))) return ans;
+
+    if (profile.conf_supported) {
+        if (IS_FAIL(ans = _queryTypicalScanMode(profile.typical_mode, timeout))) return ans;
+    } else {
+        // old triangle lidars scan in express mode when they have it
+        profile.typical_mode = profile.findMode(RPLIDAR_CONF_SCAN_COMMAND_EXPRESS) ? RPLIDAR_CONF_SCAN_COMMAND_EXPRESS : RPLIDAR_CONF_SCAN_COMMAND_STD;
+    }
+
+    _profile = profile;
+    _profile_valid = true;
+    _profile_from_cache = false;
+    if (!_profile_cache_path.empty()) {
+        RplidarCapabilityProfile::Save(_profile_cache_path.c_str(), _profile);
+    }
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::_queryScanModes(std::vector<RplidarScanMode>& outModes, _u32 timeoutInMs)
 {
     u_result ans;
     bool confProtocolSupported = false;
-    ans = checkSupportConfigCommands(confProtocolSupported);
-    if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
+    ans = checkSupportConfigCommands(confProtocolSupported, timeoutInMs);
+    if (IS_FAIL(ans)) return ans;
 
     if (confProtocolSupported)
     {
         // 1. get scan mode count
         _u16 modeCount;
-        ans = getScanModeCount(modeCount);
+        ans = getScanModeCount(modeCount, timeoutInMs);
         if (IS_FAIL(ans))
         {
-            return RESULT_INVALID_DATA;
+            return ans;
         }
         // 2. for loop to get all fields of each scan mode
         for (_u16 i = 0; i < modeCount; i++)
@@ -1463,25 +2232,25 @@ u_result RPlidarDriverImplCommon::getAllSupportedScanModes(std::vector<RplidarSc
             RplidarScanMode scanModeInfoTmp;
             memset(&scanModeInfoTmp, 0, sizeof(scanModeInfoTmp));
             scanModeInfoTmp.id = i;
-            ans = getLidarSampleDuration(scanModeInfoTmp.us_per_sample, i);
+            ans = getLidarSampleDuration(scanModeInfoTmp.us_per_sample, i, timeoutInMs);
             if (IS_FAIL(ans))
             {
-                return RESULT_INVALID_DATA;
+                return ans;
             }
-            ans = getMaxDistance(scanModeInfoTmp.max_distance, i);
+            ans = getMaxDistance(scanModeInfoTmp.max_distance, i, timeoutInMs);
             if (IS_FAIL(ans))
             {
-                return RESULT_INVALID_DATA;
+                return ans;
             }
-            ans = getScanModeAnsType(scanModeInfoTmp.ans_type, i);
+            ans = getScanModeAnsType(scanModeInfoTmp.ans_type, i, timeoutInMs);
             if (IS_FAIL(ans))
             {
-                return RESULT_INVALID_DATA;
+                return ans;
             }
-            ans = getScanModeName(scanModeInfoTmp.scan_mode, i);
+            ans = getScanModeName(scanModeInfoTmp.scan_mode, i, timeoutInMs);
             if (IS_FAIL(ans))
             {
-                return RESULT_INVALID_DATA;
+                return ans;
             }
             outModes.push_back(scanModeInfoTmp);
         }
@@ -1490,12 +2259,12 @@ u_result RPlidarDriverImplCommon::getAllSupportedScanModes(std::vector<RplidarSc
     else
     {
         rplidar_response_sample_rate_t sampleRateTmp;
-        ans = getSampleDuration_uS(sampleRateTmp);
-        if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
+        ans = getSampleDuration_uS(sampleRateTmp, timeoutInMs);
+        if (IS_FAIL(ans)) return ans;
         //judge if support express scan
         bool ifSupportExpScan = false;
-        ans = checkExpressScanSupported(ifSupportExpScan);
-        if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
+        ans = checkExpressScanSupported(ifSupportExpScan, timeoutInMs);
+        if (IS_FAIL(ans)) return ans;
 
         RplidarScanMode stdScanModeInfo;
         stdScanModeInfo.id = RPLIDAR_CONF_SCAN_COMMAND_STD;
@@ -1537,91 +2306,43 @@ u_result RPlidarDriverImplCommon::getScanModeCount(_u16& modeCount, _u32 timeout
     return ans;
 }
 
-
-u_result RPlidarDriverImplCommon::startScan(bool force, bool useTypicalScan, _u32 options, RplidarScanMode* outUsedScanMode)
-{
-    u_result ans;
-
-    bool ifSupportLidarConf = false;
-    ans = checkSupportConfigCommands(ifSupportLidarConf);
-    if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
-
-    if (useTypicalScan)
-    {
-        //if support lidar config protocol
-        if (ifSupportLidarConf)
-        {
-            _u16 typicalMode;
-            ans = getTypicalScanMode(typicalMode);
-            if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
-
-            //call startScanExpress to do the job
-            return startScanExpress(false, typicalMode, 0, outUsedScanMode);
-        }
-        //if old version of triangle lidar
-        else
-        {
-            bool isExpScanSupported = false;
-            ans = checkExpressScanSupported(isExpScanSupported);
-            if (IS_FAIL(ans)) {
-                return ans;
-            }
-            if (isExpScanSupported)
-            {
-                return startScanExpress(false, RPLIDAR_CONF_SCAN_COMMAND_EXPRESS, 0, outUsedScanMode);
-            }
-        }
-    }
-    
-    // 'useTypicalScan' is false, just use normal scan mode
-    if(ifSupportLidarConf)
-    {
-        if(outUsedScanMode)
-        {
-            outUsedScanMode->id = RPLIDAR_CONF_SCAN_COMMAND_STD;
-            ans = getLidarSampleDuration(outUsedScanMode->us_per_sample, outUsedScanMode->id);
-            if(IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-
-            ans = getMaxDistance(outUsedScanMode->max_distance, outUsedScanMode->id);
-            if(IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-
-            ans = getScanModeAnsType(outUsedScanMode->ans_type, outUsedScanMode->id);
-            if(IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-
-            ans = getScanModeName(outUsedScanMode->scan_mode, outUsedScanMode->id);
-            if(IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-        }
+
+u_result RPlidarDriverImplCommon::startScan(bool force, bool useTypicalScan, _u32 options, RplidarScanMode* outUsedScanMode)
+{
+    const RplidarCapabilityProfile * profile;
+    u_result ans = _getProfile(profile);
+    if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
+
+    if (useTypicalScan && profile->typical_mode != RPLIDAR_CONF_SCAN_COMMAND_STD)
+    {
+        //call startScanExpress to do the job
+        return startScanExpress(false, profile->typical_mode, 0, outUsedScanMode);
     }
-    else
+
+    // 'useTypicalScan' is false, just use normal scan mode
+    if (outUsedScanMode)
     {
-        if(outUsedScanMode)
-        {
-            rplidar_response_sample_rate_t sampleRateTmp;
-            ans = getSampleDuration_uS(sampleRateTmp);
-            if(IS_FAIL(ans)) return RESULT_INVALID_DATA;
-            outUsedScanMode->us_per_sample = sampleRateTmp.std_sample_duration_us;
-            outUsedScanMode->max_distance = 16;
-            outUsedScanMode->ans_type = RPLIDAR_ANS_TYPE_MEASUREMENT;
-            strcpy(outUsedScanMode->scan_mode, "Standard");
-        }
+        const RplidarScanMode * mode = profile->findMode(RPLIDAR_CONF_SCAN_COMMAND_STD);
+        if (!mode) return RESULT_INVALID_DATA;
+        *outUsedScanMode = *mode;
     }
 
     return startScanNormal(force);
 }
 
 u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u32 options, RplidarScanMode* outUsedScanMode, _u32 timeout)
+{
+    bool cachedProfile = _profile_valid && _profile_from_cache;
+    u_result ans = _startScanExpress(force, scanMode, options, outUsedScanMode, timeout);
+
+    // the cached profile didn't match the lidar and was dropped, try again with a probed one
+    if (ans == RESULT_INVALID_DATA && cachedProfile && !_profile_valid) {
+        ans = _startScanExpress(force, scanMode, options, outUsedScanMode, timeout);
+    }
+    return ans;
+}
+
+u_result RPlidarDriverImplCommon::_startScanExpress(bool force, _u16 scanMode, _u32 options, RplidarScanMode* outUsedScanMode, _u32 timeout)
 {
     u_result ans;
     if (!isConnected()) return RESULT_OPERATION_FAIL;
@@ -1634,65 +2355,23 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
         return startScan(force, false, 0, outUsedScanMode);
     }
 
-    
-    bool ifSupportLidarConf = false;
-    ans = checkSupportConfigCommands(ifSupportLidarConf);
+    const RplidarCapabilityProfile * profile;
+    ans = _getProfile(profile);
     if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
 
+    // old triangle lidars only know one express mode
+    const RplidarScanMode * mode = profile->findMode(scanMode);
+    if (!mode && !profile->conf_supported) mode = profile->findMode(RPLIDAR_CONF_SCAN_COMMAND_EXPRESS);
+    if (!mode) return RESULT_INVALID_DATA;
+
     if (outUsedScanMode)
     {
+        *outUsedScanMode = *mode;
         outUsedScanMode->id = scanMode;
-        if (ifSupportLidarConf)
-        {
-            ans = getLidarSampleDuration(outUsedScanMode->us_per_sample, outUsedScanMode->id);
-            if (IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-
-            ans = getMaxDistance(outUsedScanMode->max_distance, outUsedScanMode->id);
-            if (IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-
-            ans = getScanModeAnsType(outUsedScanMode->ans_type, outUsedScanMode->id);
-            if (IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-
-            ans = getScanModeName(outUsedScanMode->scan_mode, outUsedScanMode->id);
-            if (IS_FAIL(ans))
-            {
-                return RESULT_INVALID_DATA;
-            }
-           
-
-        }
-        else
-        {
-            rplidar_response_sample_rate_t sampleRateTmp;
-            ans = getSampleDuration_uS(sampleRateTmp);
-            if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
-
-            outUsedScanMode->us_per_sample = sampleRateTmp.express_sample_duration_us;
-            outUsedScanMode->max_distance = 16;
-            outUsedScanMode->ans_type = RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED;
-            strcpy(outUsedScanMode->scan_mode, "Express");
-        }
     }
 
     //get scan answer type to specify how to wait data
-    _u8 scanAnsType;
-    if (ifSupportLidarConf)
-    {      
-        getScanModeAnsType(scanAnsType, scanMode);
-    }
-    else
-    {
-        scanAnsType = RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED;
-    }
+    _u8 scanAnsType = mode->ans_type;
 
     {
         rp::hal::AutoLocker l(_lock);
@@ -1715,6 +2394,8 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
 
         // verify whether we got a correct header
         if (response_header.type != scanAnsType) {
+            // the next start probes the lidar again instead of trusting a stale cache
+            if (_profile_from_cache) _profile_valid = false;
             return RESULT_INVALID_DATA;
         }
 
@@ -1726,8 +2407,6 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
                 return RESULT_INVALID_DATA;
             }
             _cached_express_flag = 0;
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheCapsuledScanData);
         }
         else if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED)
         {
@@ -1735,27 +2414,21 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
                 return RESULT_INVALID_DATA;
             }
             _cached_express_flag = 1;
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheCapsuledScanData);
         }
         else if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_HQ) {
             if (header_size < sizeof(rplidar_response_hq_capsule_measurement_nodes_t)) {
                 return RESULT_INVALID_DATA;
             }
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheHqScanData);
         }
         else
         {
             if (header_size < sizeof(rplidar_response_ultra_capsule_measurement_nodes_t)) {
                 return RESULT_INVALID_DATA;
             }
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheUltraCapsuledScanData);
         }
 
-        if (_cachethread.getHandle() == 0) {
-            return RESULT_OPERATION_FAIL;
+        if (IS_FAIL(ans = _startScanCaching(scanAnsType))) {
+            return ans;
         }
     }
     return RESULT_OK;
@@ -1764,7 +2437,7 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
 u_result RPlidarDriverImplCommon::stop(_u32 timeout)
 {
     u_result ans;
-    _disableDataGrabbing();
+    if (IS_FAIL(ans = _disableDataGrabbing())) return ans;
 
     {
         rp::hal::AutoLocker l(_lock);
@@ -1779,6 +2452,7 @@ u_result RPlidarDriverImplCommon::stop(_u32 timeout)
 
 u_result RPlidarDriverImplCommon::grabScanData(rplidar_response_measurement_node_t * nodebuffer, size_t & count, _u32 timeout)
 {
+    RPLIDAR_TRACE_SCOPE("grabScanData");
     DEPRECATED_WARN("grabScanData()", "grabScanDataHq()");
 
     switch (_dataEvt.wait(timeout))
@@ -1810,7 +2484,19 @@ u_result RPlidarDriverImplCommon::grabScanData(rplidar_response_measurement_node
 
 u_result RPlidarDriverImplCommon::grabScanDataHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u32 timeout)
 {
-    switch (_dataEvt.wait(timeout))
+    RPLIDAR_TRACE_SCOPE("grabScanDataHq");
+    return _takeScanData(nodebuffer, count, _dataEvt.wait(timeout));
+}
+
+u_result RPlidarDriverImplCommon::grabScanDataHq_uS(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 timeout_us)
+{
+    RPLIDAR_TRACE_SCOPE("grabScanDataHq_uS");
+    return _takeScanData(nodebuffer, count, _dataEvt.waitUs(timeout_us));
+}
+
+u_result RPlidarDriverImplCommon::_takeScanData(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, unsigned long waitResult)
+{
+    switch (waitResult)
     {
     case rp::hal::Event::EVENT_TIMEOUT:
         count = 0;
@@ -1835,8 +2521,198 @@ u_result RPlidarDriverImplCommon::grabScanDataHq(rplidar_response_measurement_no
     }
 }
 
+u_result RPlidarDriverImplCommon::waitScanAsync(RplidarAsyncRequest * request)
+{
+    if (!request || !request->complete) return RESULT_INVALID_DATA;
+
+    // _disableDataGrabbing() clears _isScanning before it aborts the pending requests
+    rp::hal::AutoLocker l(_async_lock);
+    if (!_isScanning) return RESULT_OPERATION_FAIL;
+    request->next = _scan_requests;
+    _scan_requests = request;
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::waitSectorAsync(RplidarAsyncRequest * request)
+{
+    if (!request || !request->complete) return RESULT_INVALID_DATA;
+
+    rp::hal::AutoLocker l(_async_lock);
+    if (!_isScanning) return RESULT_OPERATION_FAIL;
+    request->next = _sector_requests;
+    _sector_requests = request;
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::submitCommandAsync(RplidarAsyncRequest * request)
+{
+    if (!request || !request->complete) return RESULT_INVALID_DATA;
+    if (request->command >= RplidarAsyncRequest::ASYNC_COMMAND_COUNT) return RESULT_INVALID_DATA;
+
+    rp::hal::AutoLocker l(_async_lock);
+    if (!_isConnected) return RESULT_OPERATION_FAIL;
+
+    request->deadline_us = getus() + (_u64)request->timeout * 1000;
+    request->next = NULL;
+    RplidarAsyncRequest ** tail = &_command_requests;
+    while (*tail) tail = &(*tail)->next;
+    *tail = request;
+
+    if (!_async_running) {
+        _async_running = true;
+        _async_thread = CLASS_THREAD(RPlidarDriverImplCommon, _asyncCommandProc);
+        if (_async_thread.getHandle() == 0) {
+            _async_running = false;
+            *tail = NULL;
+            return RESULT_OPERATION_FAIL;
+        }
+    }
+    _async_evt.set();
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::getHealthAsync(RplidarAsyncRequest * request)
+{
+    if (!request) return RESULT_INVALID_DATA;
+    request->command = RplidarAsyncRequest::ASYNC_COMMAND_GET_HEALTH;
+    return submitCommandAsync(request);
+}
+
+bool RPlidarDriverImplCommon::cancelAsync(RplidarAsyncRequest * request)
+{
+    rp::hal::AutoLocker l(_async_lock);
+    RplidarAsyncRequest ** lists[] = { &_scan_requests, &_sector_requests, &_command_requests };
+    for (size_t pos = 0; pos < _countof(lists); ++pos) {
+        for (RplidarAsyncRequest ** link = lists[pos]; *link; link = &(*link)->next) {
+            if (*link == request) {
+                *link = request->next;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void RPlidarDriverImplCommon::_fillAsyncRequests(RplidarAsyncRequest *& pending, const rplidar_response_measurement_node_hq_t * nodebuffer, size_t count, RplidarAsyncRequest *& done)
+{
+    RplidarAsyncRequest * requests;
+    {
+        rp::hal::AutoLocker l(_async_lock);
+        requests = pending;
+        pending = NULL;
+    }
+
+    while (requests) {
+        RplidarAsyncRequest * request = requests;
+        requests = request->next;
+
+        if (request->count > count) request->count = count;
+        memcpy(request->nodebuffer, nodebuffer, request->count * sizeof(rplidar_response_measurement_node_hq_t));
+        request->next = done;
+        done = request;
+    }
+}
+
+void RPlidarDriverImplCommon::_completeAsyncRequests(RplidarAsyncRequest * done, u_result result)
+{
+    while (done) {
+        // the request may be reused or freed by its callback
+        RplidarAsyncRequest * request = done;
+        done = request->next;
+        request->next = NULL;
+        request->complete(request, result);
+    }
+}
+
+void RPlidarDriverImplCommon::_abortScanRequests(u_result result)
+{
+    RplidarAsyncRequest * done = NULL;
+    {
+        rp::hal::AutoLocker l(_async_lock);
+        RplidarAsyncRequest ** lists[] = { &_scan_requests, &_sector_requests };
+        for (size_t pos = 0; pos < _countof(lists); ++pos) {
+            while (*lists[pos]) {
+                RplidarAsyncRequest * request = *lists[pos];
+                *lists[pos] = request->next;
+                request->count = 0;
+                request->next = done;
+                done = request;
+            }
+        }
+    }
+    _completeAsyncRequests(done, result);
+}
+
+void RPlidarDriverImplCommon::_stopAsyncCommands()
+{
+    {
+        rp::hal::AutoLocker l(_async_lock);
+        if (!_async_running) return;
+        _async_running = false;
+    }
+    _async_evt.set();
+    _async_thread.join();
+
+    // whatever was still queued is not going to be sent anymore
+    RplidarAsyncRequest * done;
+    {
+        rp::hal::AutoLocker l(_async_lock);
+        done = _command_requests;
+        _command_requests = NULL;
+    }
+    _completeAsyncRequests(done, RESULT_OPERATION_STOP);
+}
+
+u_result RPlidarDriverImplCommon::_asyncCommandProc()
+{
+    RPLIDAR_TRACE_THREAD("async commands");
+    for (;;) {
+        RplidarAsyncRequest * request = NULL;
+        {
+            rp::hal::AutoLocker l(_async_lock);
+            if (!_async_running) break;
+            if (_command_requests) {
+                request = _command_requests;
+                _command_requests = request->next;
+                request->next = NULL;
+            }
+        }
+        if (!request) {
+            _async_evt.wait();
+            continue;
+        }
+        request->complete(request, _runAsyncCommand(request));
+    }
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::_runAsyncCommand(RplidarAsyncRequest * request)
+{
+    // the commands ahead of it may have used up its time
+    _u64 now = getus();
+    if (now >= request->deadline_us) return RESULT_OPERATION_TIMEOUT;
+    _u32 timeout = (_u32)((request->deadline_us - now + 999) / 1000);
+
+    RplidarCommandAnswer & answer = request->answer;
+    switch (request->command) {
+    case RplidarAsyncRequest::ASYNC_COMMAND_GET_HEALTH:
+        return getHealth(answer.health, timeout);
+    case RplidarAsyncRequest::ASYNC_COMMAND_GET_DEVICE_INFO:
+        return getDeviceInfo(answer.devinfo, timeout);
+    case RplidarAsyncRequest::ASYNC_COMMAND_GET_LIDAR_CONF:
+        return getLidarConf(request->conf_type, answer.conf, std::vector<_u8>(), timeout);
+    case RplidarAsyncRequest::ASYNC_COMMAND_RESET:
+        return reset(timeout);
+    case RplidarAsyncRequest::ASYNC_COMMAND_CHECK_MOTOR_CTRL:
+        return checkMotorCtrlSupport(answer.motor_ctrl_support, timeout);
+    default:
+        return RESULT_INVALID_DATA;
+    }
+}
+
 u_result RPlidarDriverImplCommon::getScanDataWithInterval(rplidar_response_measurement_node_t * nodebuffer, size_t & count)
 {
+    RPLIDAR_TRACE_SCOPE("getScanDataWithInterval");
     DEPRECATED_WARN("getScanDataWithInterval(rplidar_response_measurement_node_t*, size_t&)", "getScanDataWithInterval(rplidar_response_measurement_node_hq_t*, size_t&)");
 
     size_t size_to_copy = 0;
@@ -1861,6 +2737,7 @@ u_result RPlidarDriverImplCommon::getScanDataWithInterval(rplidar_response_measu
 
 u_result RPlidarDriverImplCommon::getScanDataWithIntervalHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count)
 {
+    RPLIDAR_TRACE_SCOPE("getScanDataWithIntervalHq");
     size_t size_to_copy = 0;
     {
         rp::hal::AutoLocker l(_lock);
@@ -1878,6 +2755,63 @@ u_result RPlidarDriverImplCommon::getScanDataWithIntervalHq(rplidar_response_mea
     return RESULT_OK;
 }
 
+u_result RPlidarDriverImplCommon::getScanDataWithIntervalHq_uS(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 timeout_us)
+{
+    RPLIDAR_TRACE_SCOPE("getScanDataWithIntervalHq_uS");
+    _u64 deadline = getus() + timeout_us;
+
+    for (;;) {
+        u_result ans = getScanDataWithIntervalHq(nodebuffer, count);
+        if (ans != RESULT_OPERATION_TIMEOUT) return ans;
+
+        // the event may be left over from nodes somebody already took, look again after every wakeup
+        if (_interval_evt.waitUntil(deadline) != rp::hal::Event::EVENT_OK) {
+            count = 0;
+            return RESULT_OPERATION_TIMEOUT;
+        }
+    }
+}
+
+u_result RPlidarDriverImplCommon::setScanFilter(const RplidarScanFilter * filter)
+{
+    rp::hal::AutoLocker l(_lock);
+
+    if (!filter) {
+        _scan_filter_enabled = false;
+        return RESULT_OK;
+    }
+
+    if (filter->angle_range_count > RplidarScanFilter::MAX_ANGLE_RANGES) return RESULT_INVALID_DATA;
+
+    // compile the angle ranges into a lookup table indexed by angle_z_q14
+    if (filter->angle_range_count == 0) {
+        memset(_scan_filter_angle_mask, 1, sizeof(_scan_filter_angle_mask));
+    } else {
+        memset(_scan_filter_angle_mask, 0, sizeof(_scan_filter_angle_mask));
+        for (size_t bin = 0; bin < _countof(_scan_filter_angle_mask); ++bin) {
+            float angle = (bin + 0.5f) * 360.f / _countof(_scan_filter_angle_mask);
+            for (size_t pos = 0; pos < filter->angle_range_count; ++pos) {
+                float from = fmodf(filter->angle_ranges[pos].from, 360.f);
+                float to = fmodf(filter->angle_ranges[pos].to, 360.f);
+                if (from < 0) from += 360.f;
+                if (to < 0) to += 360.f;
+
+                bool inRange = (from <= to) ? (angle >= from && angle < to) : (angle >= from || angle < to);
+                if (inRange) {
+                    _scan_filter_angle_mask[bin] = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    _scan_filter_min_dist_q2 = filter->min_distance > 0 ? _u32(filter->min_distance * 4) : 0;
+    _scan_filter_max_dist_q2 = filter->max_distance > 0 ? _u32(filter->max_distance * 4) : _u32(-1);
+    _scan_filter_min_quality = filter->min_quality;
+    _scan_filter_enabled = true;
+    return RESULT_OK;
+}
+
 static inline float getAngle(const rplidar_response_measurement_node_t& node)
 {
     return (node.angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) / 64.f;
@@ -1972,6 +2906,7 @@ static u_result ascendScanData_(TNode * nodebuffer, size_t count)
 
 u_result RPlidarDriverImplCommon::ascendScanData(rplidar_response_measurement_node_t * nodebuffer, size_t count)
 {
+    RPLIDAR_TRACE_SCOPE("ascendScanData");
     DEPRECATED_WARN("ascendScanData(rplidar_response_measurement_node_t*, size_t)", "ascendScanData(rplidar_response_measurement_node_hq_t*, size_t)");
 
     return ascendScanData_<rplidar_response_measurement_node_t>(nodebuffer, count);
@@ -1979,28 +2914,30 @@ u_result RPlidarDriverImplCommon::ascendScanData(rplidar_response_measurement_no
 
 u_result RPlidarDriverImplCommon::ascendScanData(rplidar_response_measurement_node_hq_t * nodebuffer, size_t count)
 {
+    RPLIDAR_TRACE_SCOPE("ascendScanDataHq");
     return ascendScanData_<rplidar_response_measurement_node_hq_t>(nodebuffer, count);
 }
 
 u_result RPlidarDriverImplCommon::_sendCommand(_u8 cmd, const void * payload, size_t payloadsize)
 {
-    _u8 pkt_header[10];
-    rplidar_cmd_packet_t * header = reinterpret_cast<rplidar_cmd_packet_t * >(pkt_header);
-    _u8 checksum = 0;
+    // sync, cmd, size, up to 255 bytes of payload and the checksum, sent with a single write
+    _u8 pkt[2 + 1 + 255 + 1];
+    rplidar_cmd_packet_t * header = reinterpret_cast<rplidar_cmd_packet_t * >(pkt);
+    size_t pkt_size = 2;
 
     if (!_isConnected) return RESULT_OPERATION_FAIL;
 
     if (payloadsize && payload) {
+        // the size goes out in one byte
+        if (payloadsize > 255) return RESULT_INVALID_DATA;
         cmd |= RPLIDAR_CMDFLAG_HAS_PAYLOAD;
     }
 
     header->syncByte = RPLIDAR_CMD_SYNC_BYTE;
     header->cmd_flag = cmd;
 
-    // send header first
-    _chanDev->senddata(pkt_header, 2) ;
-
     if (cmd & RPLIDAR_CMDFLAG_HAS_PAYLOAD) {
+        _u8 checksum = 0;
         checksum ^= RPLIDAR_CMD_SYNC_BYTE;
         checksum ^= cmd;
         checksum ^= (payloadsize & 0xFF);
@@ -2010,17 +2947,15 @@ u_result RPlidarDriverImplCommon::_sendCommand(_u8 cmd, const void * payload, si
             checksum ^= ((_u8 *)payload)[pos];
         }
 
-        // send size
-        _u8 sizebyte = payloadsize;
-        _chanDev->senddata(&sizebyte, 1);
-
-        // send payload
-        _chanDev->senddata((const _u8 *)payload, sizebyte);
-
-        // send checksum
-        _chanDev->senddata(&checksum, 1);
+        pkt[pkt_size++] = (_u8)payloadsize;
+        memcpy(pkt + pkt_size, payload, payloadsize);
+        pkt_size += payloadsize;
+        pkt[pkt_size++] = checksum;
     }
 
+    if (_chanDev->senddata(pkt, pkt_size) != (int)pkt_size) {
+        return RESULT_OPERATION_FAIL;
+    }
     return RESULT_OK;
 }
 
@@ -2030,11 +2965,12 @@ u_result RPlidarDriverImplCommon::getSampleDuration_uS(rplidar_response_sample_r
 
     if (!isConnected()) return RESULT_OPERATION_FAIL;
     
-    _disableDataGrabbing();
+    u_result ans;
+    if (IS_FAIL(ans = _disableDataGrabbing())) return ans;
     
     rplidar_response_device_info_t devinfo;
     // 1. fetch the device version first...
-    u_result ans = getDeviceInfo(devinfo, timeout);
+    ans = getDeviceInfo(devinfo, timeout);
 
     rateInfo.express_sample_duration_us = _cached_sampleduration_express;
     rateInfo.std_sample_duration_us = _cached_sampleduration_std;
@@ -2083,7 +3019,7 @@ u_result RPlidarDriverImplCommon::checkMotorCtrlSupport(bool & support, _u32 tim
     
     if (!isConnected()) return RESULT_OPERATION_FAIL;
     
-    _disableDataGrabbing();
+    if (IS_FAIL(ans = _disableDataGrabbing())) return ans;
 
     {
         rp::hal::AutoLocker l(_lock);
@@ -2135,6 +3071,7 @@ u_result RPlidarDriverImplCommon::setMotorPWM(_u16 pwm)
         if (IS_FAIL(ans = _sendCommand(RPLIDAR_CMD_SET_MOTOR_PWM,(const _u8 *)&motor_pwm, sizeof(motor_pwm)))) {
             return ans;
         }
+        _motor_pwm = pwm;
     }
 
     return RESULT_OK;
@@ -2142,36 +3079,108 @@ u_result RPlidarDriverImplCommon::setMotorPWM(_u16 pwm)
 
 u_result RPlidarDriverImplCommon::startMotor()
 {
+    startMotorAsync();
+    // returns right away if the motor was already spinning
+    waitMotorReady(MOTOR_SPINUP_TIME);
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::stopMotor()
+{
+    stopMotorAsync();
+    delay(MOTOR_SPINUP_TIME);
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::startMotorAsync()
+{
+    u_result ans = RESULT_OK;
     if (_isSupportingMotorCtrl) { // RPLIDAR A2
-        setMotorPWM(DEFAULT_MOTOR_PWM);
-        delay(500);
-        return RESULT_OK;
+        // keep the pwm of a spinning motor, the speed regulation may have moved it
+        if (!_motor_on || !_motor_pwm) ans = setMotorPWM(DEFAULT_MOTOR_PWM);
     } else { // RPLIDAR A1
         rp::hal::AutoLocker l(_lock);
         _chanDev->clearDTR();
-        delay(500);
-        return RESULT_OK;
     }
+    if (IS_FAIL(ans)) return ans;
+
+    if (!_motor_on) {
+        _motor_spinup_us = getus() + (_u64)MOTOR_SPINUP_TIME * 1000;
+        _motor_on = true;
+    }
+    return RESULT_OK;
 }
 
-u_result RPlidarDriverImplCommon::stopMotor()
+u_result RPlidarDriverImplCommon::stopMotorAsync()
 {
+    u_result ans = RESULT_OK;
     if (_isSupportingMotorCtrl) { // RPLIDAR A2
-        setMotorPWM(0);
-        delay(500);
-        return RESULT_OK;
+        ans = setMotorPWM(0);
     } else { // RPLIDAR A1
         rp::hal::AutoLocker l(_lock);
         _chanDev->setDTR();
-        delay(500);
-        return RESULT_OK;
+    }
+
+    _motor_on = false;
+    {
+        rp::hal::AutoLocker l(_lock);
+        _stable_revolutions = 0;
+        _setMotorReady(false);
+    }
+    return ans;
+}
+
+u_result RPlidarDriverImplCommon::waitMotorReady(_u32 timeout)
+{
+    if (!_motor_on) return RESULT_OPERATION_FAIL;
+
+    _u64 deadline = getus() + (_u64)timeout * 1000;
+    for (;;) {
+        // while scanning the revolutions tell, otherwise all there is to go by is the spin-up time
+        _u64 now = getus();
+        bool scanning = _isScanning;
+        if (scanning ? _motor_ready.load() : now >= _motor_spinup_us) return RESULT_OK;
+        if (now >= deadline) return RESULT_OPERATION_TIMEOUT;
+
+        // a scan may start or stop meanwhile, look again every revolution or so
+        _u64 wakeup = now + 100000;
+        if (!scanning && _motor_spinup_us < wakeup) wakeup = _motor_spinup_us;
+        if (deadline < wakeup) wakeup = deadline;
+        _motor_ready_evt.waitUntil(wakeup);
     }
 }
 
-void RPlidarDriverImplCommon::_disableDataGrabbing()
+u_result RPlidarDriverImplCommon::_disableDataGrabbing()
 {
     _isScanning = false;
-    _cachethread.join();
+    if (_reactor) _reactor->removeDriver(this);
+
+    _u64 deadline = getus() + (_u64)SCAN_THREAD_STOP_TIMEOUT * 1000;
+    u_result ans = _joinScanThread(_cachethread, deadline);
+    if (IS_OK(ans)) ans = _joinScanThread(_decodethread, deadline);
+    if (IS_FAIL(ans)) {
+        // the thread keeps its handle, a new scan is refused until it has been joined
+        fprintf(stderr, "*WARN* the scan thread did not stop within %d ms\n", (int)SCAN_THREAD_STOP_TIMEOUT);
+    }
+    _abortScanRequests(RESULT_OPERATION_STOP);
+
+    // a cancellation nobody consumed would fail the next command's wait
+    _chanDev->clearCancel();
+    return ans;
+}
+
+u_result RPlidarDriverImplCommon::_joinScanThread(rp::hal::Thread & thread, _u64 deadline)
+{
+    // wake the thread out of its wait instead of letting it time out. A thread may consume a
+    // cancellation and go on to its next wait before it sees _isScanning, so keep cancelling.
+    // Channels that can't be cancelled still end within their own wait timeout.
+    // Thread::join() can't time out on macOS, there a stuck thread blocks the caller.
+    for (;;) {
+        _chanDev->cancelOperation();
+        _scan_ring_evt.set();
+        if (thread.join(SCAN_THREAD_JOIN_TIMEOUT) != RESULT_OPERATION_TIMEOUT) return RESULT_OK;
+        if (getus() >= deadline) return RESULT_OPERATION_TIMEOUT;
+    }
 }
 
 // Serial Driver Impl
@@ -2187,12 +3196,17 @@ RPlidarDriverSerial::~RPlidarDriverSerial()
     disconnect();
     
     _chanDev->close();
+    // a scan thread that outlived stop() ends once its channel is closed
+    _cachethread.join();
+    _decodethread.join();
+
     _chanDev->ReleaseRxTx();
 }
 
 void RPlidarDriverSerial::disconnect()
 {
     if (!_isConnected) return ;
+    _stopAsyncCommands();
     stop();
 }
 
@@ -2214,8 +3228,14 @@ u_result RPlidarDriverSerial::connect(const wchar_t * port_path, _u32 baudrate,
 
     _isConnected = true;
 
-    checkMotorCtrlSupport(_isSupportingMotorCtrl);
-    stopMotor();
+    _loadProfile();
+    if (flag & CONNECT_FLAG_KEEP_MOTOR) {
+        // a lidar that kept spinning across the reconnect doesn't need to spin up again
+        _motor_on = true;
+        _motor_spinup_us = 0;
+    } else {
+        stopMotorAsync();
+    }
 
     return RESULT_OK;
 }
@@ -2229,12 +3249,22 @@ RPlidarDriverTCP::~RPlidarDriverTCP()
 {
     // force disconnection
     disconnect();
+
+    // a scan thread that outlived stop() still reads from the socket, wait for it to end
+    _cachethread.join();
+    _decodethread.join();
+    _chanDev->close();
+
+    _chanDev->ReleaseRxTx();
 }
 
 void RPlidarDriverTCP::disconnect()
 {
     if (!_isConnected) return ;
+    _stopAsyncCommands();
     stop();
+    // closing disposes the socket, leave it to the destructor while a scan thread still uses it
+    if (_cachethread.getHandle() || _decodethread.getHandle()) return;
     _chanDev->close();
 }
 
@@ -2254,8 +3284,70 @@ u_result RPlidarDriverTCP::connect(const wchar_t * ipStr, _u32 port, _u32 flag)
 
     _isConnected = true;
 
-    checkMotorCtrlSupport(_isSupportingMotorCtrl);
-    stopMotor();
+    _loadProfile();
+    if (flag & CONNECT_FLAG_KEEP_MOTOR) {
+        // a lidar that kept spinning across the reconnect doesn't need to spin up again
+        _motor_on = true;
+        _motor_spinup_us = 0;
+    } else {
+        stopMotorAsync();
+    }
+
+    return RESULT_OK;
+}
+
+RPlidarDriverUDP::RPlidarDriverUDP() 
+{
+    _chanDev = new UDPChannelDevice();
+}
+
+RPlidarDriverUDP::~RPlidarDriverUDP()
+{
+    // force disconnection
+    disconnect();
+
+    // a scan thread that outlived stop() still reads from the socket, wait for it to end
+    _cachethread.join();
+    _decodethread.join();
+    _chanDev->close();
+
+    _chanDev->ReleaseRxTx();
+}
+
+void RPlidarDriverUDP::disconnect()
+{
+    if (!_isConnected) return ;
+    _stopAsyncCommands();
+    stop();
+    // closing disposes the socket, leave it to the destructor while a scan thread still uses it
+    if (_cachethread.getHandle() || _decodethread.getHandle()) return;
+    _chanDev->close();
+}
+
+u_result RPlidarDriverUDP::connect(const wchar_t * ipStr, _u32 port, _u32 flag)
+{
+    if (isConnected()) return RESULT_ALREADY_DONE;
+
+    if (!_chanDev) return RESULT_INSUFFICIENT_MEMORY;
+
+    {
+        rp::hal::AutoLocker l(_lock);
+
+        // there is no connection, only the socket the lidar streams to
+        if(!_chanDev->bind(ipStr, port))
+            return RESULT_INVALID_DATA;
+    }
+
+    _isConnected = true;
+
+    _loadProfile();
+    if (flag & CONNECT_FLAG_KEEP_MOTOR) {
+        // a lidar that kept spinning across the reconnect doesn't need to spin up again
+        _motor_on = true;
+        _motor_spinup_us = 0;
+    } else {
+        stopMotorAsync();
+    }
 
     return RESULT_OK;
 }
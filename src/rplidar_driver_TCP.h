@@ -39,35 +39,143 @@ namespace rp { namespace standalone{ namespace rplidar {
 class TCPChannelDevice :public ChannelDevice
 {
 public:
+    enum {
+        RX_RING_SIZE = 64*1024,
+        DEFAULT_SOCKET_BUFFER_SIZE = 256*1024,
+        CANCEL_CHECK_INTERVAL = 20, // ms, how long a wait may block before it notices cancelOperation()
+    };
+
     rp::net::StreamSocket * _binded_socket;
-    TCPChannelDevice():_binded_socket(rp::net::StreamSocket::CreateSocket()){}
+
+    TCPChannelDevice()
+        : _binded_socket(NULL)
+        , _rx_ring(RX_RING_SIZE)
+        , _socket_buffer_size(DEFAULT_SOCKET_BUFFER_SIZE)
+        , _cancelled(false)
+    {}
 
     bool bind(const wchar_t * ipStr, uint32_t port)
     {
+        close();
+        _binded_socket = rp::net::StreamSocket::CreateSocket();
+        if (!_binded_socket) return false;
+
+        _rx_ring.clear();
+        _cancelled = false;
+
+        // the receive buffer has to be sized before connecting for the TCP window to follow it
+        _binded_socket->setBufferSize(_socket_buffer_size, rp::net::SocketBase::SOCKET_DIR_RD);
+
         rp::net::SocketAddress socket(narrow(ipStr).c_str(), port);
-        return IS_OK(_binded_socket->connect(socket));
+        if (IS_FAIL(_binded_socket->connect(socket))) {
+            close();
+            return false;
+        }
+        return true;
     }
     void close()
     {
+        if (!_binded_socket) return;
         _binded_socket->dispose();
         _binded_socket = NULL;
     }
+    void flush()
+    {
+        if (!_binded_socket) return;
+        // drop both what the ring holds and what is still queued in the socket
+        do {
+            _rx_ring.clear();
+        } while (_fillRing(false) && _rx_ring.size());
+        _rx_ring.clear();
+    }
     bool waitfordata(size_t data_count,_u32 timeout = -1, size_t * returned_size = NULL)
     {
-        if(returned_size)
-            *returned_size = data_count;
-        return (_binded_socket->waitforData(timeout) == RESULT_OK);
+        if (returned_size) *returned_size = _rx_ring.size();
+        if (!_binded_socket) return false;
+
+        _u32 startTs = getms();
+        bool readable = false;
+        for (;;) {
+            if (_rx_ring.size() < data_count && !_fillRing(readable)) {
+                // the connection is gone
+                return false;
+            }
+
+            size_t avail = _rx_ring.size();
+            if (returned_size) *returned_size = avail;
+            if (avail >= data_count) return true;
+            if (_cancelled) return false;
+
+            _u32 waitTime = getms() - startTs;
+            if (waitTime >= timeout) return false;
+
+            // wait in slices so a cancelled wait returns without closing the socket
+            _u32 slice = timeout - waitTime;
+            if (slice > CANCEL_CHECK_INTERVAL) slice = CANCEL_CHECK_INTERVAL;
+
+            u_result ans = _binded_socket->waitforData(slice);
+            if (IS_FAIL(ans) && ans != RESULT_OPERATION_TIMEOUT) return false;
+            readable = IS_OK(ans);
+        }
     }
     int senddata(const _u8 * data, size_t size)
     {
-        return _binded_socket->send(data, size) ;
+        if (!_binded_socket) return -1;
+        // the socket reports a u_result, the driver expects the number of bytes sent
+        return IS_OK(_binded_socket->send(data, size)) ? (int)size : -1;
     }
     int recvdata(unsigned char * data, size_t size)
     {
-        size_t lenRec = 0;
-        _binded_socket->recv(data, size, lenRec);
-        return lenRec;
+        return (int)_rx_ring.read(data, size);
+    }
+    void ReleaseRxTx()
+    {
+        close();
     }
+    int getNativeHandle()
+    {
+        // a reactor reads the socket itself, see RPlidarReactorImpl::addDriver()
+        return _binded_socket ? _binded_socket->getNativeHandle() : -1;
+    }
+    void cancelOperation()
+    {
+        _cancelled = true;
+    }
+    void clearCancel()
+    {
+        _cancelled = false;
+    }
+    bool setBufferSize(size_t size)
+    {
+        _socket_buffer_size = size;
+        return true;
+    }
+
+protected:
+    // moves everything the socket has queued into the ring without blocking, false once the
+    // connection is closed. readable tells that a wait just reported data, so getting none means EOF
+    bool _fillRing(bool readable)
+    {
+        size_t received = 0;
+        for (;;) {
+            _u8 * block;
+            size_t space = _rx_ring.writeBlock(&block);
+            if (!space) return true; // ring full, the rest waits in the socket buffer
+
+            size_t recvSize = 0;
+            if (IS_FAIL(_binded_socket->recvNoWait(block, space, recvSize))) return false;
+            _rx_ring.commitWrite(recvSize);
+            received += recvSize;
+
+            // a full block may just have reached the end of the ring, go on from its start
+            if (recvSize < space) break;
+        }
+        return !readable || received;
+    }
+
+    rp::hal::RingBuffer     _rx_ring;
+    size_t                  _socket_buffer_size;
+    std::atomic<bool>       _cancelled;
 };
 
 
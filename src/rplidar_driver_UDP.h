@@ -0,0 +1,197 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+#include "Convert.h"
+namespace rp { namespace standalone{ namespace rplidar {
+
+class UDPChannelDevice :public ChannelDevice
+{
+public:
+    enum {
+        RX_RING_SIZE = 64*1024,
+        DEFAULT_SOCKET_BUFFER_SIZE = 1024*1024, // datagrams that don't fit are lost, unlike TCP
+        MAX_DATAGRAM_SIZE = 2048,
+        RECV_BATCH = 32,
+        CANCEL_CHECK_INTERVAL = 20, // ms, how long a wait may block before it notices cancelOperation()
+    };
+
+    rp::net::DGramSocket *  _binded_socket;
+    rp::net::SocketAddress  _lidar_addr;
+
+    UDPChannelDevice()
+        : _binded_socket(NULL)
+        , _rx_ring(RX_RING_SIZE)
+        , _socket_buffer_size(DEFAULT_SOCKET_BUFFER_SIZE)
+        , _cancelled(false)
+    {}
+
+    bool bind(const wchar_t * ipStr, uint32_t port)
+    {
+        close();
+        _binded_socket = rp::net::DGramSocket::CreateSocket();
+        if (!_binded_socket) return false;
+
+        _rx_ring.clear();
+        _cancelled = false;
+        _binded_socket->setBufferSize(_socket_buffer_size, rp::net::SocketBase::SOCKET_DIR_RD);
+
+        // any local port, the lidar answers to wherever the commands come from
+        rp::net::SocketAddress localAddr;
+        localAddr.setAnyAddress();
+        localAddr.setPort(0);
+        if (IS_FAIL(_binded_socket->bind(localAddr))
+            || IS_FAIL(_lidar_addr.setAddressFromString(narrow(ipStr).c_str()))
+            || IS_FAIL(_lidar_addr.setPort(port))
+            // only the lidar's datagrams get through, a stray sender can't feed the decoder
+            || IS_FAIL(_binded_socket->setPairAddress(&_lidar_addr))) {
+            close();
+            return false;
+        }
+        return true;
+    }
+    void close()
+    {
+        if (!_binded_socket) return;
+        _binded_socket->dispose();
+        _binded_socket = NULL;
+    }
+    void flush()
+    {
+        if (!_binded_socket) return;
+        // drop both what the ring holds and what is still queued in the socket
+        do {
+            _rx_ring.clear();
+        } while (_fillRing() && _rx_ring.size());
+        _rx_ring.clear();
+    }
+    bool waitfordata(size_t data_count,_u32 timeout = -1, size_t * returned_size = NULL)
+    {
+        if (returned_size) *returned_size = _rx_ring.size();
+        if (!_binded_socket) return false;
+
+        _u32 startTs = getms();
+        for (;;) {
+            if (_rx_ring.size() < data_count && !_fillRing()) return false;
+
+            size_t avail = _rx_ring.size();
+            if (returned_size) *returned_size = avail;
+            if (avail >= data_count) return true;
+            if (_cancelled) return false;
+
+            _u32 waitTime = getms() - startTs;
+            if (waitTime >= timeout) return false;
+
+            // wait in slices so a cancelled wait returns in time
+            _u32 slice = timeout - waitTime;
+            if (slice > CANCEL_CHECK_INTERVAL) slice = CANCEL_CHECK_INTERVAL;
+
+            u_result ans = _binded_socket->waitforData(slice);
+            if (IS_FAIL(ans) && ans != RESULT_OPERATION_TIMEOUT) return false;
+        }
+    }
+    int senddata(const _u8 * data, size_t size)
+    {
+        if (!_binded_socket) return -1;
+        return IS_OK(_binded_socket->send(data, size)) ? (int)size : -1;
+    }
+    int recvdata(unsigned char * data, size_t size)
+    {
+        return (int)_rx_ring.read(data, size);
+    }
+    void ReleaseRxTx()
+    {
+        close();
+    }
+    int getNativeHandle()
+    {
+        // a reactor reads the socket itself, see RPlidarReactorImpl::addDriver()
+        return _binded_socket ? _binded_socket->getNativeHandle() : -1;
+    }
+    void cancelOperation()
+    {
+        _cancelled = true;
+    }
+    void clearCancel()
+    {
+        _cancelled = false;
+    }
+    bool setBufferSize(size_t size)
+    {
+        _socket_buffer_size = size;
+        return true;
+    }
+
+protected:
+    // moves the queued datagrams into the ring in batches without blocking. Only whole datagrams
+    // are taken, so a frame is never cut; what doesn't fit stays in the socket buffer
+    bool _fillRing()
+    {
+        for (;;) {
+            size_t batch = _rx_ring.space() / MAX_DATAGRAM_SIZE;
+            if (batch > RECV_BATCH) batch = RECV_BATCH;
+            if (!batch) return true;
+
+            size_t count = 0;
+            if (IS_FAIL(_binded_socket->recvBatchNoWait(_batch, MAX_DATAGRAM_SIZE, batch, _batch_lens, count))) {
+                return false;
+            }
+            for (size_t pos = 0; pos < count; ++pos) {
+                // a truncated datagram has size 0 and is lost like any other
+                _rx_ring.write(_batch + pos * MAX_DATAGRAM_SIZE, _batch_lens[pos]);
+            }
+            if (count < batch) return true;
+        }
+    }
+
+    rp::hal::RingBuffer     _rx_ring;
+    size_t                  _socket_buffer_size;
+    std::atomic<bool>       _cancelled;
+    _u8                     _batch[RECV_BATCH * MAX_DATAGRAM_SIZE];
+    size_t                  _batch_lens[RECV_BATCH];
+};
+
+
+class RPlidarDriverUDP : public RPlidarDriverImplCommon
+{
+public:
+
+    RPlidarDriverUDP();
+    virtual ~RPlidarDriverUDP();
+    virtual u_result connect(const wchar_t * ipStr, _u32 port, _u32 flag = 0);
+    virtual void disconnect();
+};
+
+
+}}}
@@ -35,6 +35,11 @@
 #pragma once
 
 namespace rp { namespace standalone{ namespace rplidar {
+    class RPlidarReactorImpl;
+
+    // crc32 of an HQ capsule, also used by the emulator to build them
+    _u32 _crc32(_u8 * ptr, _u32 len);
+
     class RPlidarDriverImplCommon : public RPlidarDriver
 {
 public:
@@ -52,6 +57,9 @@ public:
     virtual u_result getScanModeAnsType(_u8 &ansType, _u16 scanModeID, _u32 timeoutInMs = DEFAULT_TIMEOUT);
     virtual u_result getScanModeName(char* modeName, _u16 scanModeID, _u32 timeoutInMs = DEFAULT_TIMEOUT);
     virtual u_result getLidarConf(_u32 type, std::vector<_u8> &outputBuf, const std::vector<_u8> &reserve = std::vector<_u8>(), _u32 timeout = DEFAULT_TIMEOUT);
+    virtual u_result setLidarConf(_u32 type, const void * payload, size_t payloadSize, _u32 timeout = DEFAULT_TIMEOUT);
+    virtual u_result setProfileCache(const char * path);
+    virtual u_result setSocketBufferSize(size_t size);
 
     virtual u_result startScan(bool force, bool useTypicalScan, _u32 options = 0, RplidarScanMode* outUsedScanMode = NULL);
     virtual u_result startScanExpress(bool force, _u16 scanMode, _u32 options = 0, RplidarScanMode* outUsedScanMode = NULL, _u32 timeout = DEFAULT_TIMEOUT);
@@ -63,23 +71,64 @@ public:
     virtual u_result setMotorPWM(_u16 pwm);
     virtual u_result startMotor();
     virtual u_result stopMotor();
+    virtual u_result startMotorAsync();
+    virtual u_result stopMotorAsync();
+    virtual u_result waitMotorReady(_u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result checkMotorCtrlSupport(bool & support, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result getFrequency(bool inExpressMode, size_t count, float & frequency, bool & is4kmode);
     virtual u_result getFrequency(const RplidarScanMode& scanMode, size_t count, float & frequency);
+    virtual u_result getMeasuredFrequency(float & frequency);
+    virtual u_result setTargetFrequency(float frequency);
+    virtual u_result getRotationFrequencyRange(float & minFrequency, float & maxFrequency, float & desiredFrequency, _u32 timeout = DEFAULT_TIMEOUT);
+    virtual u_result setDesiredRotationFrequency(float frequency, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result startScanNormal(bool force, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result checkExpressScanSupported(bool & support, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result stop(_u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result grabScanData(rplidar_response_measurement_node_t * nodebuffer, size_t & count, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result grabScanDataHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u32 timeout = DEFAULT_TIMEOUT);
+    virtual u_result grabScanDataHq_uS(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 timeout_us);
     virtual u_result ascendScanData(rplidar_response_measurement_node_t * nodebuffer, size_t count);
     virtual u_result ascendScanData(rplidar_response_measurement_node_hq_t * nodebuffer, size_t count);
     virtual u_result getScanDataWithInterval(rplidar_response_measurement_node_t * nodebuffer, size_t & count);
     virtual u_result getScanDataWithIntervalHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count);
+    virtual u_result getScanDataWithIntervalHq_uS(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 timeout_us);
+    virtual u_result setScanFilter(const RplidarScanFilter * filter);
+    virtual u_result setReactor(RPlidarReactor * reactor);
+    virtual u_result setPipelinedDecoding(bool enable);
+    virtual u_result setRealtimeProfile(const RplidarRealtimeProfile * profile);
+    virtual u_result waitScanAsync(RplidarAsyncRequest * request);
+    virtual u_result waitSectorAsync(RplidarAsyncRequest * request);
+    virtual u_result submitCommandAsync(RplidarAsyncRequest * request);
+    virtual u_result getHealthAsync(RplidarAsyncRequest * request);
+    virtual bool cancelAsync(RplidarAsyncRequest * request);
+    virtual u_result getStats(RplidarDriverStats & stats);
+    virtual u_result resetStats();
 
 protected:
+    friend class RPlidarReactorImpl;
+
+    enum {
+        SCAN_FILTER_ANGLE_SHIFT = 4, // angle_z_q14 >> 4, 4096 bins per revolution
+        SCAN_FILTER_ANGLE_BINS  = (0x10000 >> SCAN_FILTER_ANGLE_SHIFT),
+        SCAN_RING_BUFFER_SIZE   = 64 * 1024,
+        SCAN_THREAD_JOIN_TIMEOUT = 50,   // ms between two cancellations while stopping a scan thread
+        SCAN_THREAD_STOP_TIMEOUT = 2 * DEFAULT_TIMEOUT, // ms a scan thread gets to stop: its own wait plus a channel that ignores cancellation
+        MOTOR_SPINUP_TIME       = 500,  // ms the motor is given to reach its speed when there is no scan to measure it
+        MOTOR_STABLE_REVOLUTIONS = 3,   // revolutions in a row within tolerance before the motor is ready
+        MAX_LATE_CAPSULES       = 2,    // capsules dropped in a row as reordered before taking a jump as a gap
+    };
 
     virtual u_result _sendCommand(_u8 cmd, const void * payload = NULL, size_t payloadsize = 0);
-    void     _disableDataGrabbing();
+    u_result _startScanExpress(bool force, _u16 scanMode, _u32 options, RplidarScanMode* outUsedScanMode, _u32 timeout);
+
+    // the capability profile is probed on first use and kept for the connection, or loaded on connect
+    void     _loadProfile();
+    u_result _getProfile(const RplidarCapabilityProfile *& profile, _u32 timeout = DEFAULT_TIMEOUT);
+    u_result _probeProfile(_u32 timeout);
+    u_result _queryScanModes(std::vector<RplidarScanMode>& outModes, _u32 timeoutInMs);
+    u_result _queryTypicalScanMode(_u16& outMode, _u32 timeoutInMs);
+    u_result _disableDataGrabbing();
+    u_result _joinScanThread(rp::hal::Thread & thread, _u64 deadline);
 
     virtual u_result _waitResponseHeader(rplidar_ans_header_t * header, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result _cacheScanData();
@@ -89,6 +138,7 @@ protected:
     virtual u_result _waitCapsuledNode(rplidar_response_capsule_measurement_nodes_t & node, _u32 timeout = DEFAULT_TIMEOUT);
     virtual void     _capsuleToNormal(const rplidar_response_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount);
     virtual void     _dense_capsuleToNormal(const rplidar_response_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount);
+    bool             _checkCapsuleContinuity(_u16 currentStartAngle_q6, _u16 prevStartAngle_q6);
     
     //FW1.23
     virtual u_result  _cacheUltraCapsuledScanData();
@@ -99,7 +149,41 @@ protected:
     virtual u_result _waitHqNode(rplidar_response_hq_capsule_measurement_nodes_t & node, _u32 timeout = DEFAULT_TIMEOUT);
     virtual void     _HqToNormal(const rplidar_response_hq_capsule_measurement_nodes_t & node_hq, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount);
 
-    bool     _isConnected; 
+    void     _cacheScanNodes(const rplidar_response_measurement_node_hq_t * nodebuffer, size_t count);
+    // hands out the published revolution once _dataEvt was waited for
+    u_result _takeScanData(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, unsigned long waitResult);
+    bool     _isNodeInScanFilter(const rplidar_response_measurement_node_hq_t & node) const;
+
+    u_result _startScanCaching(_u8 ansType);
+    // pipelined mode, one thread reads the raw bytes and the other decodes them
+    u_result _cacheRawScanData();
+    u_result _decodeRawScanData();
+    // called by every scan thread on itself before it touches the port
+    static void _applyRealtimeProfile(const RplidarRealtimeProfile & profile, _u64 cpuMask);
+    void     _prefaultScanBuffers();
+    // incremental decoding of the scan data pushed in by a reactor
+    void     _feedScanData(const _u8 * data, size_t size);
+    bool     _decodeScanFrame(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount);
+
+    // performance counters, bumped by whichever thread runs that stage
+    void     _countRecv(size_t recvSize, size_t keptSize);
+    void     _countFrames(size_t frames);
+    void     _countDecodeTime(_u64 startUs);
+
+    // asynchronous requests; the nodes are copied under _lock, complete is called after it is released
+    void     _fillAsyncRequests(RplidarAsyncRequest *& pending, const rplidar_response_measurement_node_hq_t * nodebuffer, size_t count, RplidarAsyncRequest *& done);
+    void     _completeAsyncRequests(RplidarAsyncRequest * done, u_result result);
+    void     _abortScanRequests(u_result result);
+    void     _stopAsyncCommands();
+    u_result _runAsyncCommand(RplidarAsyncRequest * request);
+    u_result _asyncCommandProc();
+
+    // called under _lock on every sync node
+    float    _measureRevolution(_u64 now);
+    bool     _regulateMotorSpeed(float period, _u16 & pwm);
+    void     _setMotorReady(bool ready);
+
+    bool     _isConnected;
     bool     _isScanning;
     bool     _isSupportingMotorCtrl;
 
@@ -109,6 +193,86 @@ protected:
     rplidar_response_measurement_node_hq_t   _cached_scan_node_hq_buf_for_interval_retrieve[8192];
     size_t                                   _cached_scan_node_hq_count_for_interval_retrieve;
 
+    // the scan being assembled by the cache thread
+    rplidar_response_measurement_node_hq_t   _local_scan_buf[MAX_SCAN_NODES];
+    size_t                                   _local_scan_count;
+    bool                                     _local_scan_synced;
+
+    bool                    _scan_filter_enabled;
+    _u8                     _scan_filter_angle_mask[SCAN_FILTER_ANGLE_BINS];
+    _u32                    _scan_filter_min_dist_q2;
+    _u32                    _scan_filter_max_dist_q2;
+    _u8                     _scan_filter_min_quality;
+
+    RPlidarReactorImpl *    _reactor;
+    _u8                     _scan_ans_type;
+    union {
+        rplidar_response_measurement_node_t                  node;
+        rplidar_response_capsule_measurement_nodes_t         capsule;
+        rplidar_response_ultra_capsule_measurement_nodes_t   ultra_capsule;
+        rplidar_response_hq_capsule_measurement_nodes_t      hq;
+    }                       _scan_frame;
+    size_t                  _scan_frame_pos;
+
+    bool                    _isPipelined;
+    rp::hal::RingBuffer     _scan_ring;
+    rp::hal::Event          _scan_ring_evt;
+
+    bool                    _rt_enabled;
+    RplidarRealtimeProfile  _rt_profile;
+
+    bool                            _devinfo_valid;     // from the last getDeviceInfo() of this connection
+    rplidar_response_device_info_t  _devinfo;
+    bool                            _profile_valid;
+    bool                            _profile_from_cache;
+    RplidarCapabilityProfile        _profile;
+    std::string                     _profile_cache_path;
+
+    struct {
+        std::atomic<_u64>   bytes_received;
+        std::atomic<_u64>   recv_calls;
+        std::atomic<_u64>   wakeups;
+        std::atomic<_u64>   frames_decoded[RplidarDriverStats::FRAME_TYPE_COUNT];
+        std::atomic<_u64>   checksum_failures;
+        std::atomic<_u64>   crc_failures;
+        std::atomic<_u64>   resync_bytes;
+        std::atomic<_u64>   ring_overruns;
+        std::atomic<_u64>   scans_published;
+        std::atomic<_u64>   scans_dropped;
+        std::atomic<_u64>   interval_overflows;
+        std::atomic<_u64>   zero_distance_nodes;
+        std::atomic<_u64>   capsule_gaps;
+        std::atomic<_u64>   capsules_reordered;
+        std::atomic<_u64>   decode_time[RplidarDriverStats::DECODE_TIME_BINS];
+    }                       _stats;
+
+    // pending asynchronous requests, singly linked through RplidarAsyncRequest::next
+    rp::hal::Locker         _async_lock;
+    RplidarAsyncRequest *   _scan_requests;
+    RplidarAsyncRequest *   _sector_requests;
+    RplidarAsyncRequest *   _command_requests;  // in order, served by _async_thread
+    bool                    _async_running;
+    rp::hal::Event          _async_evt;
+    rp::hal::Thread         _async_thread;
+
+    std::atomic<float>      _measured_frequency;
+    _u64                    _last_sync_us;
+    int                     _sync_outliers;
+
+    // motor speed regulation, guarded by _lock
+    float                   _target_frequency;
+    bool                    _motor_ctrl_running;
+    float                   _motor_ctrl_output;
+    float                   _motor_ctrl_error;
+    _u16                    _motor_pwm;
+
+    // motor readiness, _stable_revolutions is updated under _lock by the scan thread
+    bool                    _motor_on;
+    _u64                    _motor_spinup_us;   // when the motor is assumed at speed without a scan
+    int                     _stable_revolutions;
+    std::atomic<bool>       _motor_ready;
+    rp::hal::Event          _motor_ready_evt;
+
     _u16                    _cached_sampleduration_std;
     _u16                    _cached_sampleduration_express;
     _u8                     _cached_express_flag;
@@ -119,12 +283,16 @@ protected:
     rplidar_response_hq_capsule_measurement_nodes_t _cached_previous_Hqdata;
     bool                                         _is_previous_capsuledataRdy;
     bool                                         _is_previous_HqdataRdy;
+    int                                          _capsule_step_q8;      // start angle advance of the last capsule pair
+    int                                          _capsule_late_count;   // capsules dropped in a row as late
 
 	
 
     rp::hal::Locker         _lock;
     rp::hal::Event          _dataEvt;
+    rp::hal::Event          _interval_evt;      // set when nodes were added for getScanDataWithInterval*()
     rp::hal::Thread _cachethread;
+    rp::hal::Thread _decodethread;
 
 protected:
     RPlidarDriverImplCommon();
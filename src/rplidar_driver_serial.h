@@ -90,6 +90,18 @@ public:
     {
         rp::hal::serial_rxtx::ReleaseRxTx(_rxtxSerial);
     }
+    int getNativeHandle()
+    {
+        return _rxtxSerial->getNativeHandle();
+    }
+    void cancelOperation()
+    {
+        _rxtxSerial->cancelOperation();
+    }
+    void clearCancel()
+    {
+        _rxtxSerial->clearCancel();
+    }
 };
 
 class RPlidarDriverSerial : public RPlidarDriverImplCommon
@@ -0,0 +1,960 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include "hal/abs_rxtx.h"
+#include "hal/thread.h"
+#include "hal/types.h"
+#include "hal/locker.h"
+#include "hal/socket.h"
+#include "hal/event.h"
+#include "hal/ringbuffer.h"
+#include "rplidar_profile.h"
+#include "rplidar_driver_impl.h"
+#include "rplidar_emulator_impl.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// the synthetic scene: an 8m x 5m room with a pillar circling the lidar
+static const float ROOM_HALF_X_MM       = 4000.0f;
+static const float ROOM_HALF_Y_MM       = 2500.0f;
+static const float PILLAR_RADIUS_MM     = 150.0f;
+static const float PILLAR_ORBIT_MM      = 1500.0f;
+static const float PILLAR_ORBIT_HZ      = 0.2f;
+static const _u32  NOISE_MM             = 5;
+
+static const _u16  MIN_ROT_RPM          = 300;
+static const _u16  MAX_ROT_RPM          = 900;
+static const _u8   QUALITY              = 0x2F;
+
+// the boost decoder subtracts the triangulation offset, ~8 degree at room distances
+static const float ULTRA_ANGLE_OFFSET   = 8.0f;
+
+static const double PI                  = 3.14159265358979;
+
+// frames older than this after a stall are skipped, not sent in a burst
+static const double MAX_CATCH_UP_US     = 1000000.0;
+
+RPlidarEmulator * RPlidarEmulator::CreateEmulator(const RplidarEmulatorConfig & config)
+{
+    if (config.transport != DRIVER_TYPE_TCP && config.transport != DRIVER_TYPE_UDP) return NULL;
+    if (!config.device_count || !config.frames_per_packet || !config.sample_rate) return NULL;
+    if (config.scan_frequency <= 0 || config.loss_rate < 0 || config.loss_rate > 1) return NULL;
+    if (config.base_port && config.base_port + config.device_count > 65536) return NULL;
+    if (EmulatedLidar::findMode(config.ans_type) < 0) return NULL;
+
+    RPlidarEmulatorImpl * emulator = new RPlidarEmulatorImpl(config);
+    if (IS_FAIL(emulator->start())) {
+        delete emulator;
+        return NULL;
+    }
+    return emulator;
+}
+
+void RPlidarEmulator::DisposeEmulator(RPlidarEmulator * emulator)
+{
+    delete emulator;
+}
+
+RPlidarEmulatorImpl::RPlidarEmulatorImpl(const RplidarEmulatorConfig & config)
+    : _config(config)
+{
+}
+
+RPlidarEmulatorImpl::~RPlidarEmulatorImpl()
+{
+    stop();
+}
+
+u_result RPlidarEmulatorImpl::start()
+{
+    u_result ans;
+    if (_config.recording && IS_FAIL(ans = _loadRecording(_config.recording))) {
+        return ans;
+    }
+
+    for (size_t pos = 0; pos < _config.device_count; ++pos) {
+        EmulatedLidar * device = new EmulatedLidar(this, pos);
+        _devices.push_back(device);
+        if (IS_FAIL(ans = device->start())) {
+            return ans;
+        }
+    }
+    return RESULT_OK;
+}
+
+void RPlidarEmulatorImpl::stop()
+{
+    for (size_t pos = 0; pos < _devices.size(); ++pos) {
+        _devices[pos]->stop();
+        delete _devices[pos];
+    }
+    _devices.clear();
+}
+
+_u16 RPlidarEmulatorImpl::getPort(size_t device)
+{
+    if (device >= _devices.size()) return 0;
+    return _devices[device]->getPort();
+}
+
+u_result RPlidarEmulatorImpl::getStats(size_t device, RplidarEmulatorStats & stats)
+{
+    if (device >= _devices.size()) return RESULT_INVALID_DATA;
+    _devices[device]->getStats(stats);
+    return RESULT_OK;
+}
+
+static bool _recordedNodeLess(const RPlidarEmulatorImpl::RecordedNode & a, const RPlidarEmulatorImpl::RecordedNode & b)
+{
+    return a.angle_z_q14 < b.angle_z_q14;
+}
+
+u_result RPlidarEmulatorImpl::_loadRecording(const char * path)
+{
+    FILE * fp = fopen(path, "rb");
+    if (!fp) return RESULT_OPERATION_FAIL;
+
+    rplidar_response_measurement_node_hq_t node;
+    std::vector<RecordedNode> revolution;
+    while (fread(&node, sizeof(node), 1, fp) == 1) {
+        if ((node.flag & RPLIDAR_RESP_HQ_FLAG_SYNCBIT) && !revolution.empty()) {
+            std::sort(revolution.begin(), revolution.end(), _recordedNodeLess);
+            _recording.push_back(revolution);
+            revolution.clear();
+        }
+        RecordedNode recorded;
+        recorded.angle_z_q14 = node.angle_z_q14;
+        recorded.dist_mm = (_u16)std::min<_u32>(node.dist_mm_q2 >> 2, 0xFFFF);
+        revolution.push_back(recorded);
+    }
+    fclose(fp);
+
+    if (!revolution.empty()) {
+        std::sort(revolution.begin(), revolution.end(), _recordedNodeLess);
+        _recording.push_back(revolution);
+    }
+    return _recording.empty() ? RESULT_INVALID_DATA : RESULT_OK;
+}
+
+const std::vector<RPlidarEmulatorImpl::RecordedNode> * RPlidarEmulatorImpl::recordedRevolution(_u64 revolution) const
+{
+    if (_recording.empty()) return NULL;
+    return &_recording[revolution % _recording.size()];
+}
+
+// ids follow RPLIDAR_CONF_SCAN_COMMAND_*
+const EmulatedLidar::Mode EmulatedLidar::MODES[EmulatedLidar::MODE_COUNT] = {
+    { RPLIDAR_ANS_TYPE_MEASUREMENT,                 "Standard" },
+    { RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED,        "Express" },
+    { RPLIDAR_ANS_TYPE_MEASUREMENT_HQ,              "HQ" },
+    { RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA,  "Boost" },
+    { RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED,  "DenseBoost" },
+};
+
+int EmulatedLidar::findMode(_u8 ansType)
+{
+    for (int pos = 0; pos < MODE_COUNT; ++pos) {
+        if (MODES[pos].ans_type == ansType) return pos;
+    }
+    return -1;
+}
+
+EmulatedLidar::EmulatedLidar(RPlidarEmulatorImpl * owner, size_t index)
+    : _owner(owner)
+    , _config(owner->config())
+    , _index(index)
+    , _port(0)
+    , _isRunning(false)
+    , _listener(NULL)
+    , _connection(NULL)
+    , _dgram(NULL)
+    , _hasClient(false)
+    , _last_due(0)
+    , _streaming(false)
+    , _stream_type(0)
+    , _first_frame(false)
+    , _frequency(owner->config().scan_frequency)
+    , _phase(0.5 * owner->config().scan_frequency / owner->config().sample_rate)
+    , _revolution(0)
+    , _sample_index(0)
+    , _next_frame_us(0)
+    , _packet_frames(0)
+    , _seed(0x9E3779B9u ^ (_u32)(index * 2654435761u))
+{
+    // starting half a sample in keeps the frames off exact multiples of 360 degree, where the
+    // truncated angle steps of the decoder miss the sync
+    memset(&_stats, 0, sizeof(_stats));
+    if (!_seed) _seed = 1;
+}
+
+EmulatedLidar::~EmulatedLidar()
+{
+    stop();
+}
+
+u_result EmulatedLidar::start()
+{
+    u_result ans;
+    if (IS_FAIL(ans = _bindPort())) return ans;
+
+    _isRunning = true;
+    _thread = CLASS_THREAD(EmulatedLidar, _proc);
+    return RESULT_OK;
+}
+
+void EmulatedLidar::stop()
+{
+    if (_isRunning) {
+        _isRunning = false;
+        _thread.join();
+    }
+
+    _closeConnection();
+    if (_listener) {
+        _listener->dispose();
+        _listener = NULL;
+    }
+    if (_dgram) {
+        _dgram->dispose();
+        _dgram = NULL;
+    }
+}
+
+void EmulatedLidar::getStats(RplidarEmulatorStats & stats)
+{
+    rp::hal::AutoLocker l(_statsLock);
+    stats = _stats;
+}
+
+u_result EmulatedLidar::_bindPort()
+{
+    rp::net::SocketAddress addr;
+    addr.setAnyAddress();
+    addr.setPort(_config.base_port ? (int)(_config.base_port + _index) : 0);
+
+    rp::net::SocketBase * socket;
+    if (_config.transport == DRIVER_TYPE_TCP) {
+        _listener = rp::net::StreamSocket::CreateSocket();
+        if (!_listener) return RESULT_OPERATION_FAIL;
+        if (IS_FAIL(_listener->bind(addr)) || IS_FAIL(_listener->listen())) return RESULT_OPERATION_FAIL;
+        socket = _listener;
+    } else {
+        _dgram = rp::net::DGramSocket::CreateSocket();
+        if (!_dgram) return RESULT_OPERATION_FAIL;
+        if (IS_FAIL(_dgram->bind(addr))) return RESULT_OPERATION_FAIL;
+        socket = _dgram;
+    }
+
+    rp::net::SocketAddress local;
+    if (IS_FAIL(socket->getLocalAddress(local))) return RESULT_OPERATION_FAIL;
+    _port = (_u16)local.getPort();
+    return RESULT_OK;
+}
+
+void EmulatedLidar::_closeConnection()
+{
+    if (_connection) {
+        _connection->dispose();
+        _connection = NULL;
+    }
+    _cmdbuf.clear();
+    _stopStream();
+}
+
+u_result EmulatedLidar::_proc()
+{
+    while (_isRunning) {
+        _u64 now = getus();
+        _produceFrames(now);
+        _flushPackets(now);
+
+        // sleep until the next frame or packet is due, the waits have ms granularity
+        _u64 wakeup = now + IDLE_WAIT * 1000;
+        if (_streaming && (_u64)_next_frame_us < wakeup) wakeup = (_u64)_next_frame_us;
+        if (!_packets.empty() && _packets.begin()->first < wakeup) wakeup = _packets.begin()->first;
+        _u32 timeout = (wakeup > now) ? (_u32)((wakeup - now + 999) / 1000) : 0;
+
+        if (_receive(timeout)) {
+            _parseCommands();
+        }
+    }
+    return RESULT_OK;
+}
+
+bool EmulatedLidar::_receive(_u32 timeout)
+{
+    _u8 buffer[RECV_BUFFER_SIZE];
+    size_t recvSize = 0;
+
+    if (_listener) {
+        // a new client takes over from the previous one
+        if (IS_OK(_listener->waitforIncomingConnection(_connection ? 0 : timeout))) {
+            rp::net::StreamSocket * connection = _listener->accept();
+            if (connection) {
+                _closeConnection();
+                _connection = connection;
+                _last_due = 0;
+                rp::hal::AutoLocker l(_statsLock);
+                _stats.connections++;
+            }
+            return false;
+        }
+        if (!_connection || IS_FAIL(_connection->waitforData(timeout))) return false;
+
+        if (IS_FAIL(_connection->recvNoWait(buffer, sizeof(buffer), recvSize))) {
+            _closeConnection();
+            return false;
+        }
+    } else {
+        if (IS_FAIL(_dgram->waitforData(timeout))) return false;
+
+        rp::net::SocketAddress source;
+        if (IS_FAIL(_dgram->recvFrom(buffer, sizeof(buffer), recvSize, &source))) return false;
+
+        char sourceName[64], clientName[64];
+        source.getAddressAsString(sourceName, sizeof(sourceName));
+        _client.getAddressAsString(clientName, sizeof(clientName));
+        if (!_hasClient || source.getPort() != _client.getPort() || strcmp(sourceName, clientName)) {
+            _client = source;
+            _hasClient = true;
+            _cmdbuf.clear();
+            rp::hal::AutoLocker l(_statsLock);
+            _stats.connections++;
+        }
+    }
+
+    _cmdbuf.insert(_cmdbuf.end(), buffer, buffer + recvSize);
+    return recvSize != 0;
+}
+
+void EmulatedLidar::_parseCommands()
+{
+    size_t size = _cmdbuf.size();
+    size_t pos = 0;
+
+    while (pos < size) {
+        const _u8 * pkt = &_cmdbuf[pos];
+        size_t remain = size - pos;
+
+        if (pkt[0] != RPLIDAR_CMD_SYNC_BYTE) {
+            ++pos;
+            continue;
+        }
+        if (remain < 2) break;
+
+        _u8 cmd = pkt[1];
+        if (!(cmd & RPLIDAR_CMDFLAG_HAS_PAYLOAD)) {
+            _handleCommand(cmd, NULL, 0);
+            pos += 2;
+            continue;
+        }
+
+        if (remain < 3) break;
+        size_t payloadSize = pkt[2];
+        if (remain < 4 + payloadSize) break;
+
+        _u8 checksum = 0;
+        for (size_t cpos = 0; cpos < 3 + payloadSize; ++cpos) {
+            checksum ^= pkt[cpos];
+        }
+        if (checksum != pkt[3 + payloadSize]) {
+            ++pos;
+            continue;
+        }
+
+        _handleCommand(cmd, pkt + 3, payloadSize);
+        pos += 4 + payloadSize;
+    }
+
+    _cmdbuf.erase(_cmdbuf.begin(), _cmdbuf.begin() + pos);
+}
+
+void EmulatedLidar::_handleCommand(_u8 cmd, const _u8 * payload, size_t size)
+{
+    switch (cmd) {
+    case RPLIDAR_CMD_STOP:
+    case RPLIDAR_CMD_RESET:
+        _stopStream();
+        break;
+
+    case RPLIDAR_CMD_SCAN:
+    case RPLIDAR_CMD_FORCE_SCAN:
+        _startStream(RPLIDAR_CONF_SCAN_COMMAND_STD);
+        break;
+
+    case RPLIDAR_CMD_EXPRESS_SCAN:
+        {
+            if (size < sizeof(rplidar_payload_express_scan_t)) return;
+            rplidar_payload_express_scan_t req;
+            memcpy(&req, payload, sizeof(req));
+
+            // the plain express mode is asked for with working mode 0
+            int mode = req.working_mode ? req.working_mode : RPLIDAR_CONF_SCAN_COMMAND_EXPRESS;
+            if (mode >= MODE_COUNT) return;
+            _startStream(mode);
+        }
+        break;
+
+    case RPLIDAR_CMD_HQ_SCAN:
+        _startStream(RPLIDAR_CONF_SCAN_COMMAND_HQ);
+        break;
+
+    case RPLIDAR_CMD_GET_DEVICE_INFO:
+        {
+            rplidar_response_device_info_t info;
+            info.model = 0x61;
+            info.firmware_version = (0x1 << 8) | 29;
+            info.hardware_version = 18;
+            for (size_t pos = 0; pos < sizeof(info.serialnum); ++pos) {
+                info.serialnum[pos] = (pos < 8) ? (_u8)(0xE0 + pos) : (_u8)(_index >> ((15 - pos) * 8));
+            }
+            _answer(RPLIDAR_ANS_TYPE_DEVINFO, &info, sizeof(info));
+        }
+        break;
+
+    case RPLIDAR_CMD_GET_DEVICE_HEALTH:
+        {
+            rplidar_response_device_health_t health;
+            health.status = RPLIDAR_STATUS_OK;
+            health.error_code = 0;
+            _answer(RPLIDAR_ANS_TYPE_DEVHEALTH, &health, sizeof(health));
+        }
+        break;
+
+    case RPLIDAR_CMD_GET_SAMPLERATE:
+        {
+            rplidar_response_sample_rate_t rate;
+            rate.std_sample_duration_us = (_u16)(1000000 / _config.sample_rate);
+            rate.express_sample_duration_us = rate.std_sample_duration_us;
+            _answer(RPLIDAR_ANS_TYPE_SAMPLE_RATE, &rate, sizeof(rate));
+        }
+        break;
+
+    case RPLIDAR_CMD_GET_ACC_BOARD_FLAG:
+        {
+            // the motor of a network lidar runs on its own
+            rplidar_response_acc_board_flag_t flag;
+            flag.support_flag = 0;
+            _answer(RPLIDAR_ANS_TYPE_ACC_BOARD_FLAG, &flag, sizeof(flag));
+        }
+        break;
+
+    case RPLIDAR_CMD_GET_LIDAR_CONF:
+        _handleGetConf(payload, size);
+        break;
+
+    case RPLIDAR_CMD_SET_LIDAR_CONF:
+        _handleSetConf(payload, size);
+        break;
+
+    case RPLIDAR_CMD_SET_MOTOR_PWM:
+    case RPLIDAR_CMD_HQ_MOTOR_SPEED_CTRL:
+        break;
+
+    default:
+        return;
+    }
+
+    rp::hal::AutoLocker l(_statsLock);
+    _stats.commands++;
+}
+
+void EmulatedLidar::_handleGetConf(const _u8 * payload, size_t size)
+{
+    rplidar_payload_get_scan_conf_t query;
+    if (size < sizeof(query.type)) return;
+    memset(&query, 0, sizeof(query));
+    memcpy(&query, payload, std::min(size, sizeof(query)));
+
+    _u16 modeId;
+    memcpy(&modeId, query.reserved, sizeof(modeId));
+    if (modeId >= MODE_COUNT) modeId = 0;
+    const Mode & mode = MODES[modeId];
+
+    std::vector<_u8> answer(sizeof(query.type));
+    memcpy(&answer[0], &query.type, sizeof(query.type));
+
+    _u16 u16Value;
+    _u32 u32Value;
+    const void * value;
+    size_t valueSize;
+
+    switch (query.type) {
+    case RPLIDAR_CONF_SCAN_MODE_COUNT:
+        u16Value = MODE_COUNT;
+        value = &u16Value; valueSize = sizeof(u16Value);
+        break;
+    case RPLIDAR_CONF_SCAN_MODE_TYPICAL:
+        u16Value = (_u16)findMode(_config.ans_type);
+        value = &u16Value; valueSize = sizeof(u16Value);
+        break;
+    case RPLIDAR_CONF_SCAN_MODE_US_PER_SAMPLE:
+        u32Value = (_u32)(1000000.0 / _config.sample_rate * 256);
+        value = &u32Value; valueSize = sizeof(u32Value);
+        break;
+    case RPLIDAR_CONF_SCAN_MODE_MAX_DISTANCE:
+        u32Value = 40 << 8;
+        value = &u32Value; valueSize = sizeof(u32Value);
+        break;
+    case RPLIDAR_CONF_SCAN_MODE_ANS_TYPE:
+        value = &mode.ans_type; valueSize = sizeof(mode.ans_type);
+        break;
+    case RPLIDAR_CONF_SCAN_MODE_NAME:
+        value = mode.name; valueSize = strlen(mode.name) + 1;
+        break;
+    case RPLIDAR_CONF_MIN_ROT_FREQ:
+        u16Value = MIN_ROT_RPM;
+        value = &u16Value; valueSize = sizeof(u16Value);
+        break;
+    case RPLIDAR_CONF_MAX_ROT_FREQ:
+        u16Value = MAX_ROT_RPM;
+        value = &u16Value; valueSize = sizeof(u16Value);
+        break;
+    case RPLIDAR_CONF_DESIRED_ROT_FREQ:
+        u16Value = (_u16)(_frequency * 60.0f + 0.5f);
+        value = &u16Value; valueSize = sizeof(u16Value);
+        break;
+    default:
+        // unknown types are answered with the type alone
+        value = NULL; valueSize = 0;
+        break;
+    }
+
+    answer.insert(answer.end(), (const _u8 *)value, (const _u8 *)value + valueSize);
+    _answer(RPLIDAR_ANS_TYPE_GET_LIDAR_CONF, &answer[0], answer.size());
+}
+
+void EmulatedLidar::_handleSetConf(const _u8 * payload, size_t size)
+{
+    _u32 type;
+    if (size < sizeof(type)) return;
+    memcpy(&type, payload, sizeof(type));
+
+    rplidar_response_set_lidar_conf_t reply;
+    reply.result = 1;
+
+    if (type == RPLIDAR_CONF_DESIRED_ROT_FREQ && size >= sizeof(type) + sizeof(_u16)) {
+        _u16 rpm;
+        memcpy(&rpm, payload + sizeof(type), sizeof(rpm));
+        if (rpm >= MIN_ROT_RPM && rpm <= MAX_ROT_RPM) {
+            _frequency = rpm / 60.0f;
+            reply.result = 0;
+        }
+    }
+
+    _u8 answer[sizeof(type) + sizeof(reply)];
+    memcpy(answer, &type, sizeof(type));
+    memcpy(answer + sizeof(type), &reply, sizeof(reply));
+    _answer(RPLIDAR_ANS_TYPE_SET_LIDAR_CONF, answer, sizeof(answer));
+}
+
+void EmulatedLidar::_answer(_u8 type, const void * payload, size_t size, _u32 subtype)
+{
+    std::vector<_u8> data(sizeof(rplidar_ans_header_t));
+    rplidar_ans_header_t * header = reinterpret_cast<rplidar_ans_header_t *>(&data[0]);
+    header->syncByte1 = RPLIDAR_ANS_SYNC_BYTE1;
+    header->syncByte2 = RPLIDAR_ANS_SYNC_BYTE2;
+    header->size_q30_subtype = (_u32)size | (subtype << RPLIDAR_ANS_HEADER_SUBTYPE_SHIFT);
+    header->type = type;
+
+    // a scan answer is the header alone, the frames follow
+    if (payload) data.insert(data.end(), (const _u8 *)payload, (const _u8 *)payload + size);
+
+    _queuePacket(data, getus() + _config.latency_us, false);
+}
+
+void EmulatedLidar::_startStream(int mode)
+{
+    _stopStream();
+
+    _stream_type = MODES[mode].ans_type;
+    _streaming = true;
+    _first_frame = true;
+    _pending.clear();
+    _packet.clear();
+    _packet_frames = 0;
+
+    size_t frameSize;
+    switch (_stream_type) {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        frameSize = sizeof(rplidar_response_measurement_node_t);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+        frameSize = sizeof(rplidar_response_capsule_measurement_nodes_t);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        frameSize = sizeof(rplidar_response_hq_capsule_measurement_nodes_t);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:
+        frameSize = sizeof(rplidar_response_ultra_capsule_measurement_nodes_t);
+        break;
+    default:
+        frameSize = sizeof(rplidar_response_dense_capsule_measurement_nodes_t);
+        break;
+    }
+    _answer(_stream_type, NULL, frameSize, 1);
+
+    _next_frame_us = (double)getus() + _frameSamples() * 1000000.0 / _config.sample_rate;
+}
+
+void EmulatedLidar::_stopStream()
+{
+    _streaming = false;
+
+    // answers already queued still go out
+    for (std::multimap<_u64, Packet>::iterator itr = _packets.begin(); itr != _packets.end(); ) {
+        if (itr->second.stream) {
+            _packets.erase(itr++);
+        } else {
+            ++itr;
+        }
+    }
+}
+
+size_t EmulatedLidar::_frameSamples() const
+{
+    switch (_stream_type) {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:                  return 1;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:         return 32;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:               return 16;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:   return 96;
+    default:                                            return 40;
+    }
+}
+
+void EmulatedLidar::_produceFrames(_u64 now)
+{
+    if (!_streaming) return;
+
+    // after a stall the lidar has moved on, the frames in between are lost
+    if (now > _next_frame_us + MAX_CATCH_UP_US) {
+        _next_frame_us = (double)now;
+    }
+
+    double frameUs = _frameSamples() * 1000000.0 / _config.sample_rate;
+    while (_next_frame_us <= (double)now) {
+        _encodeFrame(_packet);
+        _next_frame_us += frameUs;
+
+        if (++_packet_frames >= _config.frames_per_packet) {
+            _u64 due = (_u64)_next_frame_us + _config.latency_us;
+            if (_config.jitter_us) due += _random() % (_config.jitter_us + 1);
+            _queuePacket(_packet, due, true);
+            _packet.clear();
+            _packet_frames = 0;
+        }
+    }
+}
+
+void EmulatedLidar::_fillSamples(size_t count)
+{
+    while (_pending.size() < count) {
+        _u64 revolution = (_u64)_phase;
+
+        Sample sample;
+        sample.angle = (float)((_phase - revolution) * 360.0);
+        sample.sync = (revolution != _revolution) || (_sample_index == 0);
+        sample.dist_mm = _distanceAt(revolution, sample.angle);
+        _pending.push_back(sample);
+
+        _revolution = revolution;
+        _phase += (double)_frequency / _config.sample_rate;
+        ++_sample_index;
+    }
+}
+
+_u16 EmulatedLidar::_distanceAt(_u64 revolution, float angle)
+{
+    const std::vector<RPlidarEmulatorImpl::RecordedNode> * recorded = _owner->recordedRevolution(revolution);
+    if (recorded) {
+        // the nearest recorded node at or after the angle
+        RPlidarEmulatorImpl::RecordedNode key;
+        key.angle_z_q14 = (_u16)(angle * 16384.0f / 90.0f);
+        key.dist_mm = 0;
+        std::vector<RPlidarEmulatorImpl::RecordedNode>::const_iterator itr = std::lower_bound(recorded->begin(), recorded->end(), key, _recordedNodeLess);
+        if (itr == recorded->end()) itr = recorded->begin();
+        return itr->dist_mm;
+    }
+
+    double rad = angle * PI / 180.0;
+    double dx = cos(rad), dy = sin(rad);
+
+    double dist = 1e9;
+    if (fabs(dx) > 1e-6) dist = std::min(dist, ROOM_HALF_X_MM / fabs(dx));
+    if (fabs(dy) > 1e-6) dist = std::min(dist, ROOM_HALF_Y_MM / fabs(dy));
+
+    // ray and circle
+    double seconds = (double)_sample_index / _config.sample_rate;
+    double orbit = 2 * PI * PILLAR_ORBIT_HZ * seconds;
+    double cx = PILLAR_ORBIT_MM * cos(orbit), cy = PILLAR_ORBIT_MM * sin(orbit);
+    double along = dx * cx + dy * cy;
+    double disc = along * along - (cx * cx + cy * cy) + PILLAR_RADIUS_MM * PILLAR_RADIUS_MM;
+    if (disc >= 0 && along - sqrt(disc) > 0) {
+        dist = std::min(dist, along - sqrt(disc));
+    }
+
+    dist += (double)(_random() % (2 * NOISE_MM + 1)) - NOISE_MM;
+    return (_u16)std::min(dist, 65535.0);
+}
+
+static _u32 _varbitscale_encode(_u32 dist, _u32 & scaleLevel)
+{
+    if (dist >= (0x1 << RPLIDAR_VARBITSCALE_X16_SRC_BIT)) {
+        scaleLevel = 4;
+        return std::min<_u32>(RPLIDAR_VARBITSCALE_X16_DEST_VAL + ((dist - (0x1 << RPLIDAR_VARBITSCALE_X16_SRC_BIT)) >> 4), 0xFFF);
+    }
+    if (dist >= (0x1 << RPLIDAR_VARBITSCALE_X8_SRC_BIT)) {
+        scaleLevel = 3;
+        return RPLIDAR_VARBITSCALE_X8_DEST_VAL + ((dist - (0x1 << RPLIDAR_VARBITSCALE_X8_SRC_BIT)) >> 3);
+    }
+    if (dist >= (0x1 << RPLIDAR_VARBITSCALE_X4_SRC_BIT)) {
+        scaleLevel = 2;
+        return RPLIDAR_VARBITSCALE_X4_DEST_VAL + ((dist - (0x1 << RPLIDAR_VARBITSCALE_X4_SRC_BIT)) >> 2);
+    }
+    if (dist >= (0x1 << RPLIDAR_VARBITSCALE_X2_SRC_BIT)) {
+        scaleLevel = 1;
+        return RPLIDAR_VARBITSCALE_X2_DEST_VAL + ((dist - (0x1 << RPLIDAR_VARBITSCALE_X2_SRC_BIT)) >> 1);
+    }
+    scaleLevel = 0;
+    return dist;
+}
+
+// the distance the decoder gets back from an encoded major
+static _u32 _varbitscale_value(_u32 dist)
+{
+    _u32 scaleLevel;
+    _u32 scaled = _varbitscale_encode(dist, scaleLevel);
+    switch (scaleLevel) {
+    case 4: return (0x1 << RPLIDAR_VARBITSCALE_X16_SRC_BIT) + ((scaled - RPLIDAR_VARBITSCALE_X16_DEST_VAL) << 4);
+    case 3: return (0x1 << RPLIDAR_VARBITSCALE_X8_SRC_BIT) + ((scaled - RPLIDAR_VARBITSCALE_X8_DEST_VAL) << 3);
+    case 2: return (0x1 << RPLIDAR_VARBITSCALE_X4_SRC_BIT) + ((scaled - RPLIDAR_VARBITSCALE_X4_DEST_VAL) << 2);
+    case 1: return (0x1 << RPLIDAR_VARBITSCALE_X2_SRC_BIT) + ((scaled - RPLIDAR_VARBITSCALE_X2_DEST_VAL) << 1);
+    default: return scaled;
+    }
+}
+
+// 10 bit signed difference to base, 0x1FF marks a sample without distance
+static _u32 _ultra_predict(_u32 dist, _u32 base, _u32 scaleLevel)
+{
+    if (!dist) return 0x1FF;
+    int predict = ((int)dist - (int)base) >> scaleLevel;
+    if (predict < -511 || predict > 510) return 0x1FF;
+    return (_u32)predict & 0x3FF;
+}
+
+static void _capsule_checksum(_u8 * frame, size_t size)
+{
+    _u8 checksum = 0;
+    for (size_t pos = 2; pos < size; ++pos) {
+        checksum ^= frame[pos];
+    }
+    frame[0] = (RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1 << 4) | (checksum & 0xF);
+    frame[1] = (RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2 << 4) | (checksum >> 4);
+}
+
+void EmulatedLidar::_encodeFrame(std::vector<_u8> & packet)
+{
+    size_t count = _frameSamples();
+
+    // a boost frame predicts its last samples from the first one of the next frame
+    _fillSamples(_stream_type == RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA ? count + 1 : count);
+    const Sample * samples = &_pending[0];
+
+    _u16 startAngle_q6 = (_u16)(samples[0].angle * 64.0f);
+    _u16 startAngleSync = startAngle_q6 | (_first_frame ? RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT : 0);
+    _first_frame = false;
+
+    size_t offset = packet.size();
+    switch (_stream_type) {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        {
+            rplidar_response_measurement_node_t node;
+            _u16 dist = std::min<_u16>(samples[0].dist_mm, 0x3FFF);
+            node.sync_quality = (samples[0].sync ? RPLIDAR_RESP_MEASUREMENT_SYNCBIT : 0x2)
+                | ((dist ? QUALITY : 0) << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
+            node.angle_q6_checkbit = (startAngle_q6 << RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) | RPLIDAR_RESP_MEASUREMENT_CHECKBIT;
+            node.distance_q2 = dist << 2;
+            packet.resize(offset + sizeof(node));
+            memcpy(&packet[offset], &node, sizeof(node));
+        }
+        break;
+
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+        {
+            rplidar_response_capsule_measurement_nodes_t capsule;
+            capsule.start_angle_sync_q6 = startAngleSync;
+            for (size_t pos = 0; pos < _countof(capsule.cabins); ++pos) {
+                capsule.cabins[pos].distance_angle_1 = std::min<_u16>(samples[pos * 2].dist_mm, 0x3FFF) << 2;
+                capsule.cabins[pos].distance_angle_2 = std::min<_u16>(samples[pos * 2 + 1].dist_mm, 0x3FFF) << 2;
+                capsule.cabins[pos].offset_angles_q3 = 0;
+            }
+            _capsule_checksum((_u8 *)&capsule, sizeof(capsule));
+            packet.resize(offset + sizeof(capsule));
+            memcpy(&packet[offset], &capsule, sizeof(capsule));
+        }
+        break;
+
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        {
+            rplidar_response_dense_capsule_measurement_nodes_t capsule;
+            capsule.start_angle_sync_q6 = startAngleSync;
+            for (size_t pos = 0; pos < _countof(capsule.cabins); ++pos) {
+                capsule.cabins[pos].distance = samples[pos].dist_mm;
+            }
+            _capsule_checksum((_u8 *)&capsule, sizeof(capsule));
+            packet.resize(offset + sizeof(capsule));
+            memcpy(&packet[offset], &capsule, sizeof(capsule));
+        }
+        break;
+
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:
+        {
+            rplidar_response_ultra_capsule_measurement_nodes_t capsule;
+            float angle = samples[0].angle + ULTRA_ANGLE_OFFSET;
+            if (angle >= 360.0f) angle -= 360.0f;
+            capsule.start_angle_sync_q6 = (_u16)(angle * 64.0f) | (startAngleSync & RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT);
+
+            for (size_t pos = 0; pos < _countof(capsule.ultra_cabins); ++pos) {
+                const Sample * cabin = samples + pos * 3;
+                _u32 scaleLevel1, scaleLevel2;
+                _u32 major = _varbitscale_encode(cabin[0].dist_mm, scaleLevel1);
+                _u32 base1 = _varbitscale_value(cabin[0].dist_mm);
+                _u32 base2 = _varbitscale_value(cabin[3].dist_mm);
+                _varbitscale_encode(cabin[3].dist_mm, scaleLevel2);
+
+                // the decoder falls back to the next major when this one is empty
+                if (!base1) {
+                    base1 = base2;
+                    scaleLevel1 = scaleLevel2;
+                }
+
+                capsule.ultra_cabins[pos].combined_x3 = major
+                    | (_ultra_predict(cabin[1].dist_mm, base1, scaleLevel1) << RPLIDAR_RESP_MEASUREMENT_EXP_ULTRA_MAJOR_BITS)
+                    | (_ultra_predict(cabin[2].dist_mm, base2, scaleLevel2) << (RPLIDAR_RESP_MEASUREMENT_EXP_ULTRA_MAJOR_BITS + RPLIDAR_RESP_MEASUREMENT_EXP_ULTRA_PREDICT_BITS));
+            }
+            _capsule_checksum((_u8 *)&capsule, sizeof(capsule));
+            packet.resize(offset + sizeof(capsule));
+            memcpy(&packet[offset], &capsule, sizeof(capsule));
+        }
+        break;
+
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        {
+            rplidar_response_hq_capsule_measurement_nodes_t capsule;
+            capsule.sync_byte = RPLIDAR_RESP_MEASUREMENT_HQ_SYNC;
+            capsule.time_stamp = getus();
+            for (size_t pos = 0; pos < _countof(capsule.node_hq); ++pos) {
+                rplidar_response_measurement_node_hq_t & node = capsule.node_hq[pos];
+                node.angle_z_q14 = (_u16)(samples[pos].angle * 16384.0f / 90.0f);
+                node.dist_mm_q2 = (_u32)samples[pos].dist_mm << 2;
+                node.quality = samples[pos].dist_mm ? (QUALITY << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
+                node.flag = samples[pos].sync ? RPLIDAR_RESP_HQ_FLAG_SYNCBIT : 0;
+            }
+            capsule.crc32 = _crc32((_u8 *)&capsule, sizeof(capsule) - sizeof(capsule.crc32));
+            packet.resize(offset + sizeof(capsule));
+            memcpy(&packet[offset], &capsule, sizeof(capsule));
+        }
+        break;
+    }
+
+    _pending.erase(_pending.begin(), _pending.begin() + count);
+}
+
+void EmulatedLidar::_queuePacket(std::vector<_u8> & data, _u64 due, bool stream)
+{
+    // a stream keeps its order, only datagrams overtake each other
+    if (_config.transport == DRIVER_TYPE_TCP) {
+        if (due < _last_due) due = _last_due;
+        _last_due = due;
+    }
+
+    std::multimap<_u64, Packet>::iterator itr = _packets.insert(std::make_pair(due, Packet()));
+    itr->second.stream = stream;
+    itr->second.data.swap(data);
+}
+
+void EmulatedLidar::_flushPackets(_u64 now)
+{
+    while (!_packets.empty() && _packets.begin()->first <= now) {
+        Packet packet;
+        packet.stream = _packets.begin()->second.stream;
+        packet.data.swap(_packets.begin()->second.data);
+        _packets.erase(_packets.begin());
+
+        if (packet.stream && _config.loss_rate > 0 && _random() < (_u32)(_config.loss_rate * 4294967295.0)) {
+            rp::hal::AutoLocker l(_statsLock);
+            _stats.packets_dropped++;
+            continue;
+        }
+
+        if (_transmit(packet.data)) {
+            rp::hal::AutoLocker l(_statsLock);
+            _stats.packets_sent++;
+            _stats.bytes_sent += packet.data.size();
+        }
+    }
+}
+
+bool EmulatedLidar::_transmit(const std::vector<_u8> & data)
+{
+    if (_connection) {
+        if (IS_FAIL(_connection->send(&data[0], data.size()))) {
+            _closeConnection();
+            return false;
+        }
+        return true;
+    }
+    if (_dgram && _hasClient) {
+        return IS_OK(_dgram->sendTo(_client, &data[0], data.size()));
+    }
+    return false;
+}
+
+_u32 EmulatedLidar::_random()
+{
+    // xorshift32
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+}
+
+}}}
@@ -0,0 +1,171 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <map>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+class RPlidarEmulatorImpl;
+
+// one emulated lidar, served by its own thread
+class EmulatedLidar
+{
+public:
+    enum {
+        IDLE_WAIT           = 10,       // ms, the longest the thread blocks before looking at _isRunning
+        RECV_BUFFER_SIZE    = 2048,
+        MODE_COUNT          = 5,
+    };
+
+    struct Mode {
+        _u8             ans_type;
+        const char *    name;
+    };
+    static const Mode MODES[MODE_COUNT];
+
+    // the id of the mode streaming ansType, -1 if there is none
+    static int findMode(_u8 ansType);
+
+    EmulatedLidar(RPlidarEmulatorImpl * owner, size_t index);
+    ~EmulatedLidar();
+
+    u_result start();
+    void     stop();
+    _u16     getPort() const { return _port; }
+    void     getStats(RplidarEmulatorStats & stats);
+
+protected:
+    struct Sample {
+        float   angle;          // degree
+        _u16    dist_mm;
+        bool    sync;           // first sample of a revolution
+    };
+
+    struct Packet {
+        bool                stream;     // scan data, may be dropped. answers never are
+        std::vector<_u8>    data;
+    };
+
+    u_result _proc();
+    u_result _bindPort();
+    void     _closeConnection();
+    bool     _receive(_u32 timeout);
+    void     _parseCommands();
+    void     _handleCommand(_u8 cmd, const _u8 * payload, size_t size);
+    void     _handleGetConf(const _u8 * payload, size_t size);
+    void     _handleSetConf(const _u8 * payload, size_t size);
+    void     _answer(_u8 type, const void * payload, size_t size, _u32 subtype = 0);
+    void     _startStream(int mode);
+    void     _stopStream();
+
+    void     _produceFrames(_u64 now);
+    size_t   _frameSamples() const;
+    void     _fillSamples(size_t count);
+    _u16     _distanceAt(_u64 revolution, float angle);
+    void     _encodeFrame(std::vector<_u8> & packet);
+
+    void     _queuePacket(std::vector<_u8> & data, _u64 due, bool stream);
+    void     _flushPackets(_u64 now);
+    bool     _transmit(const std::vector<_u8> & data);
+    _u32     _random();
+
+    RPlidarEmulatorImpl *           _owner;
+    const RplidarEmulatorConfig &   _config;
+    size_t                          _index;
+    _u16                            _port;
+    volatile bool                   _isRunning;
+    rp::hal::Thread                 _thread;
+
+    rp::net::StreamSocket *         _listener;      // TCP
+    rp::net::StreamSocket *         _connection;
+    rp::net::DGramSocket *          _dgram;         // UDP
+    rp::net::SocketAddress          _client;
+    bool                            _hasClient;
+
+    std::vector<_u8>                _cmdbuf;
+    std::multimap<_u64, Packet>     _packets;       // by due time
+    _u64                            _last_due;
+
+    // the scan being streamed
+    bool                            _streaming;
+    _u8                             _stream_type;
+    bool                            _first_frame;
+    float                           _frequency;
+    double                          _phase;         // revolutions since the device started
+    _u64                            _revolution;
+    _u64                            _sample_index;
+    double                          _next_frame_us;
+    std::vector<Sample>             _pending;       // generated ahead, boost frames need the next sample
+    std::vector<_u8>                _packet;
+    size_t                          _packet_frames;
+    _u32                            _seed;
+
+    rp::hal::Locker                 _statsLock;
+    RplidarEmulatorStats            _stats;
+};
+
+class RPlidarEmulatorImpl : public RPlidarEmulator
+{
+public:
+    struct RecordedNode {
+        _u16    angle_z_q14;
+        _u16    dist_mm;
+    };
+
+    RPlidarEmulatorImpl(const RplidarEmulatorConfig & config);
+    virtual ~RPlidarEmulatorImpl();
+
+    u_result start();
+    void     stop();
+
+    virtual _u16 getPort(size_t device);
+    virtual u_result getStats(size_t device, RplidarEmulatorStats & stats);
+
+    const RplidarEmulatorConfig & config() const { return _config; }
+
+    // revolution n % count of the recording sorted by angle, NULL without a recording
+    const std::vector<RecordedNode> * recordedRevolution(_u64 revolution) const;
+
+protected:
+    u_result _loadRecording(const char * path);
+
+    RplidarEmulatorConfig                       _config;
+    std::vector<EmulatedLidar *>                _devices;
+    std::vector<std::vector<RecordedNode> >     _recording;
+};
+
+}}}
@@ -0,0 +1,254 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/types.h"
+#include "hal/locker.h"
+#include "rplidar_profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// The cache never leaves the machine, so the records are written in native layout. A build
+// with a different RplidarScanMode layout sees a mode_size mismatch and starts a new file.
+namespace {
+
+enum {
+    PROFILE_FILE_MAGIC   = 0x50434c52,  // "RLCP"
+    PROFILE_FILE_VERSION = 2,
+    MAX_PROFILE_MODES    = 64,
+    MAX_PROFILE_COUNT    = 256,
+};
+
+struct ProfileFileHeader {
+    _u32    magic;
+    _u32    version;
+    _u32    mode_size;
+    _u32    count;
+};
+
+struct ProfileRecord {
+    rplidar_response_device_info_t  devinfo;
+    _u8     conf_supported;
+    _u8     reserved;
+    _u16    typical_mode;
+    _u16    mode_count;
+};
+
+// several drivers of one process share the file
+rp::hal::Locker s_fileLock;
+
+bool readProfiles(const char * path, std::vector<RplidarCapabilityProfile> & profiles)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file) return false;
+
+    ProfileFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == PROFILE_FILE_MAGIC
+        && header.version == PROFILE_FILE_VERSION
+        && header.mode_size == sizeof(RplidarScanMode)
+        && header.count <= MAX_PROFILE_COUNT;
+
+    for (_u32 pos = 0; ok && pos < header.count; ++pos) {
+        ProfileRecord record;
+        if (fread(&record, sizeof(record), 1, file) != 1 || record.mode_count > MAX_PROFILE_MODES) {
+            ok = false;
+            break;
+        }
+
+        RplidarCapabilityProfile profile;
+        profile.devinfo = record.devinfo;
+        profile.conf_supported = record.conf_supported != 0;
+        profile.typical_mode = record.typical_mode;
+        profile.modes.resize(record.mode_count);
+        if (record.mode_count && fread(&profile.modes[0], sizeof(RplidarScanMode), record.mode_count, file) != record.mode_count) {
+            ok = false;
+            break;
+        }
+        profiles.push_back(profile);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+// creates a file of its own next to path, processes saving at the same time never share one
+FILE * openTempFile(const char * path, std::string & tmpPath)
+{
+    static const char pattern[] = ".XXXXXX";
+    std::vector<char> name(path, path + strlen(path));
+    name.insert(name.end(), pattern, pattern + sizeof(pattern));
+
+    FILE * file = NULL;
+#ifdef _WIN32
+    int fd;
+    if (_mktemp_s(&name[0], name.size()) != 0) return NULL;
+    if (_sopen_s(&fd, &name[0], _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0) return NULL;
+    file = _fdopen(fd, "wb");
+    if (!file) _close(fd);
+#else
+    int fd = mkstemp(&name[0]);
+    if (fd < 0) return NULL;
+    file = fdopen(fd, "wb");
+    if (!file) close(fd);
+#endif
+    if (!file) {
+        remove(&name[0]);
+        return NULL;
+    }
+    tmpPath = &name[0];
+    return file;
+}
+
+bool writeProfiles(const char * path, const std::vector<RplidarCapabilityProfile> & profiles)
+{
+    // write a new file and swap it in, a crash halfway never leaves a torn cache behind
+    std::string tmpPath;
+    FILE * file = openTempFile(path, tmpPath);
+    if (!file) return false;
+
+    ProfileFileHeader header;
+    header.magic = PROFILE_FILE_MAGIC;
+    header.version = PROFILE_FILE_VERSION;
+    header.mode_size = sizeof(RplidarScanMode);
+    header.count = (_u32)profiles.size();
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (size_t pos = 0; ok && pos < profiles.size(); ++pos) {
+        const RplidarCapabilityProfile & profile = profiles[pos];
+
+        ProfileRecord record;
+        memset(&record, 0, sizeof(record));
+        record.devinfo = profile.devinfo;
+        record.conf_supported = profile.conf_supported ? 1 : 0;
+        record.typical_mode = profile.typical_mode;
+        record.mode_count = (_u16)profile.modes.size();
+
+        ok = fwrite(&record, sizeof(record), 1, file) == 1;
+        if (ok && record.mode_count) {
+            ok = fwrite(&profile.modes[0], sizeof(RplidarScanMode), record.mode_count, file) == record.mode_count;
+        }
+    }
+
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    // rename() doesn't replace an existing file here
+    ok = MoveFileExA(tmpPath.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = rename(tmpPath.c_str(), path) == 0;
+#endif
+    if (!ok) remove(tmpPath.c_str());
+    return ok;
+}
+
+}
+
+RplidarCapabilityProfile::RplidarCapabilityProfile()
+    : conf_supported(false)
+    , typical_mode(RPLIDAR_CONF_SCAN_COMMAND_STD)
+{
+    memset(&devinfo, 0, sizeof(devinfo));
+}
+
+const RplidarScanMode * RplidarCapabilityProfile::findMode(_u16 id) const
+{
+    for (size_t pos = 0; pos < modes.size(); ++pos) {
+        if (modes[pos].id == id) return &modes[pos];
+    }
+    return NULL;
+}
+
+bool RplidarCapabilityProfile::matches(const rplidar_response_device_info_t & info) const
+{
+    return devinfo.model == info.model
+        && devinfo.firmware_version == info.firmware_version
+        && devinfo.hardware_version == info.hardware_version
+        && memcmp(devinfo.serialnum, info.serialnum, sizeof(info.serialnum)) == 0;
+}
+
+bool RplidarCapabilityProfile::Load(const char * path, const rplidar_response_device_info_t & info, RplidarCapabilityProfile & profile)
+{
+    std::vector<RplidarCapabilityProfile> profiles;
+    {
+        rp::hal::AutoLocker l(s_fileLock);
+        readProfiles(path, profiles);
+    }
+
+    for (size_t pos = 0; pos < profiles.size(); ++pos) {
+        if (profiles[pos].matches(info)) {
+            profile = profiles[pos];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RplidarCapabilityProfile::Save(const char * path, const RplidarCapabilityProfile & profile)
+{
+    rp::hal::AutoLocker l(s_fileLock);
+
+    // a damaged or outdated file is simply started over
+    std::vector<RplidarCapabilityProfile> profiles;
+    if (!readProfiles(path, profiles)) profiles.clear();
+
+    size_t pos = 0;
+    while (pos < profiles.size() && !profiles[pos].matches(profile.devinfo)) ++pos;
+    if (pos < profiles.size()) {
+        profiles[pos] = profile;
+    } else {
+        if (profiles.size() >= MAX_PROFILE_COUNT) profiles.erase(profiles.begin());
+        profiles.push_back(profile);
+    }
+    return writeProfiles(path, profiles);
+}
+
+}}}
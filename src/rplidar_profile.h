@@ -0,0 +1,63 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// What a lidar can do, probed once per device and kept in a small cache file so the next
+// connect can skip the configuration queries. Keyed by serial number, firmware and hardware version.
+// Motor control is not part of it, that depends on the accessory board the lidar is plugged into.
+struct RplidarCapabilityProfile
+{
+    rplidar_response_device_info_t  devinfo;
+    bool                            conf_supported;     // firmware 1.24+ answers RPLIDAR_CMD_GET_LIDAR_CONF
+    _u16                            typical_mode;
+    std::vector<RplidarScanMode>    modes;
+
+    RplidarCapabilityProfile();
+
+    const RplidarScanMode * findMode(_u16 id) const;
+    bool matches(const rplidar_response_device_info_t & info) const;
+
+    // false if the file has no profile for the device
+    static bool Load(const char * path, const rplidar_response_device_info_t & info, RplidarCapabilityProfile & profile);
+    // replaces the profile of the same device and keeps the others
+    static bool Save(const char * path, const RplidarCapabilityProfile & profile);
+};
+
+}}}
@@ -0,0 +1,618 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include "hal/abs_rxtx.h"
+#include "hal/thread.h"
+#include "hal/types.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+#include "hal/ringbuffer.h"
+#include "rplidar_profile.h"
+#include "rplidar_driver_impl.h"
+#include "rplidar_reactor.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#if defined(RPLIDAR_USE_IO_URING)
+#include <sys/eventfd.h>
+#include <poll.h>
+#endif
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+#if defined(__linux__)
+
+RPlidarReactor * RPlidarReactor::CreateReactor(size_t workerCount, const RplidarRealtimeProfile * profile, _u32 flags)
+{
+    RPlidarReactorImpl * reactor = new RPlidarReactorImpl(workerCount, profile, flags);
+    if (IS_FAIL(reactor->start())) {
+        delete reactor;
+        return NULL;
+    }
+    return reactor;
+}
+
+RPlidarReactorImpl::RPlidarReactorImpl(size_t workerCount, const RplidarRealtimeProfile * profile, _u32 flags)
+    :
+#if defined(RPLIDAR_USE_IO_URING)
+      _wakefd(-1)
+    , _wakeArmed(false)
+    , _timeoutArmed(false)
+    , 
+#endif
+      _epollfd(-1)
+    , _isRunning(false)
+    , _workerCount(workerCount)
+    , _flags(flags)
+    , _backend(REACTOR_BACKEND_EPOLL)
+    , _rt_enabled(profile != NULL)
+{
+    if (_workerCount < 1) _workerCount = 1;
+    if (_workerCount > MAX_WORKERS) _workerCount = MAX_WORKERS;
+
+    memset(&_rt_profile, 0, sizeof(_rt_profile));
+    if (profile) _rt_profile = *profile;
+
+    _stats.wait_calls = 0;
+    _stats.read_calls = 0;
+    _stats.completions = 0;
+    _stats.bytes_received = 0;
+}
+
+RPlidarReactorImpl::~RPlidarReactorImpl()
+{
+    stop();
+}
+
+u_result RPlidarReactorImpl::start()
+{
+    if (_rt_enabled && _rt_profile.lock_memory) rp::hal::Thread::lockMemory();
+
+#if defined(RPLIDAR_USE_IO_URING)
+    if (!(_flags & REACTOR_FLAG_NO_IO_URING) && _uringOpen()) {
+        _backend = REACTOR_BACKEND_IO_URING;
+    }
+#endif
+    if (_backend == REACTOR_BACKEND_EPOLL) {
+        _epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (_epollfd < 0) return RESULT_OPERATION_FAIL;
+    }
+
+    _isRunning = true;
+    _iothread = CLASS_THREAD(RPlidarReactorImpl, _ioProc);
+    if (_iothread.getHandle() == 0) {
+        stop();
+        return RESULT_OPERATION_FAIL;
+    }
+    for (size_t pos = 0; pos < _workerCount; ++pos) {
+        _workers[pos] = CLASS_THREAD(RPlidarReactorImpl, _workerProc);
+    }
+    return RESULT_OK;
+}
+
+void RPlidarReactorImpl::stop()
+{
+    _isRunning = false;
+    _iothread.join();
+    for (size_t pos = 0; pos < _workerCount; ++pos) {
+        _workers[pos].join();
+    }
+
+    if (_epollfd >= 0) {
+        ::close(_epollfd);
+        _epollfd = -1;
+    }
+#if defined(RPLIDAR_USE_IO_URING)
+    _uring.close();
+    if (_wakefd >= 0) {
+        ::close(_wakefd);
+        _wakefd = -1;
+    }
+    _closing.clear();
+#endif
+    for (size_t pos = 0; pos < _sources.size(); ++pos) {
+        delete _sources[pos];
+    }
+    _sources.clear();
+    _pending.clear();
+}
+
+u_result RPlidarReactorImpl::addDriver(RPlidarDriverImplCommon * driver)
+{
+    int fd = driver->_chanDev->getNativeHandle();
+    if (fd < 0) return RESULT_OPERATION_NOT_SUPPORT;
+
+    // the sockets block with a receive timeout, a read must never hold the I/O thread
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) return RESULT_OPERATION_FAIL;
+
+    Source * source = new Source(driver, fd, flags);
+    if (_rt_enabled && _rt_profile.lock_memory) source->ring.prefault();
+    _drainChannel(source);
+
+    {
+        rp::hal::AutoLocker l(_sourceLock);
+        if (_backend == REACTOR_BACKEND_EPOLL) {
+            epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.ptr = source;
+            if (epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                fcntl(fd, F_SETFL, flags);
+                delete source;
+                return RESULT_OPERATION_FAIL;
+            }
+        }
+        _sources.push_back(source);
+    }
+
+    if (source->ring.size()) _queueSource(source);
+#if defined(RPLIDAR_USE_IO_URING)
+    // the I/O thread arms the first read
+    if (_backend == REACTOR_BACKEND_IO_URING) _wake();
+#endif
+    return RESULT_OK;
+}
+
+void RPlidarReactorImpl::removeDriver(RPlidarDriverImplCommon * driver)
+{
+    Source * source = NULL;
+    {
+        // once it is out of _sources the I/O thread won't start reads on it anymore
+        rp::hal::AutoLocker l(_sourceLock);
+        for (size_t pos = 0; pos < _sources.size(); ++pos) {
+            if (_sources[pos]->driver == driver) {
+                source = _sources[pos];
+                _sources.erase(_sources.begin() + pos);
+                break;
+            }
+        }
+        if (!source) return;
+
+        if (_backend == REACTOR_BACKEND_EPOLL) {
+            epoll_ctl(_epollfd, EPOLL_CTL_DEL, source->fd, NULL);
+            source->detached = true;
+        }
+#if defined(RPLIDAR_USE_IO_URING)
+        else {
+            // the reads in flight still point into it, the I/O thread cancels them
+            _closing.push_back(source);
+        }
+#endif
+    }
+#if defined(RPLIDAR_USE_IO_URING)
+    if (_backend == REACTOR_BACKEND_IO_URING) _wake();
+#endif
+
+    // take it off the queue and wait for a worker that is still decoding it
+    for (;;) {
+        bool detached;
+        {
+            rp::hal::AutoLocker l(_sourceLock);
+            detached = source->detached;
+        }
+        {
+            rp::hal::AutoLocker l(_queueLock);
+            source->active = false;
+            _pending.erase(std::remove(_pending.begin(), _pending.end(), source), _pending.end());
+            if (!source->decoding && detached) break;
+        }
+        delay(1);
+    }
+    // the channel reads the fd again
+    fcntl(source->fd, F_SETFL, source->fdFlags);
+    delete source;
+}
+
+void RPlidarReactorImpl::_drainChannel(Source * source)
+{
+    // a buffered channel (TCP, UDP) may already hold the first bytes of the scan behind the answer header
+    _u8 buffer[READ_BLOCK_SIZE];
+    size_t avail = 0;
+    while (source->driver->_chanDev->waitfordata(1, 0, &avail) && avail) {
+        int recvSize = source->driver->_chanDev->recvdata(buffer, std::min(avail, sizeof(buffer)));
+        if (recvSize <= 0) break;
+        source->driver->_countRecv((size_t)recvSize, source->ring.write(buffer, (size_t)recvSize));
+    }
+}
+
+void RPlidarReactorImpl::_queueSource(Source * source)
+{
+    {
+        rp::hal::AutoLocker l(_queueLock);
+        if (!source->active || source->queued) return;
+        source->queued = true;
+        _pending.push_back(source);
+    }
+    _queueEvt.set();
+}
+
+void RPlidarReactorImpl::_readSource(Source * source)
+{
+    _u8 buffer[4096];
+
+    source->driver->_stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+    for (;;) {
+        ssize_t recvSize = ::read(source->fd, buffer, sizeof(buffer));
+        _stats.read_calls.fetch_add(1, std::memory_order_relaxed);
+        if (recvSize <= 0) break;
+
+        // whatever doesn't fit is dropped, the decoder resyncs on the next frame
+        source->driver->_countRecv((size_t)recvSize, source->ring.write(buffer, (size_t)recvSize));
+        _stats.completions.fetch_add(1, std::memory_order_relaxed);
+        _stats.bytes_received.fetch_add((size_t)recvSize, std::memory_order_relaxed);
+        if ((size_t)recvSize < sizeof(buffer)) break;
+    }
+    _queueSource(source);
+}
+
+u_result RPlidarReactorImpl::_ioProc()
+{
+    RPLIDAR_TRACE_THREAD("reactor io");
+    if (_rt_enabled) RPlidarDriverImplCommon::_applyRealtimeProfile(_rt_profile, _rt_profile.io_cpu_mask);
+#if defined(RPLIDAR_USE_IO_URING)
+    if (_backend == REACTOR_BACKEND_IO_URING) return _uringProc();
+#endif
+    epoll_event events[32];
+
+    while (_isRunning) {
+        int count = epoll_wait(_epollfd, events, _countof(events), WAIT_TIMEOUT);
+        _stats.wait_calls.fetch_add(1, std::memory_order_relaxed);
+        if (count <= 0) continue;
+
+        rp::hal::AutoLocker l(_sourceLock);
+        for (int pos = 0; pos < count; ++pos) {
+            Source * source = (Source *)events[pos].data.ptr;
+            // it may have been removed after epoll_wait returned
+            if (std::find(_sources.begin(), _sources.end(), source) == _sources.end()) continue;
+
+            if (events[pos].events & EPOLLIN) _readSource(source);
+            if (events[pos].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                // the port or the connection is gone, stop polling it; the driver will time out on its own
+                epoll_ctl(_epollfd, EPOLL_CTL_DEL, source->fd, NULL);
+            }
+        }
+    }
+    return RESULT_OK;
+}
+
+#if defined(RPLIDAR_USE_IO_URING)
+
+bool RPlidarReactorImpl::_uringOpen()
+{
+    static const _u8 REQUIRED_OPS[] = { IORING_OP_POLL_ADD, IORING_OP_READ, IORING_OP_ASYNC_CANCEL, IORING_OP_TIMEOUT };
+    if (!_uring.open(URING_ENTRIES, REQUIRED_OPS, _countof(REQUIRED_OPS))) return false;
+
+    _wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakefd < 0) {
+        _uring.close();
+        return false;
+    }
+    _waitTimeout.tv_sec = 0;
+    _waitTimeout.tv_nsec = WAIT_TIMEOUT * 1000000LL;
+    return true;
+}
+
+void RPlidarReactorImpl::_wake()
+{
+    _u64 value = 1;
+    if (::write(_wakefd, &value, sizeof(value)) < 0) {
+        // already signalled
+    }
+}
+
+bool RPlidarReactorImpl::_uringArmSource(Source * source)
+{
+    // the read waits for the poll, addDriver() made the fd non-blocking so it would return EAGAIN right away
+    if (_uring.freeSqes() < 2) return false;
+
+    _u8 * block;
+    size_t size = source->ring.writeBlock(&block);
+    source->inPlace = size >= READ_BLOCK_SIZE;
+    if (!source->inPlace) {
+        // too little contiguous space, a datagram would be cut; what doesn't fit is dropped later
+        block = source->buffer;
+        size = sizeof(source->buffer);
+    }
+
+    io_uring_sqe * sqe = _uring.getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = source->fd;
+    sqe->poll_events = POLLIN | POLLRDHUP;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = (_u64)(uintptr_t)source | URING_OP_POLL;
+
+    sqe = _uring.getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = source->fd;
+    sqe->off = (_u64)-1;
+    sqe->addr = (_u64)(uintptr_t)block;
+    sqe->len = (_u32)size;
+    sqe->user_data = (_u64)(uintptr_t)source | URING_OP_READ;
+
+    source->inflight = 2;
+    return true;
+}
+
+void RPlidarReactorImpl::_uringCancelSource(Source * source)
+{
+    if (_uring.freeSqes() < 2) return;
+
+    const _u64 ops[] = { URING_OP_POLL, URING_OP_READ };
+    for (size_t pos = 0; pos < _countof(ops); ++pos) {
+        io_uring_sqe * sqe = _uring.getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (_u64)(uintptr_t)source | ops[pos];
+        sqe->user_data = (_u64)(uintptr_t)source | URING_OP_CANCEL;
+    }
+    source->cancelled = true;
+}
+
+void RPlidarReactorImpl::_uringArm()
+{
+    rp::hal::AutoLocker l(_sourceLock);
+
+    for (size_t pos = 0; pos < _closing.size(); ) {
+        Source * source = _closing[pos];
+        if (!source->inflight) {
+            source->detached = true;
+            _closing.erase(_closing.begin() + pos);
+            continue;
+        }
+        if (!source->cancelled) _uringCancelSource(source);
+        ++pos;
+    }
+
+    // new sources and those whose read completed; when the queue is full the rest wait a round
+    for (size_t pos = 0; pos < _sources.size(); ++pos) {
+        Source * source = _sources[pos];
+        if (source->failed || source->inflight) continue;
+        if (!_uringArmSource(source)) break;
+    }
+
+    if (!_wakeArmed) {
+        io_uring_sqe * sqe = _uring.getSqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = _wakefd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data = URING_WAKE;
+            _wakeArmed = true;
+        }
+    }
+    if (!_timeoutArmed) {
+        io_uring_sqe * sqe = _uring.getSqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = (_u64)(uintptr_t)&_waitTimeout;
+            sqe->len = 1;
+            sqe->user_data = URING_TIMEOUT;
+            _timeoutArmed = true;
+        }
+    }
+}
+
+void RPlidarReactorImpl::_uringComplete(const io_uring_cqe & cqe)
+{
+    if (cqe.user_data == URING_WAKE) {
+        _u64 value;
+        if (::read(_wakefd, &value, sizeof(value)) < 0) {
+            // a wake between the poll and now was folded into this one
+        }
+        _wakeArmed = false;
+        return;
+    }
+    if (cqe.user_data == URING_TIMEOUT) {
+        _timeoutArmed = false;
+        return;
+    }
+
+    _u32 op = (_u32)(cqe.user_data & URING_OP_MASK);
+    if (op == URING_OP_CANCEL) return;
+
+    Source * source = (Source *)(uintptr_t)(cqe.user_data & ~(_u64)URING_OP_MASK);
+    --source->inflight;
+
+    if (op == URING_OP_POLL) {
+        if (cqe.res < 0) {
+            // the linked read is cancelled with it
+            if (cqe.res != -ECANCELED) source->failed = true;
+        } else if (cqe.res & (POLLERR | POLLHUP | POLLRDHUP | POLLNVAL)) {
+            // take what is left, then stop
+            source->hangup = true;
+        }
+        return;
+    }
+
+    if (cqe.res > 0) {
+        size_t recvSize = (size_t)cqe.res;
+        size_t stored;
+        if (source->inPlace) {
+            source->ring.commitWrite(recvSize);
+            stored = recvSize;
+        } else {
+            // whatever doesn't fit is dropped, the decoder resyncs on the next frame
+            stored = source->ring.write(source->buffer, recvSize);
+        }
+        source->driver->_stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+        source->driver->_countRecv(recvSize, stored);
+        _stats.completions.fetch_add(1, std::memory_order_relaxed);
+        _stats.bytes_received.fetch_add(recvSize, std::memory_order_relaxed);
+        _queueSource(source);
+    } else if (cqe.res == 0 || (cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECANCELED)) {
+        // EOF on a connection, or the port went away; the driver will time out on its own
+        if (cqe.res < 0 || source->hangup) source->failed = true;
+    }
+    if (source->hangup && !source->inflight) source->failed = true;
+}
+
+void RPlidarReactorImpl::_uringDrain()
+{
+    // nothing may complete into the rings after they are deleted
+    {
+        rp::hal::AutoLocker l(_sourceLock);
+        for (size_t pos = 0; pos < _sources.size(); ++pos) {
+            _sources[pos]->failed = true;
+            if (_sources[pos]->inflight && !_sources[pos]->cancelled) _uringCancelSource(_sources[pos]);
+        }
+    }
+
+    _u32 startTs = getms();
+    while (getms() - startTs < 1000) {
+        bool busy = false;
+        {
+            rp::hal::AutoLocker l(_sourceLock);
+            for (size_t pos = 0; pos < _sources.size(); ++pos) busy = busy || _sources[pos]->inflight;
+            for (size_t pos = 0; pos < _closing.size(); ++pos) busy = busy || _closing[pos]->inflight;
+        }
+        if (!busy) break;
+
+        _uringArm();
+        _uring.submitAndWait(1);
+        io_uring_cqe cqe;
+        rp::hal::AutoLocker l(_sourceLock);
+        while (_uring.popCqe(cqe)) _uringComplete(cqe);
+    }
+}
+
+u_result RPlidarReactorImpl::_uringProc()
+{
+    while (_isRunning) {
+        _uringArm();
+
+        // one system call submits the new reads and waits for the next batch of completions
+        int ans = _uring.submitAndWait(1);
+        _stats.wait_calls.fetch_add(1, std::memory_order_relaxed);
+        if (ans < 0 && ans != -EINTR && ans != -EBUSY && ans != -EAGAIN) break;
+
+        io_uring_cqe cqe;
+        rp::hal::AutoLocker l(_sourceLock);
+        while (_uring.popCqe(cqe)) _uringComplete(cqe);
+    }
+    _uringDrain();
+    return RESULT_OK;
+}
+
+#endif
+
+u_result RPlidarReactorImpl::_workerProc()
+{
+    RPLIDAR_TRACE_THREAD("reactor worker");
+    if (_rt_enabled) RPlidarDriverImplCommon::_applyRealtimeProfile(_rt_profile, _rt_profile.decode_cpu_mask);
+    _u8 buffer[4096];
+
+    while (_isRunning) {
+        _queueEvt.wait(100);
+
+        for (;;) {
+            Source * source;
+            {
+                rp::hal::AutoLocker l(_queueLock);
+                if (_pending.empty()) break;
+                source = _pending.front();
+                _pending.erase(_pending.begin());
+                source->decoding = true;
+                // let another worker pick up the rest of the queue
+                if (!_pending.empty()) _queueEvt.set();
+            }
+
+            RPLIDAR_TRACE_SCOPE("reactor decode");
+            size_t size;
+            while ((size = source->ring.read(buffer, sizeof(buffer))) != 0) {
+                source->driver->_feedScanData(buffer, size);
+            }
+
+            bool requeue = false;
+            {
+                rp::hal::AutoLocker l(_queueLock);
+                source->decoding = false;
+                source->queued = false;
+                // bytes that arrived while decoding were not queued again by the I/O thread
+                if (source->active && source->ring.size()) {
+                    source->queued = true;
+                    _pending.push_back(source);
+                    requeue = true;
+                }
+            }
+            if (requeue) _queueEvt.set();
+        }
+    }
+    return RESULT_OK;
+}
+
+#else
+
+RPlidarReactor * RPlidarReactor::CreateReactor(size_t, const RplidarRealtimeProfile *, _u32)
+{
+    // there is no epoll on this platform, drivers keep their own threads
+    return NULL;
+}
+
+u_result RPlidarReactorImpl::addDriver(RPlidarDriverImplCommon *)
+{
+    return RESULT_OPERATION_NOT_SUPPORT;
+}
+
+void RPlidarReactorImpl::removeDriver(RPlidarDriverImplCommon *)
+{
+}
+
+#endif
+
+void RPlidarReactor::DisposeReactor(RPlidarReactor * reactor)
+{
+    delete reactor;
+}
+
+_u32 RPlidarReactorImpl::getBackend()
+{
+    return _backend;
+}
+
+void RPlidarReactorImpl::getStats(RplidarReactorStats & stats)
+{
+    stats.wait_calls = _stats.wait_calls.load(std::memory_order_relaxed);
+    stats.read_calls = _stats.read_calls.load(std::memory_order_relaxed);
+    stats.completions = _stats.completions.load(std::memory_order_relaxed);
+    stats.bytes_received = _stats.bytes_received.load(std::memory_order_relaxed);
+}
+
+}}}
@@ -0,0 +1,156 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include "hal/ringbuffer.h"
+#include <vector>
+#include <atomic>
+
+#if defined(RPLIDAR_USE_IO_URING)
+#include "arch/linux/io_uring.h"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+class RPlidarDriverImplCommon;
+
+class RPlidarReactorImpl : public RPlidarReactor
+{
+public:
+    enum {
+        RING_BUFFER_SIZE = 64 * 1024,
+        MAX_WORKERS = 16,
+        READ_BLOCK_SIZE = 4096,     // io_uring reads into less free ring space than this go through Source::buffer
+        URING_ENTRIES = 256,
+        WAIT_TIMEOUT = 100,         // ms, the I/O thread looks at _isRunning at least this often
+    };
+
+    RPlidarReactorImpl(size_t workerCount, const RplidarRealtimeProfile * profile = NULL, _u32 flags = 0);
+    virtual ~RPlidarReactorImpl();
+
+    u_result start();
+    void     stop();
+
+    // called by the driver when it starts and stops scanning
+    u_result addDriver(RPlidarDriverImplCommon * driver);
+    void     removeDriver(RPlidarDriverImplCommon * driver);
+
+    virtual _u32 getBackend();
+    virtual void getStats(RplidarReactorStats & stats);
+
+protected:
+    struct Source {
+        RPlidarDriverImplCommon *   driver;
+        int                         fd;
+        int                         fdFlags;    // as the channel left them, restored by removeDriver()
+        rp::hal::RingBuffer         ring;
+        bool                        queued;     // waiting in _pending or being decoded
+        bool                        active;
+        bool                        decoding;
+
+        // io_uring only, owned by the I/O thread under _sourceLock
+        int                         inflight;   // poll and read requests not completed yet
+        bool                        inPlace;    // the read in flight targets the ring itself
+        bool                        hangup;
+        bool                        failed;     // the port is gone, no more reads
+        bool                        cancelled;
+        bool                        detached;   // no request refers to it anymore, it may be deleted
+        _u8                         buffer[READ_BLOCK_SIZE];
+
+        Source(RPlidarDriverImplCommon * drv, int handle, int flags)
+            : driver(drv), fd(handle), fdFlags(flags), ring(RING_BUFFER_SIZE), queued(false), active(true), decoding(false)
+            , inflight(0), inPlace(false), hangup(false), failed(false), cancelled(false), detached(false) {}
+    };
+
+    u_result _ioProc();
+    u_result _workerProc();
+    void     _readSource(Source * source);
+    void     _queueSource(Source * source);
+    void     _drainChannel(Source * source);
+
+#if defined(RPLIDAR_USE_IO_URING)
+    enum {
+        URING_OP_POLL   = 1,
+        URING_OP_READ   = 2,
+        URING_OP_CANCEL = 3,
+        URING_OP_MASK   = 3,
+        URING_WAKE      = URING_OP_MASK + 1,    // user_data of the requests that aren't about a source
+        URING_TIMEOUT,
+    };
+
+    bool     _uringOpen();
+    u_result _uringProc();
+    bool     _uringArmSource(Source * source);
+    void     _uringCancelSource(Source * source);
+    void     _uringArm();
+    void     _uringComplete(const io_uring_cqe & cqe);
+    void     _uringDrain();
+    void     _wake();
+
+    rp::arch::io_uring_queue    _uring;
+    int                         _wakefd;
+    bool                        _wakeArmed;
+    bool                        _timeoutArmed;
+    __kernel_timespec           _waitTimeout;
+    std::vector<Source *>       _closing;       // removed sources with requests in flight
+#endif
+
+    int                     _epollfd;
+    volatile bool           _isRunning;
+    size_t                  _workerCount;
+    _u32                    _flags;
+    _u32                    _backend;
+    bool                    _rt_enabled;
+    RplidarRealtimeProfile  _rt_profile;
+
+    struct {
+        std::atomic<_u64>   wait_calls;
+        std::atomic<_u64>   read_calls;
+        std::atomic<_u64>   completions;
+        std::atomic<_u64>   bytes_received;
+    } _stats;
+
+    rp::hal::Locker         _sourceLock;    // guards _sources against the I/O thread
+    std::vector<Source *>   _sources;
+
+    rp::hal::Locker         _queueLock;     // guards _pending and the queued/active/decoding flags
+    rp::hal::Event          _queueEvt;
+    std::vector<Source *>   _pending;
+
+    rp::hal::Thread         _iothread;
+    rp::hal::Thread         _workers[MAX_WORKERS];
+};
+
+}}}
@@ -0,0 +1,216 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+#ifdef RPLIDAR_ENABLE_TRACE
+
+namespace {
+
+enum {
+    TRACE_BUFFER_EVENTS = 64 * 1024,
+};
+
+struct TraceEvent {
+    const char *    name;
+    _u64            ts;
+    char            phase;
+};
+
+struct TraceBuffer {
+    TraceEvent          events[TRACE_BUFFER_EVENTS];
+    std::atomic<_u64>   count;      // events ever recorded, only the newest TRACE_BUFFER_EVENTS are kept
+    std::atomic<_u64>   cleared;    // count at the last clear(), older events are not dumped
+    std::atomic<bool>   inUse;      // false once the owning thread has exited
+    _u32                tid;
+    const char *        threadName;
+};
+
+// owned by one thread, hands the buffer back for reuse when the thread exits
+struct TraceThread {
+    TraceBuffer * buffer;
+
+    TraceThread() : buffer(NULL) {}
+    ~TraceThread() {
+        if (buffer) buffer->inUse.store(false, std::memory_order_release);
+    }
+};
+
+thread_local TraceThread _traceThread;
+
+rp::hal::Locker & _buffersLock()
+{
+    static rp::hal::Locker lock;
+    return lock;
+}
+
+std::vector<TraceBuffer *> & _buffers()
+{
+    static std::vector<TraceBuffer *> buffers;
+    return buffers;
+}
+
+TraceBuffer * _threadBuffer()
+{
+    if (_traceThread.buffer) return _traceThread.buffer;
+
+    static _u32 nextTid = 1;
+    rp::hal::AutoLocker l(_buffersLock());
+
+    TraceBuffer * buffer = NULL;
+    for (size_t pos = 0; pos < _buffers().size(); ++pos) {
+        if (!_buffers()[pos]->inUse.load(std::memory_order_acquire)) {
+            buffer = _buffers()[pos];
+            break;
+        }
+    }
+    if (!buffer) {
+        buffer = new TraceBuffer;
+        _buffers().push_back(buffer);
+    }
+
+    buffer->count.store(0, std::memory_order_relaxed);
+    buffer->cleared.store(0, std::memory_order_relaxed);
+    buffer->inUse.store(true, std::memory_order_relaxed);
+    buffer->tid = nextTid++;
+    buffer->threadName = NULL;
+    _traceThread.buffer = buffer;
+    return buffer;
+}
+
+void _record(const char * name, char phase)
+{
+    TraceBuffer * buffer = _threadBuffer();
+    _u64 count = buffer->count.load(std::memory_order_relaxed);
+
+    TraceEvent & event = buffer->events[count % TRACE_BUFFER_EVENTS];
+    event.name = name;
+    event.ts = getus();
+    event.phase = phase;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void _writeString(FILE * file, const char * str)
+{
+    fputc('"', file);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') fputc('\\', file);
+        fputc(*str, file);
+    }
+    fputc('"', file);
+}
+
+}
+
+void RPlidarTrace::begin(const char * name)
+{
+    _record(name, 'B');
+}
+
+void RPlidarTrace::end(const char * name)
+{
+    _record(name, 'E');
+}
+
+void RPlidarTrace::setThreadName(const char * name)
+{
+    _threadBuffer()->threadName = name;
+}
+
+bool RPlidarTrace::dump(const char * path)
+{
+    FILE * file = fopen(path, "w");
+    if (!file) return false;
+
+    rp::hal::AutoLocker l(_buffersLock());
+    bool first = true;
+
+    fputs("{\"traceEvents\":[", file);
+    for (size_t pos = 0; pos < _buffers().size(); ++pos) {
+        TraceBuffer * buffer = _buffers()[pos];
+        _u64 count = buffer->count.load(std::memory_order_acquire);
+        _u64 start = (count > TRACE_BUFFER_EVENTS) ? (count - TRACE_BUFFER_EVENTS) : 0;
+        _u64 cleared = buffer->cleared.load(std::memory_order_relaxed);
+        if (start < cleared) start = cleared;
+
+        if (buffer->threadName) {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",", buffer->tid);
+            _writeString(file, buffer->threadName);
+            fputs("}}", file);
+            first = false;
+        }
+
+        for (_u64 index = start; index < count; ++index) {
+            const TraceEvent & event = buffer->events[index % TRACE_BUFFER_EVENTS];
+            fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+            _writeString(file, event.name);
+            fprintf(file, ",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%u}", event.phase, (unsigned long long)event.ts, buffer->tid);
+            first = false;
+        }
+    }
+    fputs("\n]}\n", file);
+
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+    return ok;
+}
+
+void RPlidarTrace::clear()
+{
+    // count belongs to the recording thread, only move the dump's starting point past it
+    rp::hal::AutoLocker l(_buffersLock());
+    for (size_t pos = 0; pos < _buffers().size(); ++pos) {
+        TraceBuffer * buffer = _buffers()[pos];
+        buffer->cleared.store(buffer->count.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+#else
+
+void RPlidarTrace::begin(const char *) {}
+void RPlidarTrace::end(const char *) {}
+void RPlidarTrace::setThreadName(const char *) {}
+bool RPlidarTrace::dump(const char *) { return false; }
+void RPlidarTrace::clear() {}
+
+#endif
+
+}}}